@@ -1,2 +1,3 @@
 #!/bin/sh
 sudo install -m 755 CppReflector /usr/bin
+sudo install -m 755 libCppReflectorLib.so /usr/lib
@@ -25,20 +25,20 @@ newoption
 	description	= "Enable OpenMP support which will add the OPENMP_ENABLED define."
 }
 
--- A solution contains projects, and defines the available configurations
-solution "CppReflector"
-   platforms { "x64", "x32"}
-   configurations { "Debug", "Release" }
- 
-   -- A project defines one build target
-   project "CppReflector"
-      kind "ConsoleApp"
+newoption
+{
+	trigger		= "alloc-stats",
+	description	= "Count heap allocations for the print_alloc_stats module, adds the ALLOC_STATS_ENABLED define."
+}
+
+-- settings of the library and the command line tool
+function ProjectSettings()
       language "C++"
-	  debugargs "--module=wildcard --module=cpp_parser --module=print_structure tests/test1.xh"
-      files { "src/**.h", "src/**.cpp", "tests/**.xh", "tests/**.xcpp", "docs/*.txt" }
       flags { "Cpp11" }
-	 
+
+      if ActionUsesGCC() then links { "pthread" } end -- std::thread for the task scheduler and the cpp_parser_mt pipeline
       if _OPTIONS['openmp'] ~= nil then EnableOpenMP() end
+      if _OPTIONS['alloc-stats'] ~= nil then defines { "ALLOC_STATS_ENABLED" } end
 
       configuration "Debug"
          defines { "DEBUG" }
@@ -47,3 +47,38 @@ solution "CppReflector"
       configuration "Release"
          defines { "NDEBUG" }
          flags { "Optimize" }
+
+      configuration {}
+end
+
+-- A solution contains projects, and defines the available configurations
+solution "CppReflector"
+   platforms { "x64", "x32"}
+   configurations { "Debug", "Release" }
+ 
+   -- The parser, the modules and the embedding API (src/cppReflector.h).
+   -- A shared library, so the modules that register themselves from static constructors are never dropped by the linker.
+   project "CppReflectorLib"
+      kind "SharedLib"
+      files { "src/**.h", "src/**.cpp", "docs/*.txt" }
+      removefiles { "src/main.cpp" }
+      defines { "CPPREFLECTOR_EXPORTS" }
+      ProjectSettings()
+
+   -- A project defines one build target
+   project "CppReflector"
+      kind "ConsoleApp"
+	  debugargs "--module=wildcard --module=cpp_parser --module=print_structure tests/test1.xh"
+      files { "src/main.cpp", "src/cppReflector.h", "tests/**.xh", "tests/**.xcpp" }
+      links { "CppReflectorLib" }
+      ProjectSettings()
+
+   -- Checks of the library internals (tests/checks*.cpp), run them with tests/run_checks.sh.
+   -- The sources are compiled in, the internals are not exported by the shared library.
+   project "CppReflectorTests"
+      kind "ConsoleApp"
+      files { "src/**.h", "src/**.cpp", "tests/**.h", "tests/**.cpp" }
+      removefiles { "src/main.cpp" }
+      includedirs { "src" }
+      defines { "CPPREFLECTOR_STATIC" }
+      ProjectSettings()
@@ -0,0 +1,125 @@
+#include "annotationIndex.h"
+#include <algorithm>
+
+SymbolId AnnotationIndex::AnnotationName(ASTTokenNode* annotation)
+{
+	if (annotation->Tokens.empty())
+		return SymbolTable::Empty;
+
+	const CxxToken& token = annotation->tokenSource->Tokens[annotation->Tokens[0]];
+	if (token.TokenSymbol != SymbolTable::Empty)
+		return token.TokenSymbol;
+	return SymbolTable::Global().Intern(token.TokenData);
+}
+
+void AnnotationIndex::Add(ASTNode* target, ASTTokenNode* annotation)
+{
+	Entry entry;
+	entry.target = target;
+	entry.annotation = annotation;
+	for (auto it : annotation->Children())
+	{
+		if (it->GetType() != ASTNode::Type::AntArgs)
+			continue;
+		for (auto itArg : it->Children())
+			entry.arguments.push_back(static_cast<ASTTokenNode*>(itArg));
+	}
+
+	SymbolId name = AnnotationName(annotation);
+	std::lock_guard<std::mutex> lk(m_lock);
+	auto& list = m_entries[name];
+	if (list.empty())
+		m_names.push_back(name);
+	list.push_back(std::move(entry));
+}
+
+void AnnotationIndex::Merge(const AnnotationIndex& other)
+{
+	std::lock_guard<std::mutex> lkOther(other.m_lock);
+	std::lock_guard<std::mutex> lk(m_lock);
+	for (auto name : other.m_names)
+	{
+		auto& from = other.m_entries.find(name)->second;
+		auto& list = m_entries[name];
+		if (list.empty())
+			m_names.push_back(name);
+		list.insert(list.end(), from.begin(), from.end());
+	}
+}
+
+void AnnotationIndex::Remove(const AnnotationIndex& other)
+{
+	std::lock_guard<std::mutex> lkOther(other.m_lock);
+	std::lock_guard<std::mutex> lk(m_lock);
+	for (auto name : other.m_names)
+	{
+		auto found = m_entries.find(name);
+		if (found == m_entries.end())
+			continue;
+
+		// entries are identified by the annotation node, every node is added once
+		auto& from = other.m_entries.find(name)->second;
+		auto& list = found->second;
+		list.erase(std::remove_if(list.begin(), list.end(), [&](const Entry& e)
+		{
+			for (auto& it : from)
+			{
+				if (it.annotation == e.annotation)
+					return true;
+			}
+			return false;
+		}), list.end());
+		if (list.empty())
+		{
+			m_entries.erase(found);
+			m_names.erase(std::remove(m_names.begin(), m_names.end(), name), m_names.end());
+		}
+	}
+}
+
+void AnnotationIndex::Clear()
+{
+	std::lock_guard<std::mutex> lk(m_lock);
+	m_entries.clear();
+	m_names.clear();
+}
+
+std::vector<AnnotationIndex::Entry> AnnotationIndex::Find(SymbolId name) const
+{
+	std::lock_guard<std::mutex> lk(m_lock);
+	auto found = m_entries.find(name);
+	if (found == m_entries.end())
+		return std::vector<Entry>();
+	return found->second;
+}
+
+void AnnotationIndex::ForEach(SymbolId name, const std::function<void(const Entry&)>& fn) const
+{
+	std::lock_guard<std::mutex> lk(m_lock);
+	auto found = m_entries.find(name);
+	if (found == m_entries.end())
+		return;
+	for (auto& it : found->second)
+		fn(it);
+}
+
+std::vector<SymbolId> AnnotationIndex::Names() const
+{
+	std::lock_guard<std::mutex> lk(m_lock);
+	return m_names;
+}
+
+size_t AnnotationIndex::Count() const
+{
+	std::lock_guard<std::mutex> lk(m_lock);
+	size_t ret = 0;
+	for (auto& it : m_entries)
+		ret += it.second.size();
+	return ret;
+}
+
+AnnotationIndex& AnnotationIndex::Global()
+{
+	static AnnotationIndex gAnnotations;
+	return gAnnotations;
+}
@@ -0,0 +1,46 @@
+#pragma once
+
+#include <vector>
+#include <unordered_map>
+#include <mutex>
+#include <functional>
+#include "ast.h"
+#include "symbols.h"
+
+// Index from interned annotation name to the annotated declarations.
+// Every parser fills its own index when parsing finishes, the cpp_parser module merges them into AnnotationIndex::Global().
+// Streamed files are merged before they are handed to the next modules and removed again when their tree is released.
+class AnnotationIndex
+{
+public:
+	struct Entry
+	{
+		ASTNode* target;						// annotated declaration (class, DCL_SUB, TYPEDEF_SUB, ...)
+		ASTTokenNode* annotation;				// ANNOTATION_FWD / ANNOTATION_BACK node, Tokens[0] is the name
+		SmallVector<ASTTokenNode*, 2> arguments;	// ANT_ARG nodes, each holds the tokens of one argument
+	};
+
+	void Add(ASTNode* target, ASTTokenNode* annotation);
+	void Merge(const AnnotationIndex& other);
+	// removes the entries of other (a file whose tree is released)
+	void Remove(const AnnotationIndex& other);
+	void Clear();
+
+	// copy of the entries, an empty list when the annotation is not used anywhere
+	std::vector<Entry> Find(SymbolId name) const;
+	std::vector<Entry> Find(const std::string& name) const { return Find(symbols::Find(name)); }
+	// calls fn for every entry of name with the lock held, fn must not use the index
+	void ForEach(SymbolId name, const std::function<void(const Entry&)>& fn) const;
+
+	// interned names of all annotations in the index, in order of first use
+	std::vector<SymbolId> Names() const;
+	size_t Count() const;
+
+	static SymbolId AnnotationName(ASTTokenNode* annotation);
+	static AnnotationIndex& Global();
+
+protected:
+	mutable std::mutex m_lock;
+	std::unordered_map<SymbolId, std::vector<Entry> > m_entries;
+	std::vector<SymbolId> m_names;
+};
@@ -1,5 +1,14 @@
 #include "ast.h"
 #include "tools.h"
+#include "canonicalTypes.h"
+
+void ASTAnnotationList::Assign(ASTNode* const* a_begin, size_t a_count)
+{
+	m_data.reset(a_count > 0 ? new ASTNode*[a_count] : 0);
+	m_count = a_count;
+	for (size_t i = 0; i < a_count; i++)
+		m_data[i] = a_begin[i];
+}
 
 std::vector<ASTNode*> ASTNode::GatherChildrenRecursively() const
 {
@@ -34,19 +43,60 @@ ASTNode* ASTNode::GetNextSibling() const
 		return parent->Children()[parentIndex + 1];
 }
 
-void ASTNode::DestroyChildren()
+void ASTNode::DeleteChildren()
 {
 	for (auto it : m_children) 
 	{ 
-		it->DestroyChildren(); 
+		it->DeleteChildren(); 
 		delete it; 
 	} 
 	m_children.clear();
 }
 
+void ASTNode::DestroyChildrenFrom(size_t index)
+{
+	if (index >= m_children.size())
+		return;
+	InvalidateStructuralHash();
+	for (size_t i = index; i < m_children.size(); i++)
+	{
+		m_children[i]->DeleteChildren();
+		delete m_children[i];
+	}
+	m_children.resize(index);
+}
+
+void ASTNode::ClearChildrenWithoutDestruction()
+{
+	InvalidateStructuralHash();
+	for (auto it : m_children)
+	{
+		it->parent = 0;
+		it->parentIndex = -1;
+	}
+	m_children.clear();
+}
+
+std::vector<ASTNode*> ASTNode::DetachChildrenFrom(size_t index)
+{
+	std::vector<ASTNode*> ret;
+	if (index >= m_children.size())
+		return ret;
+	InvalidateStructuralHash();
+	ret.assign(m_children.begin() + index, m_children.end());
+	for (auto it : ret)
+	{
+		it->parent = 0;
+		it->parentIndex = -1;
+	}
+	m_children.resize(index);
+	return ret;
+}
+
 void ASTNode::StealNodesFrom(ASTNode* node)
 {
 	AddNodes(node->Children());
+	node->InvalidateStructuralHash();
 	node->m_children.clear();
 }
 
@@ -110,48 +160,32 @@ const char* ASTNode::GetTypeString() const
 	}
 }
 
-std::vector<ASTNode*> ASTNode::GatherAnnotations() const
+ASTHash ASTNode::StructuralHash()
 {
-	std::vector<ASTNode*> ret;
-	i_InnerGatherAnnotations(ret);
-	return ret;
-}
+	if (structuralHash != 0)
+		return structuralHash;
 
-void ASTNode::i_InnerGatherAnnotations(std::vector<ASTNode*>& list) const
-{
-	auto* prev = GetPreviousSibling();
-	while (prev && prev->GetType() == Type::AntFwd)
-	{
-		list.insert(list.begin(), prev);
-		prev = prev->GetPreviousSibling();
-	}
+	unsigned int typeValue = (unsigned int)GetType();
+	ASTHash h = tools::Hash64(&typeValue, sizeof(typeValue));
+	h = ContentHash(h);
 
-	auto* next = GetNextSibling();
-	while (next && next->GetType() == Type::AntBack)
+	// children in order, the count separates the content from the children
+	unsigned int childCount = (unsigned int)m_children.size();
+	h = tools::Hash64(&childCount, sizeof(childCount), h);
+	for (auto it : m_children)
 	{
-		list.push_back(next);
-		next = next->GetNextSibling();
+		ASTHash childHash = it->StructuralHash();
+		h = tools::Hash64(&childHash, sizeof(childHash), h);
 	}
 
-	auto* parent = GetParent();
-	if (parent)
-	{
-		switch (parent->GetType())
-		{
-			case ASTNode::Type::Typedef:
-			case ASTNode::Type::TypedefHead:
-			case ASTNode::Type::Template:
-			case ASTNode::Type::TemplateContent:
-			case ASTNode::Type::DclHead:
-				parent->i_InnerGatherAnnotations(list);
-				break;
-			default:
-				break;
-		}
-	}
+	// final avalanche so similar subtrees spread over all bits
+	h ^= h >> 33;
+	h *= 0xff51afd7ed558ccdULL;
+	h ^= h >> 33;
+	structuralHash = h;
+	return structuralHash;
 }
 
-
 std::vector<ASTNode*> ASTNode::GatherParents() const
 {
 	std::vector<ASTNode*> ret;
@@ -166,305 +200,406 @@ std::vector<ASTNode*> ASTNode::GatherParents() const
 }
 
 
-std::string ASTPointerType::ToString()
+void ASTPointerType::AppendToString(std::string& out)
 {
-	std::string ret;
 	if (pointerType == Type::Pointer)
-		ret = "*";
+		out.push_back('*');
 	else
-		ret = "&";
+		out.push_back('&');
 	for (auto& it : pointerModifiers)
-		ret += " " + it.TokenData;
+	{
+		out.push_back(' ');
+		out.append(it.TokenData);
+	}
+}
+
+std::string ASTPointerType::ToString()
+{
+	std::string ret;
+	AppendToString(ret);
 	return ret;
 }
 
+// appends a space unless nothing was rendered since start, or the buffer already ends in whitespace
+static void AppendSpaceIfNeeded(std::string& out, size_t start)
+{
+	if (out.size() == start)
+		return;
+	if (out.back() == '\t' || out.back() == ' ')
+		return;
+	out.push_back(' ');
+}
 
+// removes the trailing space of a separated list, unless nothing was rendered since start
+static void RemoveTrailingSpace(std::string& out, size_t start)
+{
+	if (out.size() > start && out.back() == ' ')
+		out.pop_back();
+}
 
-std::string ASTType::ToString(bool withIdentifier)
+const std::string& ASTType::ToString(bool withIdentifier)
 {
-	std::string ret;
+	unsigned char slot = withIdentifier ? SpellingFull : SpellingWithoutIdentifier;
+	if ((spellingCache.valid & (1 << slot)) == 0)
+	{
+		spellingCache.text[slot].clear();
+		AppendToString(spellingCache.text[slot], withIdentifier);
+		spellingCache.valid |= (1 << slot);
+	}
+	return spellingCache.text[slot];
+}
 
-	/*if (head != 0)
+const std::string& ASTType::ToNameString(bool includeTemplateArguments)
+{
+	unsigned char slot = includeTemplateArguments ? SpellingName : SpellingNameWithoutTemplateArguments;
+	if ((spellingCache.valid & (1 << slot)) == 0)
 	{
-	GetHeadSub();
+		spellingCache.text[slot].clear();
+		AppendNameString(spellingCache.text[slot], includeTemplateArguments);
+		spellingCache.valid |= (1 << slot);
+	}
+	return spellingCache.text[slot];
+}
 
-	return t.ToString();
-	}*/
+void ASTType::MergeData(ASTType* other)
+{
+	typeName.insert(typeName.end(), other->typeName.begin(), other->typeName.end());
+	typeIdentifier.insert(typeIdentifier.end(), other->typeIdentifier.begin(), other->typeIdentifier.end());
+	typeModifiers.insert(typeModifiers.end(), other->typeModifiers.begin(), other->typeModifiers.end());
+	typeOperatorTokens.insert(typeOperatorTokens.end(), other->typeOperatorTokens.begin(), other->typeOperatorTokens.end());
+	typePointers.insert(typePointers.end(), other->typePointers.begin(), other->typePointers.end());
+	typeArrayTokens.insert(typeArrayTokens.end(), other->typeArrayTokens.begin(), other->typeArrayTokens.end());
+	typeTemplateIndices.insert(typeTemplateIndices.end(), other->typeTemplateIndices.begin(), other->typeTemplateIndices.end());
+	typeBitfieldTokens.insert(typeBitfieldTokens.end(), other->typeBitfieldTokens.begin(), other->typeBitfieldTokens.end());
+	typeIdentifierScopedPointers.insert(typeIdentifierScopedPointers.end(), other->typeIdentifierScopedPointers.begin(), other->typeIdentifierScopedPointers.end());
+	typeFunctionPointerArgumentIndices.insert(typeFunctionPointerArgumentIndices.end(), other->typeFunctionPointerArgumentIndices.begin(), other->typeFunctionPointerArgumentIndices.end());
 
-	// type modifiers
-	ret += ToModifiersString();
+	if (other->ndFuncArgumentList)
+		ndFuncArgumentList = other->ndFuncArgumentList;
+	if (other->ndFuncModifierList)
+		ndFuncModifierList = other->ndFuncModifierList;
+	if (other->ndFuncPointerArgumentList)
+		ndFuncPointerArgumentList = other->ndFuncPointerArgumentList;
 
-	// namespace symbol
-	/*if (typeName.size() > 0 &&
-	tokenSource->Tokens[typeName[0]].TokenType != Token::Type::BuiltinType &&
-	tokenSource->Tokens[typeName[0]].TokenType != Token::Type::Void)
-	{
-	ret += "::";
-	}*/
+	InvalidateSpelling();
+}
 
-	// name symbols
-	ret += ToNameString();
-	tools::appendSpaceIfNeeded(ret);
+ASTType ASTType::CombineWithHead()
+{
+	if (head == 0)
+		throw std::runtime_error("Type has no head. No combine is needed.");
 
-	// pointer symbols (including pointer modifiers)
-	ret += ToPointersString();
-	tools::appendSpaceIfNeeded(ret);
+	ASTType t(tokenSource);
+	t.MergeData(this);
+	t.MergeData(head);
+	return t;
+}
+
+ASTTypeView ASTType::CombinedView()
+{
+	return ASTTypeView(this, head);
+}
+
+CanonicalTypeId ASTType::GetCanonicalType()
+{
+	if (canonicalType == 0)
+		canonicalType = CanonicalTypeTable::Global().Canonicalize(ASTTypeView(this));
+	return canonicalType;
+}
 
+CanonicalTypeId ASTType::GetCombinedCanonicalType()
+{
+	if (head == 0)
+		return GetCanonicalType();
+	if (combinedCanonicalType == 0)
+		combinedCanonicalType = CanonicalTypeTable::Global().Canonicalize(ASTTypeView(this, head));
+	return combinedCanonicalType;
+}
 
+// the single type variants render through a view without head
+void ASTType::AppendToString(std::string& out, bool withIdentifier) { ASTTypeView(this).AppendToString(out, withIdentifier); }
+void ASTType::AppendPointersString(std::string& out) { ASTTypeView(this).AppendPointersString(out); }
+void ASTType::AppendArgumentsString(std::string& out) { ASTTypeView(this).AppendArgumentsString(out); }
+void ASTType::AppendOperatorString(std::string& out) { ASTTypeView(this).AppendOperatorString(out); }
+void ASTType::AppendBitfieldString(std::string& out) { ASTTypeView(this).AppendBitfieldString(out); }
+void ASTType::AppendIdentifierString(std::string& out) { ASTTypeView(this).AppendIdentifierString(out); }
+void ASTType::AppendTemplateArgumentsString(std::string& out, ASTNode* args) { ASTTypeView::AppendTemplateArgumentsString(out, args); }
+void ASTType::AppendPointerIdentifierScopedString(std::string& out) { ASTTypeView(this).AppendPointerIdentifierScopedString(out); }
+void ASTType::AppendNameString(std::string& out, bool includeTemplateArguments) { ASTTypeView(this).AppendNameString(out, includeTemplateArguments); }
+void ASTType::AppendModifiersString(std::string& out) { ASTTypeView(this).AppendModifiersString(out); }
+void ASTType::AppendFunctionModifiersString(std::string& out) { ASTTypeView(this).AppendFunctionModifiersString(out); }
+void ASTType::AppendArrayTokensString(std::string& out) { ASTTypeView(this).AppendArrayTokensString(out); }
+
+// string returning variants, these render into a temporary buffer
+std::string ASTType::ToPointersString() { std::string ret; AppendPointersString(ret); return ret; }
+std::string ASTType::ToArgumentsString() { std::string ret; AppendArgumentsString(ret); return ret; }
+std::string ASTType::ToOperatorString() { std::string ret; AppendOperatorString(ret); return ret; }
+std::string ASTType::ToBitfieldString() { std::string ret; AppendBitfieldString(ret); return ret; }
+std::string ASTType::ToIdentifierString() { std::string ret; AppendIdentifierString(ret); return ret; }
+std::string ASTType::ToPointerIdentifierScopedString() { std::string ret; AppendPointerIdentifierScopedString(ret); return ret; }
+std::string ASTType::ToModifiersString() { std::string ret; AppendModifiersString(ret); return ret; }
+std::string ASTType::ToFunctionModifiersString() { std::string ret; AppendFunctionModifiersString(ret); return ret; }
+std::string ASTType::ToArrayTokensString() { std::string ret; AppendArrayTokensString(ret); return ret; }
+std::string ASTType::ToTemplateArgumentsString(ASTNode* args) { std::string ret; AppendTemplateArgumentsString(ret, args); return ret; }
+
+bool ASTType::IsBuiltinType() { return ASTTypeView(this).IsBuiltinType(); }
+bool ASTType::HasType() { return ASTTypeView(this).HasType(); }
+bool ASTType::HasModifier(CxxToken::Type modifierType) { return ASTTypeView(this).HasModifier(modifierType); }
+
+
+void ASTTypeView::AppendToString(std::string& out, bool withIdentifier) const
+{
+	size_t start = out.size();
+	bool hasScopedPointers = !TypeIdentifierScopedPointers().empty();
+
+	// type modifiers
+	AppendModifiersString(out);
+
+	// name symbols
+	if (head == 0)
+		out.append(type->ToNameString());
+	else
+		AppendNameString(out);
+	AppendSpaceIfNeeded(out, start);
+
+	// pointer symbols (including pointer modifiers)
+	AppendPointersString(out);
+	AppendSpaceIfNeeded(out, start);
 
 	// function pointer prefix
-	if (!typeIdentifierScopedPointers.empty())
-		ret += "(";
+	if (hasScopedPointers)
+		out.push_back('(');
 
 	// pointer identifier tokens
-	ret += ToPointerIdentifierScopedString();
-	tools::appendSpaceIfNeeded(ret);
+	AppendPointerIdentifierScopedString(out);
+	AppendSpaceIfNeeded(out, start);
 
 	// identifier
 	if (withIdentifier)
-		ret += ToIdentifierString();
+		AppendIdentifierString(out);
 
 	// function pointer suffix
-	if (!typeIdentifierScopedPointers.empty())
-		ret += ")";
-	tools::appendSpaceIfNeeded(ret);
+	if (hasScopedPointers)
+		out.push_back(')');
+	AppendSpaceIfNeeded(out, start);
 
 	// array tokens
-	ret += ToArrayTokensString();
-	tools::appendSpaceIfNeeded(ret);
+	AppendArrayTokensString(out);
+	AppendSpaceIfNeeded(out, start);
 
 	// bitfield
-	if (typeBitfieldTokens.size() > 0) ret += ": ";
-	ret += ToBitfieldString();
+	if (!TypeBitfieldTokens().empty()) out.append(": ");
+	AppendBitfieldString(out);
 
 	// operator
-	ret += ToOperatorString();
-	tools::appendSpaceIfNeeded(ret);
+	AppendOperatorString(out);
+	AppendSpaceIfNeeded(out, start);
 
 	// function arguments
-	ret += ToArgumentsString();
-	tools::appendSpaceIfNeeded(ret);
+	AppendArgumentsString(out);
+	AppendSpaceIfNeeded(out, start);
 
 	// function modifiers
-	ret += ToFunctionModifiersString();
+	AppendFunctionModifiersString(out);
 
 	// remove trailing space
-	if (ret.size() > 0 && ret.back() == ' ')
-		ret.pop_back();
+	RemoveTrailingSpace(out, start);
+}
 
+std::string ASTTypeView::ToString(bool withIdentifier) const
+{
+	if (head == 0)
+		return type->ToString(withIdentifier);
 
+	std::string ret;
+	AppendToString(ret, withIdentifier);
 	return ret;
-
 }
 
-
-void ASTType::MergeData(ASTType* other)
+std::string ASTTypeView::ToNameString(bool includeTemplateArguments) const
 {
-	typeName.insert(typeName.end(), other->typeName.begin(), other->typeName.end());
-	typeIdentifier.insert(typeIdentifier.end(), other->typeIdentifier.begin(), other->typeIdentifier.end());
-	typeModifiers.insert(typeModifiers.end(), other->typeModifiers.begin(), other->typeModifiers.end());
-	typeOperatorTokens.insert(typeOperatorTokens.end(), other->typeOperatorTokens.begin(), other->typeOperatorTokens.end());
-	typePointers.insert(typePointers.end(), other->typePointers.begin(), other->typePointers.end());
-	typeArrayTokens.insert(typeArrayTokens.end(), other->typeArrayTokens.begin(), other->typeArrayTokens.end());
-	typeTemplateIndices.insert(typeTemplateIndices.end(), other->typeTemplateIndices.begin(), other->typeTemplateIndices.end());
-	typeBitfieldTokens.insert(typeBitfieldTokens.end(), other->typeBitfieldTokens.begin(), other->typeBitfieldTokens.end());
-	typeIdentifierScopedPointers.insert(typeIdentifierScopedPointers.end(), other->typeIdentifierScopedPointers.begin(), other->typeIdentifierScopedPointers.end());
-	typeFunctionPointerArgumentIndices.insert(typeFunctionPointerArgumentIndices.end(), other->typeFunctionPointerArgumentIndices.begin(), other->typeFunctionPointerArgumentIndices.end());
+	if (head == 0)
+		return type->ToNameString(includeTemplateArguments);
 
-	if (other->ndFuncArgumentList)
-		ndFuncArgumentList = other->ndFuncArgumentList;
-	if (other->ndFuncModifierList)
-		ndFuncModifierList = other->ndFuncModifierList;
-	if (other->ndFuncPointerArgumentList)
-		ndFuncPointerArgumentList = other->ndFuncPointerArgumentList;
+	std::string ret;
+	AppendNameString(ret, includeTemplateArguments);
+	return ret;
 }
 
-
-std::string ASTType::ToModifiersString()
+std::string ASTTypeView::ToIdentifierString() const
 {
 	std::string ret;
-	for (auto& it : typeModifiers)
+	AppendIdentifierString(ret);
+	return ret;
+}
+
+void ASTTypeView::AppendModifiersString(std::string& out) const
+{
+	auto& tokens = TokenSource()->Tokens;
+	for (auto& it : TypeModifiers())
 	{
 		for (size_t i = it.first; i <= it.second; i++)
-			ret += tokenSource->Tokens[i].TokenData + "";
-		ret += " ";
+			out.append(tokens[i].TokenData);
+		out.push_back(' ');
 	}
-	return ret;
 }
 
-std::string ASTType::ToFunctionModifiersString()
+void ASTTypeView::AppendFunctionModifiersString(std::string& out) const
 {
-	if (ndFuncModifierList == 0)
-		return "";
+	ASTNode* modifiers = FuncModifierList();
+	if (modifiers == 0)
+		return;
 
-	std::string ret;
-	for (auto it : ndFuncModifierList->Children())
+	size_t start = out.size();
+	for (auto it : modifiers->Children())
 	{
-		ret += it->ToString();
-		ret += " ";
+		it->AppendToString(out);
+		out.push_back(' ');
 	}
-	if (ret.size() > 0)
-		ret.pop_back(); // remove trailing space
-	return ret;
+	RemoveTrailingSpace(out, start);
 }
 
-std::string ASTType::ToNameString(bool includeTemplateArguments)
+void ASTTypeView::AppendNameString(std::string& out, bool includeTemplateArguments) const
 {
-	std::string ret;
+	auto& tokens = TokenSource()->Tokens;
+	auto typeName = TypeName();
 	for (size_t i = 0; i < typeName.size(); i++)
 	{
 		CxxToken* nextToken = 0;
 		if (i + 1 < typeName.size())
-			nextToken = &tokenSource->Tokens[typeName[i + 1].Index];
+			nextToken = &tokens[typeName[i + 1].Index];
 
-		ret += tokenSource->Tokens[typeName[i].Index].TokenData;
+		out.append(tokens[typeName[i].Index].TokenData);
 		if (includeTemplateArguments && typeName[i].TemplateArguments)
-			ret += ToTemplateArgumentsString(typeName[i].TemplateArguments);
-		if (tokenSource->Tokens[typeName[i].Index].TokenType != CxxToken::Type::Doublecolon)
+			AppendTemplateArgumentsString(out, typeName[i].TemplateArguments);
+		if (tokens[typeName[i].Index].TokenType != CxxToken::Type::Doublecolon)
 		{
 			if (nextToken && nextToken->TokenType == CxxToken::Type::Keyword)
-				ret.push_back(' ');
+				out.push_back(' ');
 			else if (nextToken && nextToken->TokenType == CxxToken::Type::BuiltinType)
-				ret.push_back(' ');
+				out.push_back(' ');
 			else if (nextToken && nextToken->TokenType == CxxToken::Type::Void)
-				ret.push_back(' ');
+				out.push_back(' ');
 
 		}
 
 	}
-	return ret;
 }
 
-std::string ASTType::ToTemplateArgumentsString(ASTNode* args)
+void ASTTypeView::AppendTemplateArgumentsString(std::string& out, ASTNode* args)
 {
-	std::string ret;
 	if (args)
 	{
-		if (ret.size() > 0 && ret.back() == ' ')
-			ret.pop_back(); // remove trailing space
-
 		auto& children = args->Children();
-		ret += "<";
+		out.push_back('<');
 		for (auto& it : children)
 		{
-			ret += it->ToString();
+			it->AppendToString(out);
 			if (it != children.back())
-				ret += ", ";
+				out.append(", ");
 		}
-		ret += ">";
+		out.push_back('>');
 	}
-	return ret;
 }
 
-std::string ASTType::ToArrayTokensString()
+void ASTTypeView::AppendArrayTokensString(std::string& out) const
 {
-	std::string ret;
-	for (auto& it : typeArrayTokens)
+	auto& tokens = TokenSource()->Tokens;
+	for (auto& it : TypeArrayTokens())
 	{
-		ret.push_back('[');
+		out.push_back('[');
 		for (auto& it2 : it)
-			ret.append(tokenSource->Tokens[it2].TokenData);
-		ret.push_back(']');
+			out.append(tokens[it2].TokenData);
+		out.push_back(']');
 	}
-	return ret;
 }
 
-std::string ASTType::ToPointerIdentifierScopedString()
+void ASTTypeView::AppendPointerIdentifierScopedString(std::string& out) const
 {
-	std::string ret;
-	for (auto& it : typeIdentifierScopedPointers)
-		ret += it.ToString() + " ";
-	if (ret.size() > 0)
-		ret.pop_back(); // remove trailing space
-	return ret;
+	size_t start = out.size();
+	for (auto& it : TypeIdentifierScopedPointers())
+	{
+		const_cast<ASTPointerType&>(it).AppendToString(out);
+		out.push_back(' ');
+	}
+	RemoveTrailingSpace(out, start);
 }
 
-std::string ASTType::ToIdentifierString()
+void ASTTypeView::AppendIdentifierString(std::string& out) const
 {
-	std::string ret;
-	for (auto& it : typeIdentifier)
-		ret += tokenSource->Tokens[it].TokenData;
-	return ret;
+	auto& tokens = TokenSource()->Tokens;
+	for (auto& it : TypeIdentifier())
+		out.append(tokens[it].TokenData);
 }
 
-std::string ASTType::ToBitfieldString()
+void ASTTypeView::AppendBitfieldString(std::string& out) const
 {
-	std::string ret;
-	for (auto& it : typeBitfieldTokens)
-		ret += tokenSource->Tokens[it].TokenData + " ";
-	if (ret.size() > 0)
-		ret.pop_back(); // remove trailing space
-	return ret;
+	auto& tokens = TokenSource()->Tokens;
+	size_t start = out.size();
+	for (auto& it : TypeBitfieldTokens())
+	{
+		out.append(tokens[it].TokenData);
+		out.push_back(' ');
+	}
+	RemoveTrailingSpace(out, start);
 }
 
-std::string ASTType::ToOperatorString()
+void ASTTypeView::AppendOperatorString(std::string& out) const
 {
-	std::string ret;
-	for (auto& it : typeOperatorTokens)
-		ret += tokenSource->Tokens[it].TokenData;
-	return ret;
+	auto& tokens = TokenSource()->Tokens;
+	for (auto& it : TypeOperatorTokens())
+		out.append(tokens[it].TokenData);
 }
 
-std::string ASTType::ToArgumentsString()
+void ASTTypeView::AppendArgumentsString(std::string& out) const
 {
-	std::string ret;
 	ASTNode* args = 0;
-	if (args == 0 && ndFuncArgumentList)
-		args = ndFuncArgumentList;
-	if (args == 0 && ndFuncPointerArgumentList)
-		args = ndFuncPointerArgumentList;
+	if (args == 0 && FuncArgumentList())
+		args = FuncArgumentList();
+	if (args == 0 && FuncPointerArgumentList())
+		args = FuncPointerArgumentList();
 	if (args)
 	{
 		auto& children = args->Children();
-		ret += "(";
+		out.push_back('(');
 		for (auto& it : children)
 		{
 			ASTType* t = dynamic_cast<ASTType*>(it);
 			if (t == 0)
 			{
 				if (it->GetType() == ASTNode::Type::VarArgDcl)
-					ret += "...";
+					out.append("...");
 				continue; // skip non-types
 			}
 
-			ret += t->ToString();
+			out.append(t->ToString(true));
 			if (it != children.back())
-				ret += ", ";
+				out.append(", ");
 		}
-		ret += ")";
+		out.push_back(')');
 	}
-	return ret;
 }
 
-std::string ASTType::ToPointersString()
+void ASTTypeView::AppendPointersString(std::string& out) const
 {
-	std::string ret;
-	for (auto& it : typePointers)
-		ret += it.ToString() + " ";
+	size_t start = out.size();
+	for (auto& it : TypePointers())
+	{
+		const_cast<ASTPointerType&>(it).AppendToString(out);
+		out.push_back(' ');
+	}
 
 	// remove trailing space
-	if (ret.size() > 0)
-		ret.pop_back();
-	return ret;
-}
-
-ASTType ASTType::CombineWithHead()
-{
-	if (head == 0)
-		throw std::runtime_error("Type has no head. No combine is needed.");
-
-	ASTType t(tokenSource);
-	t.MergeData(this);
-	t.MergeData(head);
-	return t;
+	RemoveTrailingSpace(out, start);
 }
 
-bool ASTType::IsBuiltinType()
+bool ASTTypeView::IsBuiltinType() const
 {
+	auto typeName = TypeName();
 	for (size_t i = 0; i < typeName.size(); i++)
 	{
-		auto type = tokenSource->Tokens[typeName[i].Index].TokenType;
-		switch (type)
+		auto tokenType = TokenSource()->Tokens[typeName[i].Index].TokenType;
+		switch (tokenType)
 		{
 		case CxxToken::Type::BuiltinType:
 		case CxxToken::Type::Void:
@@ -476,44 +611,99 @@ bool ASTType::IsBuiltinType()
 	return false;
 }
 
-bool ASTType::HasType()
+bool ASTTypeView::HasType() const
 {
-	return !typeName.empty();
+	return !TypeName().empty();
 }
 
-bool ASTType::HasModifier(CxxToken::Type modifierType)
+bool ASTTypeView::HasModifier(CxxToken::Type modifierType) const
 {
+	auto typeModifiers = TypeModifiers();
 	for (size_t i = 0; i < typeModifiers.size(); i++)
 	{
-		auto type = tokenSource->Tokens[typeModifiers[i].first].TokenType;
-		if (type == modifierType)
+		auto tokenType = TokenSource()->Tokens[typeModifiers[i].first].TokenType;
+		if (tokenType == modifierType)
 			return true;
 	}
 	return false;
 }
 
+CanonicalTypeId ASTTypeView::GetCanonicalType() const
+{
+	if (head == 0)
+		return type->GetCanonicalType();
+	return type->GetCombinedCanonicalType();
+}
 
 
 std::string ASTTokenNode::ToString()
 {
 	std::string ret;
-	for (auto it : Tokens)
-		ret.append(tokenSource->Tokens[it].TokenData);
+	AppendToString(ret);
 	return ret;
 }
 
+void ASTTokenNode::AppendToString(std::string& out)
+{
+	for (auto it : Tokens)
+		out.append(tokenSource->Tokens[it].TokenData);
+}
+
 
 std::string ASTDataNode::ToString()
 {
 	std::string ret;
+	AppendToString(ret);
+	return ret;
+}
+
+void ASTDataNode::AppendToString(std::string& out)
+{
+	size_t start = out.size();
 	for (auto it : data)
 	{
-		ret += it;
-		ret += " ";
+		out.append(SymbolTable::Global().Lookup(it));
+		out.push_back(' ');
 	}
-	if (ret.size() > 0 && ret.back() == ' ')
-		ret.pop_back();
-	return ret;
+	RemoveTrailingSpace(out, start);
+}
+
+ASTHash ASTDataNode::ContentHash(ASTHash seed)
+{
+	// hash the spellings, symbol ids differ between runs
+	for (auto it : data)
+	{
+		const std::string& spelling = SymbolTable::Global().Lookup(it);
+		seed = tools::Hash64(spelling.c_str(), spelling.size() + 1, seed);
+	}
+	return seed;
+}
+
+ASTHash ASTTokenNode::ContentHash(ASTHash seed)
+{
+	for (auto it : Tokens)
+	{
+		const CxxToken& token = tokenSource->Tokens[it];
+		switch (token.TokenType)
+		{
+			case CxxToken::Type::Whitespace:
+			case CxxToken::Type::Newline:
+			case CxxToken::Type::CommentSingleLine:
+			case CxxToken::Type::CommentMultiLine:
+				continue;
+			default:
+				break;
+		}
+		seed = tools::Hash64(token.TokenData.c_str(), token.TokenData.size() + 1, seed);
+	}
+	return seed;
+}
+
+ASTHash ASTType::ContentHash(ASTHash seed)
+{
+	// the spelling is rendered from the significant tokens only
+	const std::string& spelling = ToString(true);
+	return tools::Hash64(spelling.c_str(), spelling.size() + 1, seed);
 }
 
 size_t ASTTokenSource::AddToken(const CxxToken& token)
@@ -5,16 +5,45 @@
 #include <vector>
 #include <memory>
 #include "cxxTokenizer.h"
+#include "smallVector.h"
 
 class ASTTokenSource
 {
 public:
+	virtual ~ASTTokenSource() {}
+
 	std::vector<CxxToken> Tokens;
 	virtual const char* SourceIdentifier() { return "UNKNOWN"; }
 	size_t AddToken(const CxxToken& token);
 };
 
 typedef size_t ASTTokenIndex;
+typedef unsigned int CanonicalTypeId;
+typedef unsigned long long ASTHash;
+
+class ASTNode;
+
+// Annotations attached to a node. The list is owned by the node, the annotation nodes are nodes of the same tree,
+// so the list stays valid as long as the tree does (it does not depend on the parser or its tokens).
+class ASTAnnotationList
+{
+public:
+	ASTAnnotationList() : m_count(0) {}
+	ASTAnnotationList(const ASTAnnotationList& other) : m_count(0) { Assign(other.begin(), other.size()); }
+	ASTAnnotationList& operator = (const ASTAnnotationList& other) { if (this != &other) Assign(other.begin(), other.size()); return *this; }
+
+	void Assign(ASTNode* const* a_begin, size_t a_count);
+
+	ASTNode* const* begin() const { return m_data.get(); }
+	ASTNode* const* end() const { return m_data.get() + m_count; }
+	size_t size() const { return m_count; }
+	bool empty() const { return m_count == 0; }
+	ASTNode* operator [] (size_t index) const { return m_data[index]; }
+
+private:
+	std::unique_ptr<ASTNode*[]> m_data;
+	size_t m_count;
+};
 
 class ASTNode
 {
@@ -77,19 +106,27 @@ public:
 	};
 
 	ASTNode() { parent = 0; }
-	virtual ~ASTNode() { DestroyChildren(); }
+	virtual ~ASTNode() { DeleteChildren(); }
 
-	void DestroyChildren();
-	void DestroyChildrenAndSelf() { DestroyChildren(); delete this; }
-	void ClearChildrenWithoutDestruction() { m_children.clear(); }
+	void DestroyChildren() { InvalidateStructuralHash(); DeleteChildren(); }
+	// the node is going away, its parent (if any) has to drop it
+	void DestroyChildrenAndSelf() { DeleteChildren(); delete this; }
+	void DestroyChildrenFrom(size_t index);
+	// the children are detached, they no longer point to this node
+	void ClearChildrenWithoutDestruction();
+	// detaches the children from index on and returns them, the caller owns them
+	std::vector<ASTNode*> DetachChildrenFrom(size_t index);
 
-	void AddNode(ASTNode* node) { node->parent = this; node->parentIndex = m_children.size(); m_children.push_back(node); }
+	void AddNode(ASTNode* node) { node->parent = this; node->parentIndex = m_children.size(); m_children.push_back(node); InvalidateStructuralHash(); }
 	void AddNodes(const std::vector<ASTNode*>& nodes) { for (auto it : nodes) AddNode(it); }
 	void StealNodesFrom(ASTNode* node);
 	const std::vector<ASTNode*>& Children() const { return m_children; }
 	std::vector<ASTNode*> GatherChildrenRecursively() const;
 	std::vector<ASTNode*> GatherParents() const;
-	std::vector<ASTNode*> GatherAnnotations() const;
+	// forward annotations in front of the node and back annotations after it, including the ones of enclosing typedefs, templates and declaration heads
+	const ASTAnnotationList& Annotations() const { return annotations; }
+	void SetAnnotations(ASTNode* const* begin, size_t count) { annotations.Assign(begin, count); }
+	std::vector<ASTNode*> GatherAnnotations() const { return std::vector<ASTNode*>(annotations.begin(), annotations.end()); }
 
 	virtual const char* GetTypeString() const;
 	virtual const ASTNode::Type GetType() const { return type; };
@@ -99,14 +136,29 @@ public:
 	ASTNode* GetNextSibling() const;
 	ASTNode* GetPreviousSibling() const;
 	
-	void SetType( ASTNode::Type inType) { type = inType; }
+	void SetType( ASTNode::Type inType) { type = inType; InvalidateStructuralHash(); }
 
 	void RebuildParentIndices();
 
 	virtual std::string ToString() { return ""; }
+	// appends the ToString() representation to a caller provided buffer
+	virtual void AppendToString(std::string& out) { out.append(ToString()); }
+
+	// Merkle hash of the subtree: node type, significant tokens (no whitespace, comments or source offsets) and the hashes of the children.
+	// Equal hashes mean structurally identical subtrees, also between runs. Computed bottom-up when parsing finishes and cached.
+	ASTHash StructuralHash();
+	// drops the cached hash of this node and of all its ancestors, every change of a subtree has to call it.
+	// A node with a cached hash has cached descendants, so the walk stops at the first node that has none.
+	void InvalidateStructuralHash() { for (ASTNode* it = this; it && it->structuralHash != 0; it = it->parent) it->structuralHash = 0; }
 protected:
-	void i_InnerGatherAnnotations(std::vector<ASTNode*>& list) const;
+	void DeleteChildren();
+
+	// hash of the data of this node only, without children
+	virtual ASTHash ContentHash(ASTHash seed) { return seed; }
+
+	ASTHash structuralHash = 0;
 	ASTNode::Type type;
+	ASTAnnotationList annotations;
 	
 	ASTNode* parent;
 	size_t parentIndex = -1;
@@ -131,17 +183,21 @@ public:
 	std::vector<CxxToken> pointerModifiers;
 
 	std::string ToString();
+	void AppendToString(std::string& out);
 };
 
 class ASTDataNode : public ASTNode
 {
 public:
-	void AddData(const std::string& a_dataValue) { data.push_back(a_dataValue); }
-	const std::vector<std::string>& Data() const { return data; }
+	void AddData(const std::string& a_dataValue) { data.push_back(SymbolTable::Global().Intern(a_dataValue)); InvalidateStructuralHash(); }
+	void AddData(SymbolId a_dataSymbol) { data.push_back(a_dataSymbol); InvalidateStructuralHash(); }
+	const std::vector<SymbolId>& Data() const { return data; }
 	virtual std::string ToString();
+	virtual void AppendToString(std::string& out);
 protected:
+	virtual ASTHash ContentHash(ASTHash seed);
 	friend class ASTCxxParser;
-	std::vector<std::string> data;
+	std::vector<SymbolId> data;
 };
 
 class ASTTokenNode : public ASTNode
@@ -151,12 +207,24 @@ public:
 	ASTTokenSource* tokenSource;
 	std::vector<ASTTokenIndex> Tokens;
 	virtual std::string ToString();
+	virtual void AppendToString(std::string& out);
+protected:
+	virtual ASTHash ContentHash(ASTHash seed);
 };
 
+class ASTTypeView;
+
 class ASTType : public ASTNode
 {
 public:
 	struct ASTTokenIndexTemplated { ASTTokenIndex Index; ASTNode* TemplateArguments; };
+	typedef std::pair<ASTTokenIndex, ASTTokenIndex> TokenRange;
+	typedef SmallVector<ASTTokenIndexTemplated, 2> NameList;
+	typedef SmallVector<ASTTokenIndex, 2> IdentifierList;
+	typedef SmallVector<TokenRange, 2> ModifierList;
+	typedef SmallVector<ASTTokenIndex, 1> TokenList;
+	typedef SmallVector<ASTPointerType, 1> PointerList;
+	typedef SmallVector<std::vector<ASTTokenIndex>, 1> ArrayList;
 	ASTType(ASTTokenSource* src) : tokenSource(src) { SetType(ASTNode::Type::VarType); }
 	ASTTokenSource* tokenSource;
 	ASTType* head = 0;
@@ -165,29 +233,42 @@ public:
 	ASTNode* ndFuncArgumentList = 0;
 	ASTNode* ndFuncModifierList = 0;
 	ASTNode* ndFuncPointerArgumentList = 0;
-	std::vector<ASTTokenIndexTemplated> typeName;
-	std::vector<ASTTokenIndex> typeIdentifier;
-	std::vector<std::pair<ASTTokenIndex, ASTTokenIndex> > typeModifiers;
-	std::vector<ASTTokenIndex> typeOperatorTokens;
-	std::vector<ASTTokenIndex> typeBitfieldTokens;
-	std::vector<ASTPointerType> typePointers;
-	std::vector<ASTPointerType> typeIdentifierScopedPointers;
-	std::vector< std::vector<ASTTokenIndex> > typeArrayTokens;
-	std::vector<int> typeTemplateIndices;
-	std::vector<int> typeFunctionPointerArgumentIndices;
+	// component lists mostly hold zero to two entries, so they are stored inline
+	NameList typeName;
+	IdentifierList typeIdentifier;
+	ModifierList typeModifiers;
+	TokenList typeOperatorTokens;
+	TokenList typeBitfieldTokens;
+	PointerList typePointers;
+	PointerList typeIdentifierScopedPointers;
+	ArrayList typeArrayTokens;
+	SmallVector<int, 1> typeTemplateIndices;
+	SmallVector<int, 1> typeFunctionPointerArgumentIndices;
 
 	// Transfiguration variables
 	ASTNode* resolvedType = 0;
 
+	// id of the shared entry in the CanonicalTypeTable, structurally identical types share the same id
+	CanonicalTypeId GetCanonicalType();
+	bool IsSameType(ASTType* other) { return GetCanonicalType() == other->GetCanonicalType(); }
+
 	bool HasType();
 	bool HasModifier(CxxToken::Type modifierType);
 	bool IsBuiltinType();
 
+	// ToString(bool) and ToNameString(bool) are cached, call InvalidateSpelling() after modifying the component lists directly.
 	virtual std::string ToString() { return ToString(true); }
-	std::string ToString(bool withIdentifier);
+	virtual void AppendToString(std::string& out) { out.append(ToString(true)); }
+	const std::string& ToString(bool withIdentifier);
+	void AppendToString(std::string& out, bool withIdentifier);
+	void InvalidateSpelling() { spellingCache.valid = 0; canonicalType = 0; combinedCanonicalType = 0; }
 
 	bool IsDeclarationHead() { return head != 0; }
 	ASTType CombineWithHead();
+	// copy free view of this type combined with its declaration head (same result as CombineWithHead)
+	ASTTypeView CombinedView();
+	// canonical type of the combined view, cached
+	CanonicalTypeId GetCombinedCanonicalType();
 
 	std::string ToPointersString();
 	std::string ToArgumentsString();
@@ -196,10 +277,115 @@ public:
 	std::string ToIdentifierString();
 	std::string ToTemplateArgumentsString(ASTNode* args);
 	std::string ToPointerIdentifierScopedString();
-	std::string ToNameString(bool includeTemplateArguments=true);
+	const std::string& ToNameString(bool includeTemplateArguments=true);
 	std::string ToModifiersString();
 	std::string ToFunctionModifiersString();
 	std::string ToArrayTokensString();
 
+	void AppendPointersString(std::string& out);
+	void AppendArgumentsString(std::string& out);
+	void AppendOperatorString(std::string& out);
+	void AppendBitfieldString(std::string& out);
+	void AppendIdentifierString(std::string& out);
+	void AppendTemplateArgumentsString(std::string& out, ASTNode* args);
+	void AppendPointerIdentifierScopedString(std::string& out);
+	void AppendNameString(std::string& out, bool includeTemplateArguments = true);
+	void AppendModifiersString(std::string& out);
+	void AppendFunctionModifiersString(std::string& out);
+	void AppendArrayTokensString(std::string& out);
+
 	void MergeData(ASTType* other);
+
+protected:
+	virtual ASTHash ContentHash(ASTHash seed);
+
+	enum SpellingSlot { SpellingWithoutIdentifier, SpellingFull, SpellingNameWithoutTemplateArguments, SpellingName, SpellingCount };
+	struct SpellingCache
+	{
+		std::string text[SpellingCount];
+		unsigned char valid = 0;
+	} spellingCache;
+	CanonicalTypeId canonicalType = 0;
+	CanonicalTypeId combinedCanonicalType = 0;
+};
+
+// Read-only concatenation of a component list of a type and the same list of its declaration head.
+template <class L> class ASTConcatList
+{
+public:
+	typedef typename L::value_type value_type;
+
+	class const_iterator
+	{
+	public:
+		const_iterator(const ASTConcatList* list, size_t index) : m_list(list), m_index(index) {}
+		const value_type& operator * () const { return (*m_list)[m_index]; }
+		const value_type* operator -> () const { return &(*m_list)[m_index]; }
+		const_iterator& operator ++ () { m_index++; return *this; }
+		bool operator != (const const_iterator& o) const { return m_index != o.m_index; }
+		bool operator == (const const_iterator& o) const { return m_index == o.m_index; }
+	private:
+		const ASTConcatList* m_list;
+		size_t m_index;
+	};
+
+	ASTConcatList(const L& first, const L* second) : m_first(first), m_second(second) {}
+
+	size_t size() const { return m_first.size() + (m_second ? m_second->size() : 0); }
+	bool empty() const { return size() == 0; }
+	const value_type& operator [] (size_t index) const { return index < m_first.size() ? m_first[index] : (*m_second)[index - m_first.size()]; }
+	const_iterator begin() const { return const_iterator(this, 0); }
+	const_iterator end() const { return const_iterator(this, size()); }
+
+private:
+	const L& m_first;
+	const L* m_second;
+};
+
+// Presents a type, optionally combined with its declaration head, through the query/render API of ASTType without copying.
+// The component lists of the type come first, followed by the ones of the head (like ASTType::MergeData).
+class ASTTypeView
+{
+public:
+	explicit ASTTypeView(ASTType* a_type, ASTType* a_head = 0) : type(a_type), head(a_head) {}
+	ASTType* type;
+	ASTType* head;
+
+	ASTConcatList<ASTType::NameList> TypeName() const { return ASTConcatList<ASTType::NameList>(type->typeName, head ? &head->typeName : 0); }
+	ASTConcatList<ASTType::IdentifierList> TypeIdentifier() const { return ASTConcatList<ASTType::IdentifierList>(type->typeIdentifier, head ? &head->typeIdentifier : 0); }
+	ASTConcatList<ASTType::ModifierList> TypeModifiers() const { return ASTConcatList<ASTType::ModifierList>(type->typeModifiers, head ? &head->typeModifiers : 0); }
+	ASTConcatList<ASTType::TokenList> TypeOperatorTokens() const { return ASTConcatList<ASTType::TokenList>(type->typeOperatorTokens, head ? &head->typeOperatorTokens : 0); }
+	ASTConcatList<ASTType::TokenList> TypeBitfieldTokens() const { return ASTConcatList<ASTType::TokenList>(type->typeBitfieldTokens, head ? &head->typeBitfieldTokens : 0); }
+	ASTConcatList<ASTType::PointerList> TypePointers() const { return ASTConcatList<ASTType::PointerList>(type->typePointers, head ? &head->typePointers : 0); }
+	ASTConcatList<ASTType::PointerList> TypeIdentifierScopedPointers() const { return ASTConcatList<ASTType::PointerList>(type->typeIdentifierScopedPointers, head ? &head->typeIdentifierScopedPointers : 0); }
+	ASTConcatList<ASTType::ArrayList> TypeArrayTokens() const { return ASTConcatList<ASTType::ArrayList>(type->typeArrayTokens, head ? &head->typeArrayTokens : 0); }
+
+	// the head overrides the function lists of the type
+	ASTNode* FuncArgumentList() const { return head && head->ndFuncArgumentList ? head->ndFuncArgumentList : type->ndFuncArgumentList; }
+	ASTNode* FuncModifierList() const { return head && head->ndFuncModifierList ? head->ndFuncModifierList : type->ndFuncModifierList; }
+	ASTNode* FuncPointerArgumentList() const { return head && head->ndFuncPointerArgumentList ? head->ndFuncPointerArgumentList : type->ndFuncPointerArgumentList; }
+	ASTTokenSource* TokenSource() const { return type->tokenSource; }
+
+	bool HasType() const;
+	bool HasModifier(CxxToken::Type modifierType) const;
+	bool IsBuiltinType() const;
+	CanonicalTypeId GetCanonicalType() const;
+
+	// uses the spelling cache of the type when there is no head
+	std::string ToString(bool withIdentifier = true) const;
+	std::string ToNameString(bool includeTemplateArguments = true) const;
+	std::string ToIdentifierString() const;
+
+	void AppendToString(std::string& out, bool withIdentifier) const;
+	void AppendPointersString(std::string& out) const;
+	void AppendArgumentsString(std::string& out) const;
+	void AppendOperatorString(std::string& out) const;
+	void AppendBitfieldString(std::string& out) const;
+	void AppendIdentifierString(std::string& out) const;
+	void AppendPointerIdentifierScopedString(std::string& out) const;
+	void AppendNameString(std::string& out, bool includeTemplateArguments = true) const;
+	void AppendModifiersString(std::string& out) const;
+	void AppendFunctionModifiersString(std::string& out) const;
+	void AppendArrayTokensString(std::string& out) const;
+	static void AppendTemplateArgumentsString(std::string& out, ASTNode* args);
 };
@@ -1,7 +1,9 @@
 #include "astConstructor.h"
 #include "astProcessor.h"
+#include "astVisitor.h"
+#include "log.h"
 
-ASTConstructor::ASTConstructor()
+ASTConstructor::ASTConstructor(OutputSink* output) : m_output(output)
 {
 }
 
@@ -229,7 +231,7 @@ void ASTConstructor::WalkAST(ASTNode* node)
 	case ASTNode::Type::Init: // should be in ToString()
 		break;
 	default:
-		fprintf(stderr, "Missing ASTNode::Type construction code for type: %s\n", node->GetTypeString());
+		LOG_WARNING(LogCategory::General, "Missing ASTNode::Type construction code for type: %s\n", node->GetTypeString());
 		break;
 	};
 
@@ -237,13 +239,35 @@ void ASTConstructor::WalkAST(ASTNode* node)
 
 void ASTConstructor::Write(const std::string& inStr)
 {
-	printf("%s", inStr.c_str());
+	m_output->Write(inStr);
 }
 
-void ASTConstructor::Execute(tools::CommandLineParser& cmdOpts, ASTNode* rootNode, std::vector<std::unique_ptr<ASTCxxParser>>& parsers)
+// Root and File only recurse, every other node is written by WalkAST of its own constructor
+class ASTConstructorVisitor : public ASTVisitor
 {
-	fprintf(stderr, "********************* CODE BUILDER ***********************\n");
-	WalkAST(rootNode);
+public:
+	ASTConstructorVisitor() : m_writer(ModuleOutput::Current()) {}
+
+	virtual void Begin(ASTNode* /*root*/)
+	{
+		LOG_INFO(LogCategory::General, "********************* CODE BUILDER ***********************\n");
+	}
+
+	virtual bool Pre(ASTNode* node)
+	{
+		if (node->GetType() == ASTNode::Type::Root || node->GetType() == ASTNode::Type::File)
+			return true;
+		m_writer.WalkAST(node);
+		return false;
+	}
+
+protected:
+	ASTConstructor m_writer;
+};
+
+ASTVisitor* ASTConstructor::CreateVisitor(tools::CommandLineParser& cmdOpts, std::vector<std::unique_ptr<ASTCxxParser>>& parsers)
+{
+	return new ASTConstructorVisitor();
 }
 
 
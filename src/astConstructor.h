@@ -7,10 +7,10 @@
 #include "ast.h"
 #include "modules.h"
 
-class ASTConstructor : public IModule
+class ASTConstructor : public VisitorModule
 {
 public:
-	ASTConstructor();
+	ASTConstructor(OutputSink* output = &OutputSink::Stdout());
 
 	void	WalkAST(ASTNode* node);
 
@@ -19,7 +19,9 @@ public:
 	void	Write(const std::string& inStr);
 
 	// TODO: Remove module stuff
-	void Execute(tools::CommandLineParser& cmdOpts, ASTNode* rootNode, std::vector<std::unique_ptr<ASTCxxParser>>& parsers);
+	ASTVisitor* CreateVisitor(tools::CommandLineParser& cmdOpts, std::vector<std::unique_ptr<ASTCxxParser>>& parsers);
+	bool VisitsPerFile() const { return true; }
 private:
+	OutputSink* m_output;
 
 };
@@ -0,0 +1,78 @@
+#include "astEvents.h"
+
+static void AddTypeTokens(ASTTokenSpan& span, ASTType* typeNode)
+{
+	for (auto& it : typeNode->typeName)
+		span.Add(it.Index);
+	for (auto it : typeNode->typeIdentifier)
+		span.Add(it);
+	for (auto& it : typeNode->typeModifiers)
+	{
+		span.Add(it.first);
+		span.Add(it.second);
+	}
+	for (auto it : typeNode->typeOperatorTokens)
+		span.Add(it);
+	for (auto it : typeNode->typeBitfieldTokens)
+		span.Add(it);
+	for (auto& it : typeNode->typeArrayTokens)
+	{
+		for (auto it2 : it)
+			span.Add(it2);
+	}
+}
+
+ASTTokenSpan ASTTokenSpan::Of(ASTNode* node)
+{
+	ASTTokenSpan span;
+
+	ASTTokenNode* tokenNode = dynamic_cast<ASTTokenNode*>(node);
+	if (tokenNode)
+	{
+		for (auto it : tokenNode->Tokens)
+			span.Add(it);
+	}
+
+	ASTType* typeNode = dynamic_cast<ASTType*>(node);
+	if (typeNode)
+	{
+		AddTypeTokens(span, typeNode);
+		// declarations also cover the tokens of their declaration head
+		if (typeNode->head)
+			AddTypeTokens(span, typeNode->head);
+	}
+
+	for (auto it : node->Children())
+		span.Add(Of(it));
+	return span;
+}
+
+size_t ASTEventQueue::Add(Kind kind, ASTNode* node, ASTTokenSource* source, const ASTTokenSpan& tokens)
+{
+	Entry entry = { kind, { node, source, tokens } };
+	m_events.push_back(entry);
+	return m_events.size() - 1;
+}
+
+void ASTEventQueue::Send(ASTEventConsumer& consumer, size_t count)
+{
+	for (size_t i = 0; i < count; i++)
+		Send(consumer, m_events[i].kind, m_events[i].event);
+	m_events.erase(m_events.begin(), m_events.begin() + count);
+}
+
+void ASTEventQueue::Send(ASTEventConsumer& consumer, Kind kind, const ASTEvent& e)
+{
+	switch (kind)
+	{
+		case Kind::NamespaceBegin: consumer.NamespaceBegin(e); break;
+		case Kind::NamespaceEnd: consumer.NamespaceEnd(e); break;
+		case Kind::ClassBegin: consumer.ClassBegin(e); break;
+		case Kind::ClassEnd: consumer.ClassEnd(e); break;
+		case Kind::Declaration: consumer.Declaration(e); break;
+		case Kind::EnumBegin: consumer.EnumBegin(e); break;
+		case Kind::EnumValue: consumer.EnumValue(e); break;
+		case Kind::EnumEnd: consumer.EnumEnd(e); break;
+		case Kind::Annotation: consumer.Annotation(e); break;
+	}
+}
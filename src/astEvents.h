@@ -0,0 +1,95 @@
+#pragma once
+
+#include <vector>
+#include "ast.h"
+
+// Range of tokens [begin, end) in the token source of the parser, covers the significant tokens a node refers to.
+struct ASTTokenSpan
+{
+	ASTTokenIndex begin = 0;
+	ASTTokenIndex end = 0;
+	bool empty() const { return begin == end; }
+	void Add(ASTTokenIndex index) { if (empty()) { begin = index; end = index + 1; return; } if (index < begin) begin = index; if (index >= end) end = index + 1; }
+	void Add(const ASTTokenSpan& o) { if (o.empty()) return; Add(o.begin); Add(o.end - 1); }
+
+	// the tokens of the node and its children, declarations include the tokens of their declaration head
+	static ASTTokenSpan Of(ASTNode* node);
+};
+
+struct ASTEvent
+{
+	ASTNode* node;				// only valid during the callback, unless the consumer takes the particle
+	ASTTokenSource* source;
+	ASTTokenSpan tokens;
+};
+
+// Receives the declarations of a file as a stream of events while parsing (see ASTCxxParser::Parse).
+// The parser reports a construct as soon as it recognized it, and sends the events once the particle it belongs to
+// can no longer be backtracked (a top level particle of the file or of a namespace, with its annotations).
+// Namespaces are streamed: their particles are parsed, reported and handed over one at a time,
+// so the parser never holds more than one particle of the file, plus the annotations in front of it.
+// The spans refer to the tokens of the parser, which only keeps the tokens of the particles that are not handed over yet:
+// token indices are only valid during the callback.
+class ASTEventConsumer
+{
+public:
+	virtual ~ASTEventConsumer() {}
+
+	virtual void FileBegin(const ASTEvent& /*e*/) {}
+	virtual void FileEnd(const ASTEvent& /*e*/) {}
+	// the span covers "namespace name {", the one of the end event the closing brace.
+	// The annotations of a namespace are resolved when it begins, its back annotations are added after it ended.
+	virtual void NamespaceBegin(const ASTEvent& /*e*/) {}
+	virtual void NamespaceEnd(const ASTEvent& /*e*/) {}
+	// class, struct or union, both spans cover the whole definition from the keyword to the semicolon
+	virtual void ClassBegin(const ASTEvent& /*e*/) {}
+	virtual void ClassEnd(const ASTEvent& /*e*/) {}
+	// DCL_SUB, members as well as declarations outside of classes
+	virtual void Declaration(const ASTEvent& /*e*/) {}
+	// both spans cover the whole enum from the keyword to the closing brace
+	virtual void EnumBegin(const ASTEvent& /*e*/) {}
+	virtual void EnumValue(const ASTEvent& /*e*/) {}
+	virtual void EnumEnd(const ASTEvent& /*e*/) {}
+	// forward annotations are reported before, back annotations after the declaration they belong to
+	virtual void Annotation(const ASTEvent& /*e*/) {}
+
+	// A particle of the file or of a namespace is complete, after its events (a namespace after its end event).
+	// Return true to take the node, it is released otherwise. Annotations are particles of their own,
+	// a consumer that takes a declaration has to take the annotations in front of and after it as well.
+	virtual bool Particle(const ASTEvent& /*e*/) { return false; }
+};
+
+// Builds the AST from the particles, ASTCxxParser::Parse(parent, position) parses with it.
+class ASTTreeBuilder : public ASTEventConsumer
+{
+public:
+	virtual void FileBegin(const ASTEvent& e) { m_scopes.assign(1, e.node); }
+	virtual void FileEnd(const ASTEvent& e) { e.node->StructuralHash(); }
+	virtual void NamespaceBegin(const ASTEvent& e) { m_scopes.push_back(e.node); }
+	virtual void NamespaceEnd(const ASTEvent& /*e*/) { m_scopes.pop_back(); }
+	virtual bool Particle(const ASTEvent& e) { m_scopes.back()->AddNode(e.node); return true; }
+
+protected:
+	std::vector<ASTNode*> m_scopes;
+};
+
+// Events the parser recognized but did not send yet.
+class ASTEventQueue
+{
+public:
+	enum class Kind { NamespaceBegin, NamespaceEnd, ClassBegin, ClassEnd, Declaration, EnumBegin, EnumValue, EnumEnd, Annotation };
+
+	size_t Size() const { return m_events.size(); }
+	// returns the index of the event, its span can be completed later on
+	size_t Add(Kind kind, ASTNode* node, ASTTokenSource* source, const ASTTokenSpan& tokens);
+	ASTTokenSpan& Tokens(size_t index) { return m_events[index].event.tokens; }
+	// drops the events of a construct that was backtracked
+	void Truncate(size_t size) { m_events.resize(size); }
+	// sends the first count events to the consumer and removes them
+	void Send(ASTEventConsumer& consumer, size_t count);
+	static void Send(ASTEventConsumer& consumer, Kind kind, const ASTEvent& e);
+
+protected:
+	struct Entry { Kind kind; ASTEvent event; };
+	std::vector<Entry> m_events;
+};
@@ -2,7 +2,7 @@
 #include <stdlib.h>
 #include <string.h>
 
-void ASTProcessor::Print(FILE* dev, ASTNode* node, int level)
+void ASTProcessor::Print(OutputSink* dev, ASTNode* node, int level)
 {
 	std::string allData;
 	allData += node->ToString();
@@ -11,8 +11,58 @@ void ASTProcessor::Print(FILE* dev, ASTNode* node, int level)
 	memset(padding, ' ', 32);
 	padding[level*2] = 0;
 
-	fprintf(dev, "%s * %s (%s)\n", padding, node->GetTypeString(), allData.c_str());
+	dev->Printf("%s * %s (%s) #%016llX\n", padding, node->GetTypeString(), allData.c_str(), node->StructuralHash());
 
 	for(auto it: node->Children())
 		Print(dev, it, level+1);
 }
+
+void ASTProcessor::Print(OutputSink* dev, ASTNode* node, TaskScheduler& scheduler)
+{
+	// subtrees do not share caches, so they can be rendered at once, the hash of node is computed from theirs afterwards
+	auto& children = node->Children();
+	std::vector<MemorySink> rendered(children.size());
+	scheduler.ParallelFor(0, children.size(), 1, [&](size_t begin, size_t end)
+	{
+		for (size_t i = begin; i < end; i++)
+			Print(&rendered[i], children[i], 1);
+	});
+
+	dev->Printf(" * %s (%s) #%016llX\n", node->GetTypeString(), node->ToString().c_str(), node->StructuralHash());
+	for (auto& it : rendered)
+		dev->Write(it.Buffer());
+}
+
+void ASTProcessor::FillCaches(ASTNode* node)
+{
+	FillNodeCaches(node);
+	for (auto it : node->Children())
+		FillCaches(it);
+}
+
+void ASTProcessor::FillNodeCaches(ASTNode* node)
+{
+	node->StructuralHash();
+
+	ASTType* type = dynamic_cast<ASTType*>(node);
+	if (type)
+	{
+		type->ToString(true);
+		type->ToString(false);
+		type->ToNameString(true);
+		type->ToNameString(false);
+		type->GetCanonicalType();
+		type->GetCombinedCanonicalType();
+	}
+}
+
+void ASTProcessor::FillCaches(ASTNode* node, TaskScheduler& scheduler)
+{
+	auto& children = node->Children();
+	scheduler.ParallelFor(0, children.size(), 1, [&](size_t begin, size_t end)
+	{
+		for (size_t i = begin; i < end; i++)
+			FillCaches(children[i]);
+	});
+	FillNodeCaches(node);
+}
@@ -1,9 +1,21 @@
 #pragma once
 
 #include "ast.h"
+#include "outputSink.h"
+#include "taskScheduler.h"
 
 class ASTProcessor
 {
 public:
-	static void Print(FILE* dev, ASTNode* node, int level=0);
+	static void Print(OutputSink* dev, ASTNode* node, int level=0);
+	// same output, the children of node are rendered in parallel and written in order
+	static void Print(OutputSink* dev, ASTNode* node, TaskScheduler& scheduler);
+	// fills the lazily computed spellings, canonical types and hashes of the subtree,
+	// afterwards reading the tree does not write to it and several threads can read it at once
+	static void FillCaches(ASTNode* node);
+	// same, the children of node (the files of the root) are filled in parallel
+	static void FillCaches(ASTNode* node, TaskScheduler& scheduler);
+
+protected:
+	static void FillNodeCaches(ASTNode* node);
 };
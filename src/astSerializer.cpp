@@ -0,0 +1,416 @@
+#include "astSerializer.h"
+#include "ast.h"
+#include "cxxAstParser.h"
+#include <unordered_map>
+#include <stdexcept>
+
+namespace
+{
+	enum NodeKind
+	{
+		KindNode,
+		KindData,
+		KindToken,
+		KindType,
+	};
+
+	class Writer
+	{
+	public:
+		Writer(ASTCxxParser* a_parser) : parser(a_parser) {}
+
+		void Write(ASTNode* root, std::string& out)
+		{
+			Number(root);
+			Varint(String(parser->SourceIdentifier()));
+			Varint(parser->Tokens.size());
+			for (auto& it : parser->Tokens)
+				Token(it);
+			Node(root);
+
+			// the string table goes in front of the body that refers to it
+			std::string body;
+			body.swap(buffer);
+			Varint(strings.size());
+			for (auto it : order)
+			{
+				Varint(it->size());
+				buffer.append(*it);
+			}
+			out.append(buffer);
+			out.append(body);
+		}
+
+	protected:
+		void Varint(unsigned long long value)
+		{
+			while (value >= 0x80)
+			{
+				buffer.push_back((char)(value | 0x80));
+				value >>= 7;
+			}
+			buffer.push_back((char)value);
+		}
+
+		size_t String(const std::string& str)
+		{
+			auto it = strings.find(str);
+			if (it != strings.end())
+				return it->second;
+			it = strings.insert(std::make_pair(str, strings.size())).first;
+			order.push_back(&it->first);
+			return it->second;
+		}
+
+		void Token(const CxxToken& token)
+		{
+			Varint((unsigned long long)token.TokenType);
+			Varint(String(token.TokenData));
+			Varint(String(token.TokenParsedData));
+			Varint(token.TokenSymbol != SymbolTable::Empty ? 1 : 0);
+			// lines and offsets as differences to the previous token, mostly one byte each
+			Signed((long long)token.TokenLine - line);
+			Signed((long long)token.TokenByteOffset - offset);
+			line = token.TokenLine;
+			offset = (long long)token.TokenByteOffset;
+		}
+
+		void Signed(long long value)
+		{
+			Varint(((unsigned long long)value << 1) ^ (unsigned long long)(value >> 63));
+		}
+
+		void Reference(ASTNode* node)
+		{
+			auto it = indices.find(node);
+			Varint(it == indices.end() ? 0 : it->second + 1);
+		}
+
+		// preorder indices of the nodes, the references of a type can point forward
+		void Number(ASTNode* node)
+		{
+			size_t index = indices.size();
+			indices[node] = index;
+			for (auto it : node->Children())
+				Number(it);
+		}
+
+		void Pointers(const ASTType::PointerList& list)
+		{
+			Varint(list.size());
+			for (auto& it : list)
+			{
+				Varint((unsigned long long)it.pointerType);
+				Token(it.pointerToken);
+				Varint(it.pointerModifiers.size());
+				for (auto& it2 : it.pointerModifiers)
+					Token(it2);
+			}
+		}
+
+		template <class L> void Indices(const L& list)
+		{
+			Varint(list.size());
+			for (auto it : list)
+				Varint(it);
+		}
+
+		void Type(ASTType* type)
+		{
+			Varint(type->typeName.size());
+			for (auto& it : type->typeName)
+			{
+				Varint(it.Index);
+				Reference(it.TemplateArguments);
+			}
+			Indices(type->typeIdentifier);
+			Varint(type->typeModifiers.size());
+			for (auto& it : type->typeModifiers)
+			{
+				Varint(it.first);
+				Varint(it.second);
+			}
+			Indices(type->typeOperatorTokens);
+			Indices(type->typeBitfieldTokens);
+			Pointers(type->typePointers);
+			Pointers(type->typeIdentifierScopedPointers);
+			Varint(type->typeArrayTokens.size());
+			for (auto& it : type->typeArrayTokens)
+				Indices(it);
+			Indices(type->typeTemplateIndices);
+			Indices(type->typeFunctionPointerArgumentIndices);
+
+			Reference(type->head);
+			Reference(type->ndFuncArgumentList);
+			Reference(type->ndFuncModifierList);
+			Reference(type->ndFuncPointerArgumentList);
+		}
+
+		void Node(ASTNode* node)
+		{
+			ASTType* type = dynamic_cast<ASTType*>(node);
+			ASTTokenNode* tokenNode = dynamic_cast<ASTTokenNode*>(node);
+			ASTDataNode* dataNode = dynamic_cast<ASTDataNode*>(node);
+			if ((type && type->tokenSource != parser) || (tokenNode && tokenNode->tokenSource != parser))
+				throw std::runtime_error("node refers to the tokens of another file");
+
+			Varint(type ? KindType : tokenNode ? KindToken : dataNode ? KindData : KindNode);
+			Varint((unsigned long long)node->GetType());
+			if (type)
+				Type(type);
+			else if (tokenNode)
+				Indices(tokenNode->Tokens);
+			else if (dataNode)
+			{
+				Varint(dataNode->Data().size());
+				for (auto it : dataNode->Data())
+					Varint(String(symbols::Lookup(it)));
+			}
+
+			Varint(node->Children().size());
+			for (auto it : node->Children())
+				Node(it);
+		}
+
+		ASTCxxParser* parser;
+		long long line = 0;
+		long long offset = 0;
+		std::string buffer;
+		std::unordered_map<std::string, size_t> strings;
+		std::vector<const std::string*> order;
+		std::unordered_map<ASTNode*, size_t> indices;
+	};
+
+	class Reader
+	{
+	public:
+		Reader(const char* data, size_t length) : pos(data), end(data + length) {}
+
+		void Read(ASTCxxParser* a_parser, std::string& source, std::unique_ptr<ASTDataNode>& root)
+		{
+			parser = a_parser;
+			strings.resize(Count());
+			for (auto& it : strings)
+			{
+				size_t length = Count();
+				it.assign(pos, length);
+				pos += length;
+			}
+			source = String();
+			parser->Tokens.resize(Count());
+			for (auto& it : parser->Tokens)
+				Token(it);
+
+			std::unique_ptr<ASTNode> node(Node());
+			root.reset(dynamic_cast<ASTDataNode*>(node.get()));
+			if (!root || root->GetType() != ASTNode::Type::File)
+				throw std::runtime_error("the first node is not a file");
+			node.release();
+			if (pos != end)
+				throw std::runtime_error("trailing data");
+
+			for (auto& it : fixups)
+			{
+				if (it.second > nodes.size())
+					throw std::runtime_error("node reference out of range");
+				*it.first = it.second ? nodes[it.second - 1] : 0;
+			}
+			for (auto& it : heads)
+			{
+				if (it.second > nodes.size())
+					throw std::runtime_error("node reference out of range");
+				it.first->head = it.second ? dynamic_cast<ASTType*>(nodes[it.second - 1]) : 0;
+			}
+		}
+
+	protected:
+		unsigned long long Varint()
+		{
+			unsigned long long value = 0;
+			for (int shift = 0; shift < 64; shift += 7)
+			{
+				if (pos >= end)
+					throw std::runtime_error("unexpected end of data");
+				unsigned char byte = (unsigned char)*pos++;
+				value |= (unsigned long long)(byte & 0x7f) << shift;
+				if (!(byte & 0x80))
+					return value;
+			}
+			throw std::runtime_error("malformed number");
+		}
+
+		// a count of items that are at least one byte each, so a corrupt count does not allocate
+		size_t Count()
+		{
+			unsigned long long count = Varint();
+			if (count > (unsigned long long)(end - pos))
+				throw std::runtime_error("count out of range");
+			return (size_t)count;
+		}
+
+		const std::string& String()
+		{
+			unsigned long long index = Varint();
+			if (index >= strings.size())
+				throw std::runtime_error("string index out of range");
+			return strings[(size_t)index];
+		}
+
+		ASTTokenIndex TokenIndex()
+		{
+			unsigned long long index = Varint();
+			if (index >= parser->Tokens.size())
+				throw std::runtime_error("token index out of range");
+			return (ASTTokenIndex)index;
+		}
+
+		void Token(CxxToken& token)
+		{
+			token.TokenType = (CxxToken::Type)Varint();
+			token.TokenData = String();
+			token.TokenParsedData = String();
+			token.TokenSymbol = Varint() ? SymbolTable::Global().Intern(token.TokenData) : SymbolTable::Empty;
+			line += Signed();
+			offset += Signed();
+			token.TokenLine = (int)line;
+			token.TokenByteOffset = (size_t)offset;
+		}
+
+		long long Signed()
+		{
+			unsigned long long value = Varint();
+			return (long long)(value >> 1) ^ -(long long)(value & 1);
+		}
+
+		void Reference(ASTNode*& slot)
+		{
+			fixups.push_back(std::make_pair(&slot, (size_t)Varint()));
+		}
+
+		void Pointers(ASTType::PointerList& list)
+		{
+			for (size_t i = Count(); i > 0; i--)
+			{
+				ASTPointerType pointer;
+				pointer.pointerType = (ASTPointerType::Type)Varint();
+				Token(pointer.pointerToken);
+				pointer.pointerModifiers.resize(Count());
+				for (auto& it : pointer.pointerModifiers)
+					Token(it);
+				list.push_back(std::move(pointer));
+			}
+		}
+
+		template <class L> void Indices(L& list)
+		{
+			for (size_t i = Count(); i > 0; i--)
+				list.push_back(TokenIndex());
+		}
+
+		template <class L> void Numbers(L& list)
+		{
+			for (size_t i = Count(); i > 0; i--)
+				list.push_back((int)Varint());
+		}
+
+		void Type(ASTType* type)
+		{
+			std::vector<size_t> templateArguments;
+			for (size_t i = Count(); i > 0; i--)
+			{
+				ASTType::ASTTokenIndexTemplated name = { TokenIndex(), 0 };
+				type->typeName.push_back(name);
+				templateArguments.push_back((size_t)Varint());
+			}
+			Indices(type->typeIdentifier);
+			for (size_t i = Count(); i > 0; i--)
+			{
+				ASTType::TokenRange range;
+				range.first = TokenIndex();
+				range.second = TokenIndex();
+				type->typeModifiers.push_back(range);
+			}
+			Indices(type->typeOperatorTokens);
+			Indices(type->typeBitfieldTokens);
+			Pointers(type->typePointers);
+			Pointers(type->typeIdentifierScopedPointers);
+			for (size_t i = Count(); i > 0; i--)
+			{
+				std::vector<ASTTokenIndex> tokens;
+				Indices(tokens);
+				type->typeArrayTokens.push_back(std::move(tokens));
+			}
+			Numbers(type->typeTemplateIndices);
+			Numbers(type->typeFunctionPointerArgumentIndices);
+
+			// the name list is complete, its entries do not move anymore
+			for (size_t i = 0; i < templateArguments.size(); i++)
+				fixups.push_back(std::make_pair(&type->typeName[i].TemplateArguments, templateArguments[i]));
+			heads.push_back(std::make_pair(type, (size_t)Varint()));
+			Reference(type->ndFuncArgumentList);
+			Reference(type->ndFuncModifierList);
+			Reference(type->ndFuncPointerArgumentList);
+		}
+
+		ASTNode* Node()
+		{
+			std::unique_ptr<ASTNode> node;
+			unsigned long long kind = Varint();
+			switch (kind)
+			{
+				case KindNode: node.reset(new ASTNode()); break;
+				case KindData: node.reset(new ASTDataNode()); break;
+				case KindToken: node.reset(new ASTTokenNode(parser)); break;
+				case KindType: node.reset(new ASTType(parser)); break;
+				default: throw std::runtime_error("unknown node kind");
+			}
+			unsigned long long type = Varint();
+			if (type >= (unsigned long long)ASTNode::Type::TypeCount)
+				throw std::runtime_error("unknown node type");
+			node->SetType((ASTNode::Type)type);
+			nodes.push_back(node.get());
+
+			if (kind == KindType)
+				Type(static_cast<ASTType*>(node.get()));
+			else if (kind == KindToken)
+				Indices(static_cast<ASTTokenNode*>(node.get())->Tokens);
+			else if (kind == KindData)
+			{
+				for (size_t i = Count(); i > 0; i--)
+					static_cast<ASTDataNode*>(node.get())->AddData(String());
+			}
+
+			for (size_t i = Count(); i > 0; i--)
+				node->AddNode(Node());
+			return node.release();
+		}
+
+		const char* pos;
+		const char* end;
+		long long line = 0;
+		long long offset = 0;
+		ASTCxxParser* parser = 0;
+		std::vector<std::string> strings;
+		std::vector<ASTNode*> nodes;
+		std::vector<std::pair<ASTNode**, size_t> > fixups;
+		std::vector<std::pair<ASTType*, size_t> > heads;
+	};
+}
+
+void ASTSerializer::Write(ASTCxxParser* parser, ASTNode* root, std::string& out)
+{
+	Writer(parser).Write(root, out);
+}
+
+void ASTSerializer::Read(const char* data, size_t length, std::unique_ptr<ASTCxxParser>& parser, std::unique_ptr<ASTDataNode>& root)
+{
+	std::unique_ptr<ASTCxxParser> newParser(new ASTCxxParser());
+	std::unique_ptr<ASTDataNode> newRoot;
+	Reader(data, length).Read(newParser.get(), newParser->m_source, newRoot);
+
+	// the spans point into the annotation storage of the new parser
+	newParser->ResolveAnnotations(newRoot.get());
+	newRoot->StructuralHash();
+	parser = std::move(newParser);
+	root = std::move(newRoot);
+}
@@ -0,0 +1,21 @@
+#pragma once
+
+#include <string>
+#include <memory>
+
+class ASTNode;
+class ASTDataNode;
+class ASTCxxParser;
+
+// Compact binary form of a parsed file: its tokens and its tree, for handing files between processes (--shards).
+// Spellings are written once into a string table (symbol ids are only valid in the process that interned them) and
+// numbers are varints. Pointers between the nodes of the file (declaration heads, argument lists, template arguments)
+// are written as preorder indices. Annotation spans and structural hashes are not written, they are rebuilt by Read().
+class ASTSerializer
+{
+public:
+	// appends the file below root (a File node) with the tokens of the parser to out
+	static void Write(ASTCxxParser* parser, ASTNode* root, std::string& out);
+	// rebuilds a parser holding the tokens and the file, throws std::runtime_error for malformed data
+	static void Read(const char* data, size_t length, std::unique_ptr<ASTCxxParser>& parser, std::unique_ptr<ASTDataNode>& root);
+};
@@ -0,0 +1,88 @@
+#include "astVisitor.h"
+#include "smallVector.h"
+
+void ASTVisitor::SetFilter(std::initializer_list<ASTNode::Type> types)
+{
+	m_filter.reset();
+	for (auto it : types)
+		m_filter.set((size_t)it);
+}
+
+void ASTVisitor::Traverse(ASTNode* root, ASTVisitor* visitor)
+{
+	visitor->Begin(root);
+	Visit(root, &visitor, 1);
+	visitor->End(root);
+}
+
+void ASTVisitor::TraverseFused(ASTNode* root, const std::vector<ASTVisitor*>& visitors)
+{
+	for (auto it : visitors)
+		it->Begin(root);
+	if (!visitors.empty())
+		Visit(root, visitors.data(), visitors.size());
+	for (auto it : visitors)
+		it->End(root);
+}
+
+void ASTVisitor::Visit(ASTNode* node, ASTVisitor* const* visitors, size_t count)
+{
+	// visitors that descend into the children, and the ones that need a post call
+	SmallVector<ASTVisitor*, 8> descend;
+	SmallVector<ASTVisitor*, 8> post;
+	ASTNode::Type type = node->GetType();
+	for (size_t i = 0; i < count; i++)
+	{
+		ASTVisitor* visitor = visitors[i];
+		if (!visitor->Accepts(type))
+		{
+			descend.push_back(visitor);
+			continue;
+		}
+		post.push_back(visitor);
+		if (visitor->Pre(node))
+			descend.push_back(visitor);
+	}
+
+	if (!descend.empty())
+	{
+		for (auto it : node->Children())
+			Visit(it, descend.begin(), descend.size());
+	}
+
+	for (auto it : post)
+		it->Post(node);
+}
+
+ASTVisitorStream::ASTVisitorStream(ASTNode* root, const std::vector<ASTVisitor*>& visitors) : m_root(root), m_visitors(visitors)
+{
+	for (auto it : m_visitors)
+		it->Begin(root);
+
+	ASTNode::Type type = root->GetType();
+	for (auto it : m_visitors)
+	{
+		if (!it->Accepts(type))
+		{
+			m_descend.push_back(it);
+			continue;
+		}
+		m_post.push_back(it);
+		if (it->Pre(root))
+			m_descend.push_back(it);
+	}
+}
+
+void ASTVisitorStream::Visit(ASTNode* child)
+{
+	if (!m_descend.empty())
+		ASTVisitor::Visit(child, m_descend.data(), m_descend.size());
+}
+
+void ASTVisitorStream::Finish()
+{
+	for (auto it : m_post)
+		it->Post(m_root);
+	for (auto it : m_visitors)
+		it->End(m_root);
+}
@@ -0,0 +1,53 @@
+#pragma once
+
+#include <bitset>
+#include <initializer_list>
+#include "ast.h"
+
+// Read-only visitor with pre/post hooks, filtered by node type.
+// Several visitors can share one traversal of the tree (TraverseFused), every visitor writes to its own output sink.
+class ASTVisitor
+{
+public:
+	ASTVisitor() { m_filter.set(); }
+	virtual ~ASTVisitor() {}
+
+	virtual void Begin(ASTNode* /*root*/) {}
+	// only called for accepted node types, return false to skip the children of the node
+	virtual bool Pre(ASTNode* /*node*/) { return true; }
+	// called after the children for every node Pre() was called for
+	virtual void Post(ASTNode* /*node*/) {}
+	virtual void End(ASTNode* /*root*/) {}
+
+	// nodes of other types are not reported, but their children are still visited
+	void SetFilter(std::initializer_list<ASTNode::Type> types);
+	bool Accepts(ASTNode::Type type) const { return m_filter[(size_t)type]; }
+
+	static void Traverse(ASTNode* root, ASTVisitor* visitor);
+	// runs all visitors in a single walk, Begin() and End() are called in the order of the list
+	static void TraverseFused(ASTNode* root, const std::vector<ASTVisitor*>& visitors);
+
+protected:
+	friend class ASTVisitorStream;
+	static void Visit(ASTNode* node, ASTVisitor* const* visitors, size_t count);
+
+	std::bitset<(size_t)ASTNode::Type::TypeCount> m_filter;
+};
+
+// Fused traversal of a tree that arrives one child of the root at a time (streaming execution).
+// Makes the same calls as TraverseFused when Visit() is called for every child of the root in order.
+class ASTVisitorStream
+{
+public:
+	// calls Begin() and Pre() for the root
+	ASTVisitorStream(ASTNode* root, const std::vector<ASTVisitor*>& visitors);
+	void Visit(ASTNode* child);
+	// calls Post() for the root and End()
+	void Finish();
+
+protected:
+	ASTNode* m_root;
+	std::vector<ASTVisitor*> m_visitors;
+	std::vector<ASTVisitor*> m_descend;
+	std::vector<ASTVisitor*> m_post;
+};
@@ -0,0 +1,57 @@
+#pragma once
+
+#include <deque>
+#include <mutex>
+#include <condition_variable>
+
+// Blocking queue with a maximum depth, connects the stages of a pipeline.
+// Push() waits while the queue is full, Pop() waits while it is empty and returns false once it is closed and drained.
+template <class T> class BoundedQueue
+{
+public:
+	explicit BoundedQueue(size_t depth) : m_depth(depth ? depth : 1) {}
+
+	void Push(T&& item)
+	{
+		std::unique_lock<std::mutex> lk(m_lock);
+		m_notFull.wait(lk, [this]() { return m_items.size() < m_depth || m_closed; });
+		m_items.push_back(std::move(item));
+		if (m_items.size() > m_maxDepth)
+			m_maxDepth = m_items.size();
+		m_notEmpty.notify_one();
+	}
+
+	bool Pop(T& item)
+	{
+		std::unique_lock<std::mutex> lk(m_lock);
+		m_notEmpty.wait(lk, [this]() { return !m_items.empty() || m_closed; });
+		if (m_items.empty())
+			return false;
+		item = std::move(m_items.front());
+		m_items.pop_front();
+		m_notFull.notify_one();
+		return true;
+	}
+
+	// no more items will be pushed, wakes up all waiting consumers
+	void Close()
+	{
+		std::lock_guard<std::mutex> lk(m_lock);
+		m_closed = true;
+		m_notEmpty.notify_all();
+		m_notFull.notify_all();
+	}
+
+	size_t Depth() const { return m_depth; }
+	// highest number of items that were waiting in the queue at once
+	size_t MaxDepth() const { std::lock_guard<std::mutex> lk(m_lock); return m_maxDepth; }
+
+protected:
+	mutable std::mutex m_lock;
+	std::condition_variable m_notFull;
+	std::condition_variable m_notEmpty;
+	std::deque<T> m_items;
+	size_t m_depth;
+	size_t m_maxDepth = 0;
+	bool m_closed = false;
+};
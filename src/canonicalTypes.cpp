@@ -0,0 +1,185 @@
+#include "canonicalTypes.h"
+#include "tools.h"
+#include <algorithm>
+#include <stdexcept>
+
+SymbolId CanonicalTypeTable::TokenSymbol(const ASTTypeView& view, ASTTokenIndex index)
+{
+	const CxxToken& token = view.TokenSource()->Tokens[index];
+	if (token.TokenSymbol != SymbolTable::Empty)
+		return token.TokenSymbol;
+	return SymbolTable::Global().Intern(token.TokenData);
+}
+
+SymbolId CanonicalTypeTable::InternSpelling(const ASTTypeView& view, void (ASTTypeView::*append)(std::string&) const)
+{
+	std::string spelling;
+	(view.*append)(spelling);
+	return SymbolTable::Global().Intern(spelling);
+}
+
+void CanonicalTypeTable::BuildKey(const ASTTypeView& view, KeyBuffer& key)
+{
+	// modifiers, sorted so "const static" and "static const" share an entry
+	SmallVector<SymbolId, 4> modifiers;
+	for (auto& it : view.TypeModifiers())
+	{
+		if (it.first == it.second)
+			modifiers.push_back(TokenSymbol(view, it.first));
+		else
+		{
+			std::string modifier;
+			for (size_t i = it.first; i <= it.second; i++)
+				modifier.append(view.TokenSource()->Tokens[i].TokenData);
+			modifiers.push_back(SymbolTable::Global().Intern(modifier));
+		}
+	}
+	std::sort(modifiers.begin(), modifiers.end());
+	for (auto it : modifiers)
+	{
+		key.push_back(KeyModifier);
+		key.push_back(it);
+	}
+
+	// name tokens and template arguments
+	for (auto& it : view.TypeName())
+	{
+		key.push_back(KeyName);
+		key.push_back(TokenSymbol(view, it.Index));
+		if (it.TemplateArguments == 0)
+			continue;
+
+		key.push_back(KeyTemplateOpen);
+		for (auto itArg : it.TemplateArguments->Children())
+		{
+			ASTType* argType = dynamic_cast<ASTType*>(itArg);
+			if (argType)
+			{
+				key.push_back(KeyTemplateType);
+				key.push_back(argType->GetCanonicalType());
+				if (!argType->typeIdentifier.empty())
+				{
+					key.push_back(KeyIdentifier);
+					key.push_back(SymbolTable::Global().Intern(argType->ToIdentifierString()));
+				}
+			}
+			else if (itArg->GetType() == ASTNode::Type::VarArgDcl)
+				key.push_back(KeyTemplateVarArgs);
+			else
+			{
+				key.push_back(KeyTemplateValue);
+				key.push_back(SymbolTable::Global().Intern(itArg->ToString()));
+			}
+		}
+		key.push_back(KeyTemplateClose);
+	}
+
+	// pointer/reference chain
+	for (auto& it : view.TypePointers())
+	{
+		key.push_back(it.pointerType == ASTPointerType::Type::Pointer ? KeyPointer : KeyReference);
+		for (auto& itModifier : it.pointerModifiers)
+			key.push_back(itModifier.TokenSymbol != SymbolTable::Empty ? itModifier.TokenSymbol : SymbolTable::Global().Intern(itModifier.TokenData));
+	}
+
+	// rarely used parts are keyed by their spelling
+	if (!view.TypeIdentifierScopedPointers().empty())
+	{
+		key.push_back(KeyScopedPointers);
+		key.push_back(InternSpelling(view, &ASTTypeView::AppendPointerIdentifierScopedString));
+	}
+	if (!view.TypeArrayTokens().empty())
+	{
+		key.push_back(KeyArrays);
+		key.push_back(InternSpelling(view, &ASTTypeView::AppendArrayTokensString));
+	}
+	if (!view.TypeBitfieldTokens().empty())
+	{
+		key.push_back(KeyBitfield);
+		key.push_back(InternSpelling(view, &ASTTypeView::AppendBitfieldString));
+	}
+	if (!view.TypeOperatorTokens().empty())
+	{
+		key.push_back(KeyOperator);
+		key.push_back(InternSpelling(view, &ASTTypeView::AppendOperatorString));
+	}
+	if (view.FuncArgumentList() || view.FuncPointerArgumentList())
+	{
+		key.push_back(KeyArguments);
+		key.push_back(InternSpelling(view, &ASTTypeView::AppendArgumentsString));
+	}
+	if (view.FuncModifierList())
+	{
+		key.push_back(KeyFunctionModifiers);
+		key.push_back(InternSpelling(view, &ASTTypeView::AppendFunctionModifiersString));
+	}
+}
+
+CanonicalTypeId CanonicalTypeTable::Canonicalize(const ASTTypeView& view)
+{
+	// build the key outside of the lock, template arguments are canonicalized recursively
+	KeyBuffer keyData;
+	BuildKey(view, keyData);
+	Key key = { keyData.begin(), keyData.size(), (size_t)tools::Hash64(keyData.begin(), keyData.size() * sizeof(unsigned int)) };
+
+	{
+		std::lock_guard<std::mutex> lk(m_lock);
+		auto found = m_index.find(key);
+		if (found != m_index.end())
+			return found->second;
+	}
+
+	// first occurrence of this type
+	Entry entry;
+	entry.nameWithoutTemplateArguments = SymbolTable::Global().Intern(view.ToNameString(false));
+
+	std::lock_guard<std::mutex> lk(m_lock);
+	auto found = m_index.find(key);
+	if (found != m_index.end())
+		return found->second; // another thread was faster
+
+	m_keys.push_back(std::vector<unsigned int>(keyData.begin(), keyData.end()));
+	key.data = m_keys.back().data();
+	m_entries.push_back(entry);
+	// the key, the entry and an index node
+	m_bytes += m_keys.back().size() * sizeof(unsigned int) + sizeof(std::vector<unsigned int>) + sizeof(Entry) + sizeof(Key) + sizeof(CanonicalTypeId) + 2 * sizeof(void*);
+
+	CanonicalTypeId id = (CanonicalTypeId)m_entries.size();
+	m_index[key] = id;
+	return id;
+}
+
+CanonicalTypeTable::Entry CanonicalTypeTable::Get(CanonicalTypeId id) const
+{
+	std::lock_guard<std::mutex> lk(m_lock);
+	if (id == 0 || id > m_entries.size())
+		throw std::runtime_error("invalid canonical type id");
+	return m_entries[id - 1];
+}
+
+size_t CanonicalTypeTable::Count() const
+{
+	std::lock_guard<std::mutex> lk(m_lock);
+	return m_entries.size();
+}
+
+size_t CanonicalTypeTable::MemoryBytes() const
+{
+	std::lock_guard<std::mutex> lk(m_lock);
+	return m_bytes + m_index.bucket_count() * sizeof(void*);
+}
+
+void CanonicalTypeTable::Clear()
+{
+	std::lock_guard<std::mutex> lk(m_lock);
+	std::unordered_map<Key, CanonicalTypeId, KeyHash>().swap(m_index);
+	std::deque<std::vector<unsigned int> >().swap(m_keys);
+	std::deque<Entry>().swap(m_entries);
+	m_bytes = 0;
+}
+
+CanonicalTypeTable& CanonicalTypeTable::Global()
+{
+	static CanonicalTypeTable gCanonicalTypes;
+	return gCanonicalTypes;
+}
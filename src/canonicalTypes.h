@@ -0,0 +1,74 @@
+#pragma once
+
+#include <deque>
+#include <vector>
+#include <unordered_map>
+#include <mutex>
+#include "ast.h"
+#include "symbols.h"
+
+// Hash-consed table of structurally identical types (name tokens, template arguments, pointer/reference chain, modifiers).
+// Every unique type gets one immutable entry, ASTType::GetCanonicalType() returns the id of that entry.
+class CanonicalTypeTable
+{
+public:
+	// Only what the key determines: types with differently ordered modifiers or differently spelled template arguments
+	// share an entry, so the spellings of the types themselves are rendered from their own tokens.
+	struct Entry
+	{
+		SymbolId nameWithoutTemplateArguments;		// ASTTypeView::ToNameString(false)
+	};
+
+	// the view may combine a type with its declaration head
+	CanonicalTypeId Canonicalize(const ASTTypeView& view);
+	Entry Get(CanonicalTypeId id) const;
+	size_t Count() const;
+	// estimated heap bytes of the keys, entries and the index
+	size_t MemoryBytes() const;
+	// only while no id of the table is held anywhere
+	void Clear();
+
+	static CanonicalTypeTable& Global();
+
+protected:
+	typedef SmallVector<unsigned int, 16> KeyBuffer;
+
+	enum KeyTag
+	{
+		KeyName = 0x80000001,
+		KeyTemplateOpen,
+		KeyTemplateClose,
+		KeyTemplateType,
+		KeyTemplateValue,
+		KeyTemplateVarArgs,
+		KeyIdentifier,
+		KeyModifier,
+		KeyPointer,
+		KeyReference,
+		KeyScopedPointers,
+		KeyArrays,
+		KeyBitfield,
+		KeyOperator,
+		KeyArguments,
+		KeyFunctionModifiers,
+	};
+
+	struct Key
+	{
+		const unsigned int* data;
+		size_t length;
+		size_t hash;
+		bool operator == (const Key& o) const { return length == o.length && memcmp(data, o.data, length * sizeof(unsigned int)) == 0; }
+	};
+	struct KeyHash { size_t operator () (const Key& k) const { return k.hash; } };
+
+	void BuildKey(const ASTTypeView& view, KeyBuffer& key);
+	static SymbolId TokenSymbol(const ASTTypeView& view, ASTTokenIndex index);
+	static SymbolId InternSpelling(const ASTTypeView& view, void (ASTTypeView::*append)(std::string&) const);
+
+	mutable std::mutex m_lock;
+	std::unordered_map<Key, CanonicalTypeId, KeyHash> m_index;
+	std::deque<std::vector<unsigned int> > m_keys; // deque keeps key addresses stable for the index
+	std::deque<Entry> m_entries;
+	size_t m_bytes = 0;
+};
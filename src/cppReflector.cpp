@@ -0,0 +1,140 @@
+#include "cppReflector.h"
+#include "tools.h"
+#include "modules.h"
+#include "ast.h"
+#include "cxxAstParser.h"
+#include "moduleSchedule.h"
+#include "taskScheduler.h"
+#include "annotationIndex.h"
+#include "parseCache.h"
+#include "reflectorDaemon.h"
+#include "reflectorWatch.h"
+#include "log.h"
+#include <algorithm>
+
+CppReflector::CppReflector() : m_opts(new tools::CommandLineParser())
+{
+}
+
+CppReflector::~CppReflector()
+{
+}
+
+void CppReflector::AddArgument(const std::string& argument)
+{
+	// same rules as the command line
+	char* argv[] = { (char*)"", (char*)argument.c_str() };
+	tools::CommandLineParser::parse(*m_opts, 2, argv);
+}
+
+void CppReflector::AddSource(const std::string& name, const char* data, size_t length)
+{
+	tools::MemorySource source = { data, length };
+	if (std::find(m_opts->names.begin(), m_opts->names.end(), name) == m_opts->names.end())
+		m_opts->names.push_back(name);
+	m_opts->memorySources[name] = source;
+}
+
+void CppReflector::Reset()
+{
+	m_opts.reset(new tools::CommandLineParser());
+}
+
+std::vector<CppReflector::Result> CppReflector::Run()
+{
+	if (m_cache)
+	{
+		m_opts->options.erase("stream");
+		m_opts->optionsWithValues.erase("memory-budget");
+	}
+
+	ModuleSchedule schedule;
+	schedule.CaptureOutput();
+	schedule.Build(*m_opts);
+	Execute(*m_opts, schedule, m_cache);
+
+	std::vector<Result> ret;
+	for (size_t i = 0; i < schedule.Entries().size(); i++)
+	{
+		Result result;
+		result.module = schedule.Entries()[i].name;
+		result.output = schedule.TakeOutput(i);
+		result.milliseconds = schedule.Milliseconds(i);
+		ret.push_back(std::move(result));
+	}
+	return ret;
+}
+
+void CppReflector::Execute(tools::CommandLineParser& opts, ModuleSchedule& schedule, ParseCache* cache)
+{
+	// create root objects
+	std::vector<std::unique_ptr<ASTCxxParser>> parsers;
+	ASTNode superRoot;
+	superRoot.SetType(ASTNode::Type::Root);
+
+	// the index points into the tree of this run only
+	AnnotationIndex::Global().Clear();
+
+	// the log levels of this run (--log, --verbose)
+	Log::Configure(opts);
+
+	// one pool of workers for all modules, so concurrent modules do not add up their thread counts
+	TaskScheduler scheduler((int)opts.intOption("jobs", TaskScheduler::DefaultJobs()));
+	ParseCache::SetCurrent(cache);
+	try
+	{
+		schedule.Execute(opts, &superRoot, parsers, scheduler);
+	}
+	catch (...)
+	{
+		ParseCache::SetCurrent(0);
+		AnnotationIndex::Global().Clear();
+		Log::Flush();
+		throw;
+	}
+	ParseCache::SetCurrent(0);
+	AnnotationIndex::Global().Clear();
+	Log::Flush();
+
+	// the files go back to the cache instead of being destroyed with the root
+	if (cache)
+		cache->Return(parsers, &superRoot);
+}
+
+int CppReflector::Main(int argc, char** argv)
+{
+	// parse command line arguments
+	tools::CommandLineParser opts;
+	tools::CommandLineParser::parse(opts, argc, argv);
+	Log::Configure(opts);
+
+	// resident daemon, or a request to one
+	auto itServe = opts.optionsWithValues.find("serve");
+	if (itServe != opts.optionsWithValues.end() && !itServe->second.empty())
+		return ReflectorDaemon(opts).Serve(itServe->second.back());
+	auto itConnect = opts.optionsWithValues.find("connect");
+	if (itConnect != opts.optionsWithValues.end() && !itConnect->second.empty())
+		return ReflectorDaemon::Request(itConnect->second.back(), argc, argv);
+
+	// check whether help is needed
+	if (opts.optionsWithValues["module"].size() == 0)
+	{
+		LOG_INFO(LogCategory::General, "Supported modules:\n");
+		auto& modules = ModuleRegistration::Modules();
+		for (auto it : modules)
+			LOG_INFO(LogCategory::General, " * \"%s\"\n", it.first.c_str());
+	}
+
+	// order the modules by what they read and write, independent modules run concurrently
+	ModuleSchedule schedule;
+	schedule.Build(opts);
+	if (opts.options.find("dry-run") != opts.options.end())
+	{
+		schedule.Print(stdout);
+		return 0;
+	}
+	if (opts.options.count("watch"))
+		return ReflectorWatch(opts).Run();
+	Execute(opts, schedule, 0);
+	return 0;
+}
@@ -0,0 +1,67 @@
+#pragma once
+
+#include <string>
+#include <vector>
+#include <memory>
+
+// the library is a DLL on Windows, define CPPREFLECTOR_STATIC when the sources are compiled into the application
+#if defined(_WIN32) && !defined(CPPREFLECTOR_STATIC)
+#ifdef CPPREFLECTOR_EXPORTS
+#define CPPREFLECTOR_API __declspec(dllexport)
+#else
+#define CPPREFLECTOR_API __declspec(dllimport)
+#endif
+#else
+#define CPPREFLECTOR_API
+#endif
+
+namespace tools { struct CommandLineParser; }
+class ModuleSchedule;
+class ParseCache;
+
+// Embedding API of the CppReflectorLib library: runs modules like the command line tool does, on sources that are
+// in memory, and hands back the output of every module instead of writing it to stdout or files.
+// For example:
+//   CppReflector reflector;
+//   reflector.AddArgument("--module=cpp_parser");
+//   reflector.AddArgument("--module=reflection_data");
+//   reflector.AddSource("test1.xh", text, textLength);
+//   std::string generated = reflector.Run()[1].output;
+// Runs share the process wide symbol tables, so use one run at a time.
+class CPPREFLECTOR_API CppReflector
+{
+public:
+	struct Result
+	{
+		std::string module;
+		std::string output;
+		double milliseconds;	// wall time of the module (shared by visitor modules that were run in one traversal)
+	};
+
+	CppReflector();
+	~CppReflector();
+
+	// a command line argument: "--module=<name>", another option, or the name of a file that is read from disk
+	void AddArgument(const std::string& argument);
+	// a source that is owned by the caller, it is tokenized in place (not copied) and has to stay valid until Run() returns
+	void AddSource(const std::string& name, const char* data, size_t length);
+	// forgets the arguments and sources
+	void Reset();
+	// keeps the parsed files between runs, files that did not change are not parsed again (the daemon of --serve)
+	// streaming (--stream) is not used with a cache, since it releases every file right after it was visited
+	void SetParseCache(ParseCache* cache) { m_cache = cache; }
+
+	// runs the --module entries, returns their output in command line order (--output is ignored)
+	// errors of a module are thrown as std::runtime_error
+	std::vector<Result> Run();
+
+	// the command line tool
+	static int Main(int argc, char** argv);
+	// runs a built schedule on a fresh tree with the scheduler of --jobs (the command line tool, the daemon and --watch)
+	static void Execute(tools::CommandLineParser& opts, ModuleSchedule& schedule, ParseCache* cache);
+
+protected:
+
+	std::unique_ptr<tools::CommandLineParser> m_opts;
+	ParseCache* m_cache = 0;
+};
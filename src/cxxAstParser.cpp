@@ -1,5 +1,7 @@
 #include "cxxAstParser.h"
+#include "log.h"
 #include <memory>
+#include <algorithm>
 
 #define SUBTYPE_MODE_SUBVARIABLE 0
 #define SUBTYPE_MODE_SUBARGUMENT 1
@@ -94,41 +96,244 @@ static std::string CombineTokens(ASTTokenSource* source, std::vector<ASTTokenInd
 ASTCxxParser::ASTCxxParser(CxxTokenizer& fromTokenizer)
 {
 	m_source = fromTokenizer.Identifier;
-	int lineNumber = 1;
-	CxxToken token;
-	while (token.TokenType != CxxToken::Type::EndOfStream)
+	while (TokenizeNext(fromTokenizer)) {}
+}
+
+ASTCxxParser::ASTCxxParser(CxxTokenizer& fromTokenizer, bool incremental)
+{
+	m_source = fromTokenizer.Identifier;
+	if (!incremental)
+	{
+		while (TokenizeNext(fromTokenizer)) {}
+	}
+	else if (TokenizeNext(fromTokenizer))
+		m_tokenizer = &fromTokenizer;
+}
+
+bool ASTCxxParser::TokenizeNext(CxxTokenizer& tokenizer)
+{
+	CxxToken token = tokenizer.GetNextToken();
+	token.TokenLine = m_lineNumber;
+	if (token.TokenType == CxxToken::Type::Newline)
 	{
-		token = fromTokenizer.GetNextToken();
-		token.TokenLine = lineNumber;
-		if (token.TokenType == CxxToken::Type::Newline)
+		m_lineNumber++;
+	}
+	Tokens.push_back(token);
+	return token.TokenType != CxxToken::Type::EndOfStream;
+}
+
+void ASTCxxParser::TokenizeParticle(ASTPosition& position)
+{
+	// tokens are only added between particles, nothing refers into the token stream then
+	auto available = [this](size_t i)
+	{
+		while (i >= Tokens.size() && m_tokenizer)
 		{
-			lineNumber++;
+			if (!TokenizeNext(*m_tokenizer))
+				m_tokenizer = 0;
 		}
-		else
-		{
+		return i < Tokens.size() && Tokens[i].TokenType != CxxToken::Type::EndOfStream;
+	};
 
+	// namespaces are parsed particle by particle as well, their braces end a particle
+	bool namespaceHead = false;
+	size_t i = position.GetTokenIndex();
+	for (int depth = 0; available(i); i++)
+	{
+		CxxToken::Type type = Tokens[i].TokenType;
+		if (type == CxxToken::Type::LBrace || type == CxxToken::Type::LParen || type == CxxToken::Type::LBracket ||
+			type == CxxToken::Type::AnnotationForwardStart || type == CxxToken::Type::AnnotationBackStart)
+		{
+			depth++;
+			if (namespaceHead && depth == 1 && type == CxxToken::Type::LBrace)
+				break;
 		}
-		Tokens.push_back(token);
+		else if (type == CxxToken::Type::RBrace || type == CxxToken::Type::RParen || type == CxxToken::Type::RBracket)
+		{
+			if (--depth < 0)
+				break;
+		}
+		else if (depth <= 0 && (type == CxxToken::Type::Semicolon || type == CxxToken::Type::Preprocessor))
+			break;
+		else if (depth == 0 && type == CxxToken::Type::Namespace)
+			namespaceHead = true;
+	}
+	for (i++; available(i); i++)
+	{
+		if (ASTPosition::FilterWhitespaceComments(Tokens[i]))
+			break;
 	}
 }
 
 bool ASTCxxParser::Parse(ASTNode* parent, ASTPosition& position)
 {
+	ASTTreeBuilder builder;
+	return Parse(parent, builder, position);
+}
+
+bool ASTCxxParser::Parse(ASTNode* parent, ASTEventConsumer& consumer, ASTPosition& position)
+{
+	m_consumer = &consumer;
+	m_events.Truncate(0);
+	m_particlesTaken = false;
+	m_tokensPinned = 0;
+	Annotations.Clear();
+
+	if (m_tokenizer)
+		TokenizeParticle(position);
 	ParseBOM(position);
 
+	ASTEvent fileBegin = { parent, this, ASTTokenSpan() };
+	consumer.FileBegin(fileBegin);
 
+	StreamScope scope = { parent, parent->Children().size(), parent->Children().size(), false, NoToken };
+	m_scopes.assign(1, scope);
+	ParseScope(parent, position, false);
+	SendGroup(m_scopes.back(), parent->Children().size(), m_events.Size());
+	m_scopes.clear();
+
+	ASTEvent fileEnd = { parent, this, ASTTokenSpan() };
+	consumer.FileEnd(fileEnd);
+	m_consumer = 0;
+	return true;
+}
+
+bool ASTCxxParser::ParseScope(ASTNode* scope, ASTPosition& position, bool isNamespace)
+{
 	while (true)
 	{
-		if (ParseEndOfStream(parent, position))
-			break;
+		if (m_tokenizer)
+			TokenizeParticle(position);
+		if (ParseEndOfStream(scope, position))
+			return false;
 
-		if (ParseRootParticle(parent, position))
+		ASTTokenIndex start = position.GetTokenIndex();
+		size_t events = m_events.Size();
+		if (ParseRootParticle(scope, position))
+		{
+			StreamParticles(start, events);
+			ReleaseStreamedTokens(position);
 			continue;
+		}
 
-		ParseUnknown(parent, position);
+		if (isNamespace && position.GetToken().TokenType == CxxToken::Type::RBrace)
+			return true; // reached namespace end
+
+		// unknown tokens found; skip
+		ParseUnknown(scope, position);
 	}
+}
 
-	return true;
+void ASTCxxParser::StreamParticles(ASTTokenIndex start, size_t events)
+{
+	StreamScope& scope = m_scopes.back();
+	const std::vector<ASTNode*>& children = scope.node->Children();
+	if (scope.classified == children.size())
+		return; // nothing added, or a namespace that was streamed already
+
+	ASTNode::Type type = children[scope.classified]->GetType();
+	bool declaration = false;
+	for (size_t i = scope.classified; i < children.size(); i++)
+	{
+		if (children[i]->GetType() != ASTNode::Type::AntFwd && children[i]->GetType() != ASTNode::Type::AntBack)
+			declaration = true;
+	}
+
+	// back annotations belong to the declaration in front of them, anything else starts a new group after a declaration
+	if (scope.groupHasDeclaration && (declaration || type == ASTNode::Type::AntFwd))
+		SendGroup(scope, scope.classified, events);
+
+	if (scope.eventTokens == NoToken && m_events.Size() > 0)
+		scope.eventTokens = start;
+	scope.groupHasDeclaration |= declaration;
+	scope.classified = scope.node->Children().size();
+}
+
+void ASTCxxParser::SendGroup(StreamScope& scope, size_t end, size_t events)
+{
+	// the children of the next group are set aside, the consumer may attach the particles to the same node
+	std::vector<ASTNode*> next = scope.node->DetachChildrenFrom(end);
+
+	std::vector<IndexedAnnotation> index;
+	ResolveAnnotations(scope.node, scope.groupBegin, end, true, &index);
+	m_events.Send(*m_consumer, events);
+
+	std::vector<ASTNode*> particles = scope.node->DetachChildrenFrom(scope.groupBegin);
+	std::vector<ASTNode*> released;
+	for (size_t i = 0; i < particles.size(); i++)
+	{
+		ASTEvent e = { particles[i], this, ASTTokenSpan() };
+		if (!m_consumer->Particle(e))
+		{
+			released.push_back(particles[i]);
+			continue;
+		}
+		m_particlesTaken = true;
+		for (auto& it : index)
+		{
+			if (it.particle == scope.groupBegin + i)
+				Annotations.Add(it.node, it.annotation);
+		}
+	}
+	// the annotations of a particle can be released ones, they go when the whole group was handed over
+	for (auto it : released)
+		it->DestroyChildrenAndSelf();
+
+	scope.groupBegin = scope.node->Children().size();
+	scope.classified = scope.groupBegin;
+	scope.groupHasDeclaration = false;
+	scope.eventTokens = NoToken;
+	scope.node->AddNodes(next);
+}
+
+void ASTCxxParser::ReleaseStreamedTokens(ASTPosition& position)
+{
+	if (m_particlesTaken)
+		return;
+
+	// the tokens from the first unsent event on stay, in front of it only the ones the remaining nodes refer to
+	ASTTokenIndex keepFrom = position.GetTokenIndex();
+	for (auto& it : m_scopes)
+	{
+		if (it.eventTokens != NoToken && it.eventTokens < keepFrom)
+			keepFrom = it.eventTokens;
+	}
+	// compacting costs the size of the token stream, only do it when it at least halves the stream
+	if (keepFrom < m_tokensPinned + 1024 || keepFrom - m_tokensPinned < Tokens.size() / 2)
+		return;
+
+	std::vector<char> keep(Tokens.size(), 0);
+	for (size_t i = keepFrom; i < Tokens.size(); i++)
+		keep[i] = 1;
+	ASTNode* root = m_scopes.front().node;
+	ForEachTokenReference(root,
+		[&](ASTTokenIndex& index) { keep[index] = 1; },
+		[&](ASTType::TokenRange& r) { for (ASTTokenIndex i = r.first; i <= r.second; i++) keep[i] = 1; });
+
+	std::vector<ASTTokenIndex> remap;
+	size_t dropped = RemoveTokens(keep, remap);
+	m_tokensPinned = keepFrom - dropped;
+	if (dropped == 0)
+		return;
+
+	ForEachTokenReference(root,
+		[&](ASTTokenIndex& index) { index = remap[index]; },
+		[&](ASTType::TokenRange& r) { r.first = remap[r.first]; r.second = remap[r.second]; });
+	for (size_t i = 0; i < m_events.Size(); i++)
+	{
+		ASTTokenSpan& span = m_events.Tokens(i);
+		if (!span.empty())
+		{
+			span.begin = remap[span.begin];
+			span.end = remap[span.end - 1] + 1;
+		}
+	}
+	for (auto& it : m_scopes)
+	{
+		if (it.eventTokens != NoToken)
+			it.eventTokens = remap[it.eventTokens];
+	}
+	position.Position = remap[position.Position];
 }
 
 bool ASTCxxParser::ParseRootParticle(ASTNode* parent, ASTPosition& position)
@@ -200,7 +405,7 @@ int ASTCxxParser::ParseClassParticle(int privatePublicProtected, ASTPosition &po
 			currentScope->SetType(ASTNode::Type::Public);
 		if (privatePublicProtected == 2)
 			currentScope->SetType(ASTNode::Type::Protected);
-		currentScope->data.push_back("subsequent");
+		currentScope->AddData("subsequent");
 		subNode->AddNode(currentScope);
 	}
 	else if (ParseExtensionAnnotation(currentScope, position)) {}
@@ -220,14 +425,12 @@ int ASTCxxParser::ParseClassParticle(int privatePublicProtected, ASTPosition &po
 		// unknown scope found
 		std::vector<ASTTokenIndex> tokens;
 		ParseSpecificScopeInner(position, tokens, CxxToken::Type::LBrace, CxxToken::Type::RBrace, ASTPosition::FilterNone);
-		if (Verbose)
-			fprintf(stderr, "[PARSER] discarding unknown scope in class/struct: %s", CombineTokens(this, tokens, "").c_str());
+		LOG_DEBUG(LogCategory::Parser, "[PARSER] discarding unknown scope in class/struct: %s\n", CombineTokens(this, tokens, "").c_str());
 	}
 	else if (position.GetToken().TokenType == CxxToken::Type::EndOfStream)
 	{
 
-		if (Verbose)
-			fprintf(stderr, "[PARSER] end of stream reached during class parse - something is wrong\n");
+		LOG_DEBUG(LogCategory::Parser, "[PARSER] end of stream reached during class parse - something is wrong\n");
 		return 2; // end of class
 	}
 
@@ -288,7 +491,7 @@ bool ASTCxxParser::ParseClass(ASTNode* parent, ASTPosition& cposition)
 
 	if (position.GetToken().TokenType == CxxToken::Type::Keyword)
 	{
-		subNode->data.push_back(position.GetToken().TokenData);
+		subNode->AddData(position.GetToken().TokenSymbol);
 		position.Increment();
 	}
 
@@ -330,9 +533,15 @@ bool ASTCxxParser::ParseClass(ASTNode* parent, ASTPosition& cposition)
 		return false;
 
 	// add default scope node - class definition will be parsed here
-	initialScopeNode->data.push_back("initial");
+	initialScopeNode->AddData("initial");
 	subNode->AddNode(initialScopeNode.release());
 
+	// the span is completed at the semicolon, the events are dropped again when the instances can not be parsed
+	size_t firstEvent = m_events.Size();
+	ASTTokenSpan span;
+	span.Add(cposition.GetTokenIndex());
+	size_t beginEvent = m_events.Add(ASTEventQueue::Kind::ClassBegin, subNode.get(), this, span);
+
 	position.Increment();
 
 	// in class scope bit fields are allowed, but copy constructors are not.
@@ -364,8 +573,12 @@ bool ASTCxxParser::ParseClass(ASTNode* parent, ASTPosition& cposition)
 			std::unique_ptr<ASTType> subInstance(new ASTType(this));
 			subInstance->SetType(ASTNode::Type::DclSub);
 			if (ParseDeclarationSub(subNodeInstances.get(), position, subInstance.get(), 0, instanceOpts) == false)
+			{
+				m_events.Truncate(firstEvent);
 				return false;
+			}
 
+			m_events.Add(ASTEventQueue::Kind::Declaration, subInstance.get(), this, ASTTokenSpan::Of(subInstance.get()));
 			subNodeInstances->AddNode(subInstance.release());
 
 			// reloop on comma
@@ -385,6 +598,9 @@ bool ASTCxxParser::ParseClass(ASTNode* parent, ASTPosition& cposition)
 	if (position.GetToken().TokenType != CxxToken::Type::Semicolon)
 		throw std::runtime_error("expected semicolon to terminate class definition");
 
+	span.Add(position.GetTokenIndex());
+	m_events.Tokens(beginEvent) = span;
+	m_events.Add(ASTEventQueue::Kind::ClassEnd, subNode.get(), this, span);
 	position.Increment();
 
 	// store subnode
@@ -479,6 +695,8 @@ bool ASTCxxParser::ParseNamespace(ASTNode* parent, ASTPosition& cposition)
 	if (position.GetToken().TokenType != CxxToken::Type::Namespace)
 		return false;
 
+	ASTTokenSpan header;
+	header.Add(position.GetTokenIndex());
 	position.Increment();
 
 
@@ -487,7 +705,7 @@ bool ASTCxxParser::ParseNamespace(ASTNode* parent, ASTPosition& cposition)
 	subNode->SetType(ASTNode::Type::Namespace);
 	if (position.GetToken().TokenType == CxxToken::Type::Keyword)
 	{
-		subNode->data.push_back(position.GetToken().TokenData);
+		subNode->AddData(position.GetToken().TokenSymbol);
 		position.Increment();
 	}
 	else if (position.GetToken().TokenType == CxxToken::Type::LBrace)
@@ -499,30 +717,37 @@ bool ASTCxxParser::ParseNamespace(ASTNode* parent, ASTPosition& cposition)
 		return false; // redundant
 	}
 
-
+	header.Add(position.GetTokenIndex());
 	position.Increment();
 
-	while (true)
-	{
-		// parse inner namespace
-
-		if (ParseEndOfStream(subNode.get(), position))
-			return false; // should not reach end of file
-
-		if (ParseRootParticle(subNode.get(), position))
-			continue;
-
-		if (position.GetToken().TokenType == CxxToken::Type::RBrace)
-			break; // reached namespace end
-
-		// unknown tokens found; skip
-		ParseUnknown(subNode.get(), position);
+	// the namespace is committed now, its particles are streamed to the consumer one at a time
+	ASTNode* ns = subNode.release();
+	parent->AddNode(ns);
+	StreamParticles(header.begin, m_events.Size());
+	StreamScope& outer = m_scopes.back();
+	ResolveAnnotations(outer.node, outer.groupBegin, outer.node->Children().size(), true, 0);
+	m_events.Send(*m_consumer, m_events.Size());
+	outer.eventTokens = NoToken;
+
+	ASTEvent begin = { ns, this, header };
+	ASTEventQueue::Send(*m_consumer, ASTEventQueue::Kind::NamespaceBegin, begin);
+
+	StreamScope scope = { ns, 0, 0, false, NoToken };
+	m_scopes.push_back(scope);
+	bool closed = ParseScope(ns, position, true);
+	SendGroup(m_scopes.back(), ns->Children().size(), m_events.Size());
+	m_scopes.pop_back();
+
+	ASTEvent end = { ns, this, ASTTokenSpan() };
+	if (closed)
+	{
+		end.tokens.Add(position.GetTokenIndex());
+		// skip past final "right brace" (})
+		position.Increment();
 	}
-
-	// skip past final "right brace" (})
-	position.Increment();
-
-	parent->AddNode(subNode.release());
+	else
+		LOG_DEBUG(LogCategory::Parser, "[PARSER] end of stream reached during namespace parse\n");
+	ASTEventQueue::Send(*m_consumer, ASTEventQueue::Kind::NamespaceEnd, end);
 
 	return true;
 
@@ -557,11 +782,11 @@ bool ASTCxxParser::ParseUsing(ASTNode* parent, ASTPosition& cposition)
 	{
 		if (position.GetToken().TokenType == CxxToken::Type::Doublecolon)
 		{
-			subNode->data.push_back(position.GetToken().TokenData);
+			subNode->AddData(position.GetToken().TokenData);
 			position.Increment();
 		}
 
-		subNode->data.push_back(position.GetToken().TokenData);
+		subNode->AddData(position.GetToken().TokenData);
 		position.Increment();
 
 	} while (position.GetToken().TokenType == CxxToken::Type::Doublecolon);
@@ -684,8 +909,7 @@ bool ASTCxxParser::ParsePreprocessor(ASTNode* parent, ASTPosition& position)
 		}
 
 		// print a message
-		if (Verbose)
-			fprintf(stderr, "[PARSER] ignoring preprocessor directive: \"%s\"\n", CombineTokens(this, preprocessorTokens, "").c_str());
+		LOG_DEBUG(LogCategory::Parser, "[PARSER] ignoring preprocessor directive: \"%s\"\n", CombineTokens(this, preprocessorTokens, "").c_str());
 
 		// make sure we are at a non whitespace/comment at the end
 		if (ASTPosition::FilterWhitespaceComments(position.GetToken()) == false)
@@ -702,6 +926,8 @@ bool ASTCxxParser::ParseEnum(ASTNode* parent, ASTPosition& position)
 	if (position.GetToken().TokenType != CxxToken::Type::Enum)
 		return false;
 
+	ASTTokenSpan span;
+	span.Add(position.GetTokenIndex());
 	position.Increment();
 
 	std::unique_ptr<ASTTokenNode> subNode(new ASTTokenNode(this));
@@ -723,13 +949,15 @@ bool ASTCxxParser::ParseEnum(ASTNode* parent, ASTPosition& position)
 	if (position.GetToken().TokenType != CxxToken::Type::LBrace)
 		throw std::runtime_error("expected left brace during enum parse");
 
+	size_t beginEvent = m_events.Add(ASTEventQueue::Kind::EnumBegin, subNode.get(), this, span);
 	position.Increment();
 
 	while (true)
 	{
 		if (ParseEnumDefinition(subNode.get(), position))
 		{
-
+			ASTNode* value = subNode->Children().back();
+			m_events.Add(ASTEventQueue::Kind::EnumValue, value, this, ASTTokenSpan::Of(value));
 		}
 		else if (position.GetToken().TokenType == CxxToken::Type::RBrace)
 			break;
@@ -740,6 +968,10 @@ bool ASTCxxParser::ParseEnum(ASTNode* parent, ASTPosition& position)
 	if (position.GetNextToken().TokenType != CxxToken::Type::Semicolon)
 		throw std::runtime_error("expected semicolon after enum closing brace");
 
+	span.Add(position.GetTokenIndex());
+	m_events.Tokens(beginEvent) = span;
+	m_events.Add(ASTEventQueue::Kind::EnumEnd, subNode.get(), this, span);
+
 	position.Increment();
 
 	// store subnode
@@ -768,7 +1000,7 @@ bool ASTCxxParser::ParseEnumDefinition(ASTNode* parent, ASTPosition& position)
 		std::unique_ptr < ASTDataNode> subSubNode(new ASTDataNode());
 		subSubNode->SetType(ASTNode::Type::Init);
 
-		subSubNode->data.push_back(CombineWhile_ScopeAware(position, [](ASTPosition& position) { return position.GetToken().TokenType != CxxToken::Type::Comma && position.GetToken().TokenType != CxxToken::Type::RBrace && position.GetToken().TokenType != CxxToken::Type::Semicolon; }, &ASTCxxParser::ASTPosition::FilterComments));
+		subSubNode->AddData(CombineWhile_ScopeAware(position, [](ASTPosition& position) { return position.GetToken().TokenType != CxxToken::Type::Comma && position.GetToken().TokenType != CxxToken::Type::RBrace && position.GetToken().TokenType != CxxToken::Type::Semicolon; }, &ASTCxxParser::ASTPosition::FilterComments));
 		subNode->AddNode(subSubNode.release());
 	}
 	// store subnode
@@ -789,8 +1021,7 @@ bool ASTCxxParser::ParseIgnored(ASTNode* parent, ASTPosition& position)
 
 bool ASTCxxParser::ParseUnknown(ASTNode* parent, ASTPosition& position)
 {
-	if (Verbose)
-		fprintf(stderr, "[PARSER] no grammar match for token: %d (type: %d, line: %d): %s\n", static_cast<int>(position.Position), position.GetToken().TokenType, static_cast<int>(position.GetToken().TokenLine), position.GetToken().TokenData.c_str());
+	LOG_DEBUG(LogCategory::Parser, "[PARSER] no grammar match for token: %d (type: %d, line: %d): %s\n", static_cast<int>(position.Position), position.GetToken().TokenType, static_cast<int>(position.GetToken().TokenLine), position.GetToken().TokenData.c_str());
 	position.Increment();
 	return false;
 }
@@ -838,11 +1069,11 @@ bool ASTCxxParser::ParseClassInheritance(int &inheritancePublicPrivateProtected,
 	// create subnode
 	subNode->SetType(ASTNode::Type::Inherit);
 	if (inheritancePublicPrivateProtected == 0)
-		subNode->data.push_back("public");
+		subNode->AddData("public");
 	else if (inheritancePublicPrivateProtected == 1)
-		subNode->data.push_back("private");
+		subNode->AddData("private");
 	else if (inheritancePublicPrivateProtected == 2)
-		subNode->data.push_back("protected");
+		subNode->AddData("protected");
 
 
 	parent->AddNode(subNode.release());
@@ -936,7 +1167,7 @@ bool ASTCxxParser::ParseDeclarationHead(ASTNode* parent, ASTPosition& cposition,
 	if (ParseNTypeBase(position, &tempType) == false)
 	{
 		// only take modifiers - head identifier/type must be incorrect
-		std::vector<std::pair<ASTTokenIndex, ASTTokenIndex> > modifierTokens;
+		ASTType::ModifierList modifierTokens;
 		while (ParseModifierToken(cposition, modifierTokens)) { modifierTokens.clear(); }
 		type->typeModifiers = tempType.typeModifiers;
 
@@ -1042,7 +1273,7 @@ bool ASTCxxParser::ParseDeclarationSub(ASTNode* parent, ASTPosition& cposition,
 	if (parsedArguments)
 	{
 		// parse function modifiers if present
-		std::vector<std::pair<ASTTokenIndex, ASTTokenIndex> > funcModifiers;
+		ASTType::ModifierList funcModifiers;
 		while (ParseModifierToken(position, funcModifiers)) {}
 
 		if (funcModifiers.size() > 0)
@@ -1188,6 +1419,11 @@ bool ASTCxxParser::ParseDeclaration(ASTNode* parent, ASTPosition& cposition, AST
 
 	// push to list
 	headType->SetType(ASTNode::Type::DclHead);
+	for (auto it : headType->Children())
+	{
+		if (it->GetType() == ASTNode::Type::DclSub)
+			m_events.Add(ASTEventQueue::Kind::Declaration, it, this, ASTTokenSpan::Of(it));
+	}
 	parent->AddNode(headType.release());
 	cposition = position;
 	return true;
@@ -1217,7 +1453,7 @@ bool ASTCxxParser::_ParseDeclaration_HeadSubs(ASTPosition &position, ASTNode* pa
 			if (subCount == 0)
 			{
 				// skip modifier tokens for sub parsing
-				std::vector<std::pair<ASTTokenIndex, ASTTokenIndex>> dummy;
+				ASTType::ModifierList dummy;
 				while (ParseModifierToken(beforeHeadPosition, dummy)) dummy.clear();
 			}
 
@@ -1335,7 +1571,7 @@ bool ASTCxxParser::ParseOperatorType(ASTNode* parent, ASTPosition& cposition, st
 
 }
 
-bool ASTCxxParser::ParseModifierToken(ASTPosition& cposition, std::vector<std::pair<ASTTokenIndex, ASTTokenIndex>>& modifierTokens)
+bool ASTCxxParser::ParseModifierToken(ASTPosition& cposition, ASTType::ModifierList& modifierTokens)
 {
 	ASTPosition position = cposition;
 	switch (position.GetToken().TokenType)
@@ -1382,8 +1618,8 @@ bool ASTCxxParser::ParseModifierToken(ASTPosition& cposition, std::vector<std::p
 
 bool ASTCxxParser::ParseNTypeBase(ASTPosition &position, ASTType* typeNode)
 {
-	std::vector<ASTType::ASTTokenIndexTemplated>& typeTokens = typeNode->typeName;
-	std::vector<std::pair<ASTTokenIndex, ASTTokenIndex> >& modifierTokens = typeNode->typeModifiers;
+	auto& typeTokens = typeNode->typeName;
+	auto& modifierTokens = typeNode->typeModifiers;
 	size_t typeWordIndex = -1;
 	while (true)
 	{
@@ -1524,8 +1760,8 @@ bool ASTCxxParser::ParseNTypeArrayDefinitions(ASTPosition &position, ASTType* ty
 		hasArray = true;
 
 		// add array tokens to array by pushing a new vector and swapping.
-		typeNode->typeArrayTokens.push_back(std::vector<ASTTokenIndex>());
-		typeNode->typeArrayTokens.back().swap(arrayTokens);
+		typeNode->typeArrayTokens.push_back(std::move(arrayTokens));
+		arrayTokens.clear();
 
 		// go to next token (advance past RBracket )
 		position.Increment();
@@ -1580,7 +1816,7 @@ bool ASTCxxParser::ParseNTypeFunctionPointer(ASTPosition &cposition, ASTType* ty
 bool ASTCxxParser::ParseNTypeIdentifier(ASTPosition &cposition, ASTType* typeNode)
 {
 	ASTPosition position = cposition;
-	std::vector<ASTTokenIndex> tokenIdent;
+	SmallVector<ASTTokenIndex, 4> tokenIdent;
 
 	// parse namespaces
 	while (true)
@@ -1601,7 +1837,7 @@ bool ASTCxxParser::ParseNTypeIdentifier(ASTPosition &cposition, ASTType* typeNod
 			if (ParseOperatorType(nullptr, position, operatorTokens) == false)
 				return false;
 
-			typeNode->typeOperatorTokens = operatorTokens;
+			typeNode->typeOperatorTokens.assign(operatorTokens.begin(), operatorTokens.end());
 			typeNode->typeIdentifier.insert(typeNode->typeIdentifier.end(), tokenIdent.begin(), tokenIdent.end());
 			cposition = position;
 			return true;
@@ -1762,7 +1998,7 @@ void ASTCxxParser::ParseBOM(ASTPosition &position)
 	// check for byte order marks
 	if (position.GetToken().TokenType == CxxToken::Type::BOM_UTF8)
 	{
-		fprintf(stderr, "[PARSER] File contains UTF-8 byte order mark.\n");
+		LOG_INFO(LogCategory::Parser, "[PARSER] File contains UTF-8 byte order mark.\n");
 		IsUTF8 = true;
 		position.Increment();
 	}
@@ -1802,6 +2038,7 @@ bool ASTCxxParser::ParseConstructorArguments(ASTNode* parent, ASTPosition &posit
 bool ASTCxxParser::ParseExtensionAnnotation(ASTNode* parent, ASTPosition& cposition)
 {
 	ASTPosition position = cposition;
+	size_t firstAnnotation = parent->Children().size();
 	auto annotationType = position.GetToken().TokenType;
 	if (annotationType == CxxToken::Type::AnnotationForwardStart || annotationType == CxxToken::Type::AnnotationBackStart)
 	{
@@ -1839,10 +2076,197 @@ bool ASTCxxParser::ParseExtensionAnnotation(ASTNode* parent, ASTPosition& cposit
 	else
 		return false;
 
+	for (size_t i = firstAnnotation; i < parent->Children().size(); i++)
+		m_events.Add(ASTEventQueue::Kind::Annotation, parent->Children()[i], this, ASTTokenSpan::Of(parent->Children()[i]));
 	cposition = position;
 	return true;
 }
 
+bool ASTCxxParser::IsAnnotationPassThrough(ASTNode::Type type)
+{
+	// children of these nodes share the annotations of the node
+	switch (type)
+	{
+		case ASTNode::Type::Typedef:
+		case ASTNode::Type::TypedefHead:
+		case ASTNode::Type::Template:
+		case ASTNode::Type::TemplateContent:
+		case ASTNode::Type::DclHead:
+			return true;
+		default:
+			return false;
+	}
+}
+
+void ASTCxxParser::ResolveAnnotations(ASTNode* parent)
+{
+	std::vector<IndexedAnnotation> index;
+	Annotations.Clear();
+	ResolveAnnotations(parent, 0, parent->Children().size(), false, &index);
+	for (auto& it : index)
+		Annotations.Add(it.node, it.annotation);
+}
+
+void ASTCxxParser::ResolveAnnotations(ASTNode* scope, size_t first, size_t end, bool streamed, std::vector<IndexedAnnotation>* index)
+{
+	std::vector<PendingAnnotations> pending;
+	std::vector<ASTNode*> storage;
+	ResolveAnnotationsInner(scope, first, end, streamed, AnnotationRange(), storage, pending);
+
+	// every node gets a copy of its range, the storage is only needed while resolving
+	for (auto& it : pending)
+	{
+		it.node->SetAnnotations(storage.data() + it.offset, it.count);
+
+		// only index the declarations themselves, not the nodes that pass their annotations on
+		if (!index || IsAnnotationPassThrough(it.node->GetType()) || it.node->GetType() == ASTNode::Type::TemplateArgs)
+			continue;
+		ASTNode* particle = it.node;
+		while (particle->GetParent() != scope)
+			particle = particle->GetParent();
+		size_t particleIndex = std::find(scope->Children().begin() + first, scope->Children().begin() + end, particle) - scope->Children().begin();
+		for (auto itAnnotation : it.node->Annotations())
+		{
+			IndexedAnnotation entry = { particleIndex, it.node, static_cast<ASTTokenNode*>(itAnnotation) };
+			index->push_back(entry);
+		}
+	}
+}
+
+void ASTCxxParser::ResolveAnnotationsInner(ASTNode* node, size_t first, size_t end, bool streamed, const AnnotationRange& inherited, std::vector<ASTNode*>& storage, std::vector<PendingAnnotations>& pending)
+{
+	bool passThrough = IsAnnotationPassThrough(node->GetType());
+
+	auto& children = node->Children();
+	for (size_t i = first; i < end; i++)
+	{
+		ASTNode* child = children[i];
+		if (child->GetType() == ASTNode::Type::AntFwd || child->GetType() == ASTNode::Type::AntBack)
+			continue;
+
+		AnnotationRange range;
+		range.offset = storage.size();
+
+		// forward annotations: enclosing ones first, then the ones directly in front of the node
+		if (passThrough)
+		{
+			for (size_t j = 0; j < inherited.forwardCount; j++)
+			{
+				ASTNode* annotation = storage[inherited.offset + j];
+				storage.push_back(annotation);
+			}
+		}
+		size_t firstAnnotation = i;
+		while (firstAnnotation > first && children[firstAnnotation - 1]->GetType() == ASTNode::Type::AntFwd)
+			firstAnnotation--;
+		for (size_t j = firstAnnotation; j < i; j++)
+			storage.push_back(children[j]);
+		range.forwardCount = storage.size() - range.offset;
+
+		// back annotations: the ones directly after the node, then enclosing ones
+		for (size_t j = i + 1; j < end && children[j]->GetType() == ASTNode::Type::AntBack; j++)
+			storage.push_back(children[j]);
+		if (passThrough)
+		{
+			for (size_t j = inherited.forwardCount; j < inherited.count; j++)
+			{
+				ASTNode* annotation = storage[inherited.offset + j];
+				storage.push_back(annotation);
+			}
+		}
+		range.count = storage.size() - range.offset;
+
+		if (range.count > 0)
+		{
+			PendingAnnotations p = { child, range.offset, range.count };
+			pending.push_back(p);
+		}
+		// the particles of a streamed namespace were resolved before they were handed over
+		if (streamed && child->GetType() == ASTNode::Type::Namespace)
+			continue;
+		ResolveAnnotationsInner(child, 0, child->Children().size(), streamed, range, storage, pending);
+	}
+}
+
+template <class I, class R> void ASTCxxParser::ForEachTokenReference(ASTNode* node, const I& index, const R& range)
+{
+	ASTTokenNode* tokenNode = dynamic_cast<ASTTokenNode*>(node);
+	if (tokenNode && tokenNode->tokenSource == this)
+	{
+		for (auto& it : tokenNode->Tokens)
+			index(it);
+	}
+
+	ASTType* type = dynamic_cast<ASTType*>(node);
+	if (type && type->tokenSource == this)
+	{
+		for (auto& it : type->typeName)
+			index(it.Index);
+		for (auto& it : type->typeIdentifier)
+			index(it);
+		for (auto& it : type->typeModifiers)
+			range(it);
+		for (auto& it : type->typeOperatorTokens)
+			index(it);
+		for (auto& it : type->typeBitfieldTokens)
+			index(it);
+		for (auto& it : type->typeArrayTokens)
+		{
+			for (auto& it2 : it)
+				index(it2);
+		}
+	}
+
+	for (auto it : node->Children())
+		ForEachTokenReference(it, index, range);
+}
+
+size_t ASTCxxParser::RemoveTokens(const std::vector<char>& keep, std::vector<ASTTokenIndex>& remap)
+{
+	remap.assign(Tokens.size(), 0);
+	size_t count = 0;
+	for (size_t i = 0; i < Tokens.size(); i++)
+	{
+		if (!keep[i])
+			continue;
+		remap[i] = count;
+		if (i != count)
+			Tokens[count] = std::move(Tokens[i]);
+		count++;
+	}
+	size_t dropped = Tokens.size() - count;
+	Tokens.resize(count);
+	return dropped;
+}
+
+size_t ASTCxxParser::CompactTokens(ASTNode* parent, bool keepComments)
+{
+	// mark the referenced tokens, a range keeps everything in between since it is printed as a whole
+	std::vector<char> keep(Tokens.size(), 0);
+	ForEachTokenReference(parent,
+		[&](ASTTokenIndex& index) { keep[index] = 1; },
+		[&](ASTType::TokenRange& r) { for (ASTTokenIndex i = r.first; i <= r.second; i++) keep[i] = 1; });
+	if (keepComments)
+	{
+		for (size_t i = 0; i < Tokens.size(); i++)
+		{
+			if (Tokens[i].TokenType == CxxToken::Type::CommentSingleLine || Tokens[i].TokenType == CxxToken::Type::CommentMultiLine)
+				keep[i] = 1;
+		}
+	}
+
+	std::vector<ASTTokenIndex> remap;
+	size_t dropped = RemoveTokens(keep, remap);
+	if (dropped == 0)
+		return 0;
+	Tokens.shrink_to_fit();
+
+	ForEachTokenReference(parent,
+		[&](ASTTokenIndex& index) { index = remap[index]; },
+		[&](ASTType::TokenRange& r) { r.first = remap[r.first]; r.second = remap[r.second]; });
+	return dropped;
+}
+
 bool ASTCxxParser::ParseExtensionAnnotationContent(ASTTokenNode* ndAnnotationRoot, ASTPosition &cposition)
 {
 	ASTPosition position = cposition;
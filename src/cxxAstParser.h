@@ -4,6 +4,8 @@
 #include "cxxTokenizer.h"
 #include <memory>
 #include "ast.h"
+#include "annotationIndex.h"
+#include "astEvents.h"
 
 struct ASTDeclarationParsingOptions
 {
@@ -40,16 +42,70 @@ public:
 
 	ASTCxxParser() {}
 	ASTCxxParser(CxxTokenizer& fromTokenizer);
+	// takes the tokens from the tokenizer while parsing, one particle of the file or of a namespace at a time, for sources that are still
+	// being written (stdin, named pipes) and for parsing with events. The tokenizer has to stay valid until Parse() returns.
+	ASTCxxParser(CxxTokenizer& fromTokenizer, bool incremental);
 	virtual const char* SourceIdentifier() { return m_source.c_str(); }
 	
-	bool Verbose = false;
 	bool IsUTF8 = false;
 
 	ASTNode ForwardAnnotationStack;
+	// annotations of this file by name, filled as the consumer takes the particles they belong to
+	AnnotationIndex Annotations;
 
+	// builds the full AST below parent, the particles are attached by an ASTTreeBuilder
 	bool Parse(ASTNode* parent, ASTPosition& position);
+	// reports the parsed declarations to the consumer while parsing, see ASTEventConsumer.
+	// The particles stay below parent until they are handed to the consumer.
+	bool Parse(ASTNode* parent, ASTEventConsumer& consumer, ASTPosition& position);
+	// Drops the tokens no node below parent refers to (whitespace, comments, skipped bodies) and remaps the token indices of the nodes.
+	// Call when parsing is done, positions into the old token stream are invalid afterwards. Returns the number of dropped tokens.
+	size_t CompactTokens(ASTNode* parent, bool keepComments);
 protected:
+	friend class ASTSerializer;
 	std::string m_source;
+	// tokenizer of an incremental parser, until it reached the end of the stream
+	CxxTokenizer* m_tokenizer = 0;
+	int m_lineNumber = 1;
+	// appends the next token, false once the end of stream token was added
+	bool TokenizeNext(CxxTokenizer& tokenizer);
+	// tokenizes until the particle at position is complete (a ';' or preprocessor line outside of any scope, the '{' of a namespace
+	// or the '}' that closes it), plus the next significant token
+	void TokenizeParticle(ASTPosition& position);
+
+	// the file or a namespace while its particles are streamed to the consumer. The children from groupBegin on are not
+	// handed over yet, they form a group: a declaration with the forward annotations in front of it and the back annotations after it.
+	struct StreamScope
+	{
+		ASTNode* node;
+		size_t groupBegin;
+		size_t classified;				// children that were assigned to a group
+		bool groupHasDeclaration;
+		ASTTokenIndex eventTokens;		// first token the unsent events of the scope can refer to, NoToken if there are none
+	};
+	static const ASTTokenIndex NoToken = static_cast<ASTTokenIndex>(-1);
+	// an entry for the annotation index, added once the particle it belongs to is taken by the consumer
+	struct IndexedAnnotation { size_t particle; ASTNode* node; ASTTokenNode* annotation; };
+
+	ASTEventConsumer* m_consumer = 0;
+	ASTEventQueue m_events;
+	std::vector<StreamScope> m_scopes;
+	// once the consumer took a particle the tokens have to stay, its nodes refer to them
+	bool m_particlesTaken = false;
+	// tokens in front of the streamed particles that are still referred to, they are not dropped
+	size_t m_tokensPinned = 0;
+
+	// parses the particles of the file or of a namespace, returns true at the closing brace of a namespace and false at the end of the stream
+	bool ParseScope(ASTNode* scope, ASTPosition& position, bool isNamespace);
+	// assigns the particles a step added to the innermost scope to a group, start is the first token and events the first event of the step
+	void StreamParticles(ASTTokenIndex start, size_t events);
+	// resolves the annotations of the children [groupBegin, end), sends the first events and hands the children to the consumer
+	void SendGroup(StreamScope& scope, size_t end, size_t events);
+	// drops the tokens of the particles the consumer released, while it did not take any
+	void ReleaseStreamedTokens(ASTPosition& position);
+	// moves the tokens that are kept to the front, remap receives their new indices. Returns the number of dropped tokens.
+	size_t RemoveTokens(const std::vector<char>& keep, std::vector<ASTTokenIndex>& remap);
+
 	bool ParseRootParticle(ASTNode* parent, ASTPosition& position);
 	void ParseBOM(ASTPosition &position);
 
@@ -77,7 +133,7 @@ protected:
 
 	bool ParseConstructorArguments(ASTNode* argNode, ASTPosition &position);
 
-	bool ParseModifierToken(ASTPosition& position, std::vector<std::pair<ASTTokenIndex, ASTTokenIndex>>& modifierTokens);
+	bool ParseModifierToken(ASTPosition& position, ASTType::ModifierList& modifierTokens);
 	bool ParseArgumentAttribute(ASTPosition &position, std::pair<ASTTokenIndex, ASTTokenIndex>& outTokenStream);
 
 	bool ParseClassConstructorDestructor(ASTNode* parent, ASTPosition &position);
@@ -100,4 +156,18 @@ protected:
 
 	bool ParseExtensionAnnotation(ASTNode* parent, ASTPosition& cposition);
 	bool ParseExtensionAnnotationContent(ASTTokenNode* ndAnnotationRoot, ASTPosition &position);
+
+	// while resolving, the annotations of a node are collected as [forward part][back part] in one storage vector,
+	// every node then gets its own copy (ASTNode::Annotations())
+	struct AnnotationRange { size_t offset = 0; size_t forwardCount = 0; size_t count = 0; };
+	struct PendingAnnotations { ASTNode* node; size_t offset; size_t count; };
+	static bool IsAnnotationPassThrough(ASTNode::Type type);
+	// resolves the whole tree below parent and rebuilds the annotation index
+	void ResolveAnnotations(ASTNode* parent);
+	// resolves the children [first, end) of scope. Streamed namespaces below them are skipped, their particles were resolved before they were handed over.
+	void ResolveAnnotations(ASTNode* scope, size_t first, size_t end, bool streamed, std::vector<IndexedAnnotation>* index);
+	void ResolveAnnotationsInner(ASTNode* node, size_t first, size_t end, bool streamed, const AnnotationRange& inherited, std::vector<ASTNode*>& storage, std::vector<PendingAnnotations>& pending);
+
+	// calls index(ASTTokenIndex&) for every token index a node of this parser stores, and range(TokenRange&) for the inclusive ranges
+	template <class I, class R> void ForEachTokenReference(ASTNode* node, const I& index, const R& range);
 };
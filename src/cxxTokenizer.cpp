@@ -1,7 +1,14 @@
 #include "cxxTokenizer.h"
 #include <stdexcept>
 #include <map>
+#include <algorithm>
 #include "tools.h"
+#ifdef _WIN32
+#include <io.h>
+#else
+#include <unistd.h>
+#include <errno.h>
+#endif
 
 CxxToken CxxTokenizer::PeekNextToken(size_t& offset)
 {
@@ -216,6 +223,7 @@ CxxToken CxxTokenizer::PeekNextToken(size_t& offset)
 		}
 
 		ConvertToSpecializedKeyword(token);
+		token.TokenSymbol = SymbolTable::Global().Intern(token.TokenData);
 	}
 	else if((token.TokenData.at(0) >= '0' && token.TokenData.at(0) <= '9') )
 	{
@@ -388,11 +396,11 @@ CxxToken CxxTokenizer::GetNextToken()
 
 
 
-CxxTokenizer::Data CxxStringTokenizer::PeekBytes(size_t numBytes, size_t offset)
+CxxTokenizer::Data CxxBufferTokenizer::PeekBytes(size_t numBytes, size_t offset)
 {
 	size_t noffset = m_offset + offset;
-	if(noffset + numBytes > Source.size())
-		numBytes = Source.size() - noffset;
+	if(noffset + numBytes > m_length)
+		numBytes = m_length - noffset;
 
 	if (numBytes <= 0)
 	{
@@ -401,19 +409,72 @@ CxxTokenizer::Data CxxStringTokenizer::PeekBytes(size_t numBytes, size_t offset)
 	}
 	else
 	{
-		Data dt = { Source.c_str() + noffset, (size_t)numBytes};
+		Data dt = { m_data + noffset, (size_t)numBytes};
 		return dt;
 	}
 }
 
-size_t CxxStringTokenizer::Advance( size_t numBytes )
+size_t CxxBufferTokenizer::Advance( size_t numBytes )
 {
-	if(m_offset + numBytes > Source.size())
-		numBytes = Source.size() - m_offset;
+	if(m_offset + numBytes > m_length)
+		numBytes = m_length - m_offset;
 	m_offset += numBytes;
 	return numBytes;
 }
 
+CxxTokenizer::Data CxxStreamTokenizer::PeekBytes(size_t numBytes, size_t offset)
+{
+	size_t begin = m_consumed + offset;
+	while (m_buffer.size() < begin + numBytes && ReadChunk()) {}
+	if (begin >= m_buffer.size())
+	{
+		Data dt = { "", 0 };
+		return dt;
+	}
+	Data dt = { m_buffer.data() + begin, std::min(numBytes, m_buffer.size() - begin) };
+	return dt;
+}
+
+size_t CxxStreamTokenizer::Advance(size_t numBytes)
+{
+	numBytes = std::min(numBytes, m_buffer.size() - m_consumed);
+	m_consumed += numBytes;
+	m_offset += numBytes;
+
+	// drop the tokenized bytes once they are the larger part of the buffer
+	if (m_consumed >= 65536 && m_consumed * 2 >= m_buffer.size())
+	{
+		m_buffer.erase(0, m_consumed);
+		m_consumed = 0;
+	}
+	return numBytes;
+}
+
+bool CxxStreamTokenizer::ReadChunk()
+{
+	if (m_end)
+		return false;
+
+	char chunk[65536];
+	for (;;)
+	{
+#ifdef _WIN32
+		int length = _read(m_fd, chunk, sizeof(chunk));
+#else
+		ssize_t length = read(m_fd, chunk, sizeof(chunk));
+		if (length < 0 && errno == EINTR)
+			continue;
+#endif
+		if (length <= 0)
+		{
+			m_end = true;
+			return false;
+		}
+		m_buffer.append(chunk, (size_t)length);
+		return true;
+	}
+}
+
 void CxxTokenizer::Debug()
 {
 	CxxToken nextToken;
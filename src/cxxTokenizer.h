@@ -6,6 +6,7 @@
 
 #include <string>
 #include <string.h>
+#include "symbols.h"
 
 struct CxxToken
 {
@@ -94,11 +95,12 @@ struct CxxToken
 		EndOfStream, // <EOF>
 		BOM_UTF8, // 0xEF,0xBB,0xBF
 	};
-	CxxToken(): TokenType(Type::Init) {}
+	CxxToken(): TokenType(Type::Init), TokenSymbol(SymbolTable::Empty) {}
 
 	Type TokenType;
 	std::string TokenData;
 	std::string TokenParsedData;
+	SymbolId TokenSymbol; // interned spelling of identifier/keyword tokens
 	int TokenLine;
 	size_t TokenByteOffset;
 
@@ -147,14 +149,42 @@ protected:
 	
 };
 
-class CxxStringTokenizer: public CxxTokenizer
+// Tokenizes memory owned by the caller, it has to stay valid while tokenizing (the tokens copy their text).
+class CxxBufferTokenizer: public CxxTokenizer
 {
 public:
-	CxxStringTokenizer(std::string ident, std::string data) { Identifier = ident; Source = data; }
+	CxxBufferTokenizer(std::string ident, const char* data, size_t length) : m_data(data), m_length(length) { Identifier = ident; }
 protected:
 	virtual CxxTokenizer::Data PeekBytes(size_t numBytes, size_t offset = 0);
 	virtual size_t Advance(size_t numBytes);
 
+	const char* m_data;
+	size_t m_length;
+};
+
+class CxxStringTokenizer: public CxxBufferTokenizer
+{
+public:
+	CxxStringTokenizer(std::string ident, std::string data) : CxxBufferTokenizer(ident, 0, 0), Source(std::move(data)) { m_data = Source.c_str(); m_length = Source.size(); }
+protected:
 	std::string Source;
 	
 };
+
+// Tokenizes a file descriptor (stdin, a named pipe) while it is still being written: bytes are read in chunks when the
+// tokenizer needs them, and the ones before the current token are released.
+class CxxStreamTokenizer: public CxxTokenizer
+{
+public:
+	CxxStreamTokenizer(std::string ident, int fd) : m_fd(fd) { Identifier = ident; }
+protected:
+	virtual CxxTokenizer::Data PeekBytes(size_t numBytes, size_t offset = 0);
+	virtual size_t Advance(size_t numBytes);
+	// false at the end of the stream
+	bool ReadChunk();
+
+	int m_fd;
+	std::string m_buffer;
+	size_t m_consumed = 0;	// bytes at the front of m_buffer the tokenizer advanced over
+	bool m_end = false;
+};
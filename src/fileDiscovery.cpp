@@ -0,0 +1,344 @@
+#include "fileDiscovery.h"
+#include "tools.h"
+#include "log.h"
+#include <algorithm>
+#include <chrono>
+#include <functional>
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <dirent.h>
+#endif
+#ifdef __linux__
+#include <sys/syscall.h>
+#endif
+
+static FileDiscovery* gFileDiscovery = 0;
+
+FileDiscovery* FileDiscovery::Current()
+{
+	return gFileDiscovery;
+}
+
+void FileDiscovery::SetCurrent(FileDiscovery* discovery)
+{
+	gFileDiscovery = discovery;
+}
+
+void FileDiscovery::Complete(tools::CommandLineParser& opts)
+{
+	FileDiscovery* discovery = Current();
+	if (!discovery)
+		return;
+	SetCurrent(0);
+	std::vector<std::string> names = discovery->Finish();
+	opts.names.insert(opts.names.end(), names.begin(), names.end());
+}
+
+bool FileDiscovery::IsPattern(const std::string& argument)
+{
+	return argument.find_first_of("*?") != std::string::npos || (argument.size() > 1 && argument[0] == '@');
+}
+
+FileDiscovery::FileDiscovery(const std::vector<std::string>& arguments, TaskScheduler& scheduler) : m_scheduler(scheduler), m_found((size_t)-1), m_group(scheduler)
+{
+	m_start = std::chrono::steady_clock::now();
+	for (auto& it : arguments)
+		Expand(it, 0);
+	WalkDone();
+}
+
+FileDiscovery::~FileDiscovery()
+{
+	WaitForWalk();
+}
+
+bool FileDiscovery::Next(std::string& name)
+{
+	if (m_scheduler.Jobs() == 1)
+		WaitForWalk();
+	return m_found.Pop(name);
+}
+
+std::vector<std::string> FileDiscovery::Finish()
+{
+	WaitForWalk();
+
+	std::vector<std::string> ret;
+	std::unordered_set<std::string> seen;
+	for (auto& it : m_slots)
+	{
+		if (it.pattern)
+			std::sort(it.files.begin(), it.files.end());
+		for (auto& it2 : it.files)
+		{
+			if (seen.insert(it2).second)
+				ret.push_back(it2);
+		}
+	}
+	return ret;
+}
+
+void FileDiscovery::Run(const std::function<void()>& task)
+{
+	m_walking++;
+	m_group.Run([this, task]()
+	{
+		try
+		{
+			task();
+		}
+		catch (const std::exception& e)
+		{
+			LOG_WARNING(LogCategory::Wildcard, "Warning: File discovery failed: %s\n", e.what());
+		}
+		catch (...)
+		{
+			LOG_WARNING(LogCategory::Wildcard, "Warning: File discovery failed.\n");
+		}
+		// the walk has to end even when a directory failed, Next() waits for it
+		WalkDone();
+	});
+}
+
+void FileDiscovery::WalkDone()
+{
+	if (--m_walking > 0)
+		return;
+
+	{
+		std::lock_guard<std::mutex> lk(m_lock);
+		LOG_INFO(LogCategory::Wildcard, "[WILDCARD] %d file(s), %d director%s listed, %.2f ms\n", (int)m_handedOut.size(), (int)m_directories, m_directories == 1 ? "y" : "ies",
+			std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - m_start).count());
+	}
+	m_found.Close();
+}
+
+void FileDiscovery::WaitForWalk()
+{
+	// the tasks catch their own errors, Wait() does not throw
+	m_group.Wait();
+}
+
+FileDiscovery::Slot* FileDiscovery::AddSlot()
+{
+	m_slots.emplace_back();
+	return &m_slots.back();
+}
+
+void FileDiscovery::Expand(const std::string& argument, int depth)
+{
+	if (argument.size() > 1 && argument[0] == '@')
+	{
+		if (depth >= 8)
+		{
+			LOG_WARNING(LogCategory::Wildcard, "Warning: Response files nested too deep at \"%s\".\n", argument.c_str());
+			return;
+		}
+		std::ifstream ifs(argument.substr(1), std::ios::binary);
+		if (!ifs)
+		{
+			LOG_WARNING(LogCategory::Wildcard, "Warning: Could not read response file \"%s\".\n", argument.c_str() + 1);
+			return;
+		}
+		std::string line;
+		while (std::getline(ifs, line))
+		{
+			size_t first = line.find_first_not_of(" \t\r");
+			size_t last = line.find_last_not_of(" \t\r");
+			if (first != std::string::npos)
+				Expand(line.substr(first, last - first + 1), depth + 1);
+		}
+		return;
+	}
+
+	size_t wildcard = argument.find_first_of("*?");
+	if (wildcard == std::string::npos)
+	{
+		// names keep their place in the list, consecutive ones share a slot
+		Slot* slot = m_slots.empty() || m_slots.back().pattern ? AddSlot() : &m_slots.back();
+		Found(slot, argument);
+		return;
+	}
+
+	// the directory in front of the first wildcard is walked, the components behind it are matched one by one
+	Slot* slot = AddSlot();
+	slot->pattern = true;
+	size_t split = argument.find_last_of("/\\", wildcard);
+	if (split != std::string::npos)
+		slot->base = split == 0 ? "/" : argument.substr(0, split);
+	for (size_t begin = split == std::string::npos ? 0 : split + 1; begin <= argument.size(); )
+	{
+		size_t end = std::min(argument.find_first_of("/\\", begin), argument.size());
+		std::string segment = argument.substr(begin, end - begin);
+		begin = end + 1;
+		if (segment.empty())
+			continue;
+		// a component like **.h is ** followed by *.h
+		bool any = segment.find("**") != std::string::npos;
+		for (size_t pos; (pos = segment.find("**")) != std::string::npos; )
+			segment.erase(pos, 1);
+		if (any && (slot->segments.empty() || slot->segments.back() != "**"))
+			slot->segments.push_back("**");
+		if (any && segment == "*")
+			continue;
+		slot->segments.push_back(segment);
+	}
+	if (slot->segments.empty() || slot->segments.back() == "**")
+		slot->segments.push_back("*");
+
+	std::string base = slot->base;
+	Run([this, slot, base]() { ListDirectory(slot, base, 0); });
+}
+
+bool FileDiscovery::ReadDirectory(const std::string& directory, const std::function<void(const char*, bool, bool)>& entry)
+{
+#ifdef _WIN32
+	WIN32_FIND_DATAA ffd;
+	HANDLE hFind = FindFirstFileA((directory.empty() ? std::string("*") : directory + "\\*").c_str(), &ffd);
+	if (hFind == INVALID_HANDLE_VALUE)
+		return false;
+	do
+	{
+		bool isDirectory = (ffd.dwFileAttributes & FILE_ATTRIBUTE_DIRECTORY) != 0 && (ffd.dwFileAttributes & FILE_ATTRIBUTE_REPARSE_POINT) == 0;
+		bool isFile = (ffd.dwFileAttributes & FILE_ATTRIBUTE_DIRECTORY) == 0;
+		entry(ffd.cFileName, isFile, isDirectory);
+	} while (FindNextFileA(hFind, &ffd) != 0);
+	FindClose(hFind);
+	return true;
+#else
+	int fd = open(directory.empty() ? "." : directory.c_str(), O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+	if (fd < 0)
+		return false;
+
+	auto report = [&](const char* name, unsigned char type)
+	{
+		bool isFile = type == DT_REG;
+		bool isDirectory = type == DT_DIR;
+		if (type == DT_UNKNOWN || type == DT_LNK)
+		{
+			struct stat st;
+			if (fstatat(fd, name, &st, 0) == 0)
+			{
+				isFile = S_ISREG(st.st_mode);
+				isDirectory = type == DT_UNKNOWN && S_ISDIR(st.st_mode);
+			}
+		}
+		entry(name, isFile, isDirectory);
+	};
+
+#ifdef __linux__
+	// getdents64 returns a whole buffer of entries per call, without the per entry overhead of readdir
+	struct Dirent64
+	{
+		unsigned long long d_ino;
+		long long d_off;
+		unsigned short d_reclen;
+		unsigned char d_type;
+		char d_name[1];
+	};
+	alignas(8) char buffer[32768];
+	for (;;)
+	{
+		long length = syscall(SYS_getdents64, fd, buffer, sizeof(buffer));
+		if (length <= 0)
+			break;
+		for (long pos = 0; pos < length; )
+		{
+			const Dirent64* it = (const Dirent64*)(buffer + pos);
+			pos += it->d_reclen;
+			report(it->d_name, it->d_type);
+		}
+	}
+	close(fd);
+#else
+	DIR* dir = fdopendir(fd);
+	if (!dir)
+	{
+		close(fd);
+		return false;
+	}
+	while (dirent* it = readdir(dir))
+		report(it->d_name, it->d_type);
+	closedir(dir);
+#endif
+	return true;
+#endif
+}
+
+void FileDiscovery::ListDirectory(Slot* slot, const std::string& directory, size_t segment)
+{
+	// ** stays at its segment for the subdirectories and lets the entries match the segment behind it as well
+	bool any = slot->segments[segment] == "**";
+	size_t match = any ? segment + 1 : segment;
+	bool last = match + 1 == slot->segments.size();
+	std::string prefix = directory.empty() ? std::string() : directory.back() == '/' || directory.back() == '\\' ? directory : directory + "/";
+	bool read = ReadDirectory(directory, [&](const char* name, bool isFile, bool isDirectory)
+	{
+		if (strcmp(name, ".") == 0 || strcmp(name, "..") == 0)
+			return;
+		if (isDirectory && any)
+		{
+			std::string path = prefix + name;
+			Run([this, slot, path, segment]() { ListDirectory(slot, path, segment); });
+		}
+		if (!Match(slot->segments[match].c_str(), name))
+			return;
+		if (last && isFile)
+			Found(slot, prefix + name);
+		else if (!last && isDirectory)
+		{
+			std::string path = prefix + name;
+			Run([this, slot, path, match]() { ListDirectory(slot, path, match + 1); });
+		}
+	});
+	if (!read)
+		LOG_WARNING(LogCategory::Wildcard, "Warning: Could not list directory \"%s\".\n", directory.empty() ? "." : directory.c_str());
+
+	std::lock_guard<std::mutex> lk(m_lock);
+	m_directories++;
+}
+
+void FileDiscovery::Found(Slot* slot, const std::string& name)
+{
+	{
+		std::lock_guard<std::mutex> lk(slot->lock);
+		slot->files.push_back(name);
+	}
+	std::lock_guard<std::mutex> lk(m_lock);
+	if (m_handedOut.insert(name).second)
+		m_found.Push(std::string(name));
+}
+
+bool FileDiscovery::Match(const char* pattern, const char* name)
+{
+	// * matches any run of characters, ? a single one; backtracks to the last *
+	const char* star = 0;
+	const char* starName = 0;
+	while (*name)
+	{
+		if (*pattern == '?' || *pattern == *name)
+		{
+			pattern++;
+			name++;
+		}
+		else if (*pattern == '*')
+		{
+			star = pattern++;
+			starName = name;
+		}
+		else if (star)
+		{
+			pattern = star + 1;
+			name = ++starName;
+		}
+		else
+			return false;
+	}
+	while (*pattern == '*')
+		pattern++;
+	return *pattern == 0;
+}
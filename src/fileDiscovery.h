@@ -0,0 +1,79 @@
+#pragma once
+
+#include <string>
+#include <vector>
+#include <deque>
+#include <mutex>
+#include <atomic>
+#include <chrono>
+#include <functional>
+#include <unordered_set>
+#include "boundedQueue.h"
+#include "taskScheduler.h"
+
+namespace tools { struct CommandLineParser; }
+
+// Expands the file arguments of the wildcard module while the parser already works on the first files:
+//   dir/*.h		files in dir whose name matches (* and ? match within the name)
+//   dir/*/inc/*.h	every path component is matched on its own
+//   dir/**/*.h		** matches any number of directories, none included (dir/**.h is the same pattern)
+//   @list.txt		a response file, one argument per line (names, patterns or response files)
+// The arguments are expanded by the constructor, every directory is listed in a task of the scheduler (getdents64 on Linux),
+// so the walk uses the workers of --jobs and no thread of its own.
+// Files are handed out by Next() in the order they are found, each name once. Finish() returns the complete list in
+// command line order, with the matches of every pattern sorted, so the tree does not depend on the timing of the walk.
+class FileDiscovery
+{
+public:
+	FileDiscovery(const std::vector<std::string>& arguments, TaskScheduler& scheduler);
+	~FileDiscovery();
+
+	// waits for the next file, false when the walk is done and every file was handed out
+	bool Next(std::string& name);
+	// waits for the walk, returns all files
+	std::vector<std::string> Finish();
+
+	// wildcard pattern or response file
+	static bool IsPattern(const std::string& argument);
+	// calls entry(name, isFile, isDirectory) for every entry of the directory ("" is the working directory), linked directories
+	// are not reported as directories (they can form cycles), false when the directory cannot be opened
+	static bool ReadDirectory(const std::string& directory, const std::function<void(const char*, bool, bool)>& entry);
+
+	// discovery of the wildcard module, until a module takes over its files (see IModule::TakesDiscoveredFiles)
+	static FileDiscovery* Current();
+	static void SetCurrent(FileDiscovery* discovery);
+	// waits for the current discovery and appends its files to the names, for modules that need the complete list
+	static void Complete(tools::CommandLineParser& opts);
+
+protected:
+	struct Slot
+	{
+		std::string base;		// directory of a pattern, empty for the working directory
+		std::vector<std::string> segments;	// the path components behind the base, "**" or a name pattern, the last one matches files
+		bool pattern = false;	// the files of a pattern are sorted
+		std::mutex lock;
+		std::vector<std::string> files;
+	};
+
+	// runs a part of the walk on the scheduler, the last one to finish ends the walk
+	void Run(const std::function<void()>& task);
+	void WalkDone();
+	// runs the walk on this thread as well, it must not wait for workers that do not exist
+	void WaitForWalk();
+	void Expand(const std::string& argument, int depth);
+	// matches the entries of the directory against segment index and on
+	void ListDirectory(Slot* slot, const std::string& directory, size_t segment);
+	void Found(Slot* slot, const std::string& name);
+	Slot* AddSlot();
+	static bool Match(const char* pattern, const char* name);
+
+	TaskScheduler& m_scheduler;
+	std::deque<Slot> m_slots;		// in command line order, deque keeps the addresses stable for the tasks
+	std::mutex m_lock;
+	std::unordered_set<std::string> m_handedOut;
+	BoundedQueue<std::string> m_found;
+	size_t m_directories = 0;	// guarded by m_lock
+	std::chrono::steady_clock::time_point m_start;
+	std::atomic<int> m_walking{ 1 };	// unfinished tasks of the walk, plus one until the constructor expanded the arguments
+	TaskScheduler::Group m_group;		// last member, its destructor waits for the tasks that use the others
+};
@@ -0,0 +1,417 @@
+#include "fileLoader.h"
+#include "tools.h"
+#include "log.h"
+#include <atomic>
+#include <thread>
+#include <algorithm>
+#include <string.h>
+
+#ifndef _WIN32
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#define FILELOADER_PREAD 1
+#endif
+
+#if defined(__linux__) && defined(__has_include)
+#if __has_include(<linux/io_uring.h>)
+#include <linux/io_uring.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <errno.h>
+#if defined(STATX_SIZE) && defined(__NR_io_uring_setup)
+#define FILELOADER_IO_URING 1
+#endif
+#endif
+#endif
+
+const char* FileLoader::BackendName(Backend backend)
+{
+	switch (backend)
+	{
+		case Backend::Auto: return "auto";
+		case Backend::IoUring: return "io_uring";
+		case Backend::Pread: return "pread";
+		case Backend::Stream: return "stream";
+		default: return "unknown";
+	}
+}
+
+FileLoader::Backend FileLoader::ParseBackend(const std::string& name)
+{
+	if (name == "io_uring")
+		return Backend::IoUring;
+	if (name == "pread")
+		return Backend::Pread;
+	if (name == "stream")
+		return Backend::Stream;
+	if (name != "auto")
+		LOG_WARNING(LogCategory::Parser, "Warning: unknown io backend \"%s\", using auto.\n", name.c_str());
+	return Backend::Auto;
+}
+
+void FileLoader::Load(const std::vector<std::string>& names, const std::vector<size_t>& order, const Callback& done)
+{
+	size_t loaded = 0;
+	if (m_backend == Backend::Auto || m_backend == Backend::IoUring)
+	{
+		loaded = LoadIoUring(names, order, done);
+		m_used = Backend::IoUring;
+		if (loaded == order.size())
+			return;
+		if (m_backend == Backend::IoUring)
+			LOG_WARNING(LogCategory::Parser, "Warning: io_uring is not available, falling back to pread.\n");
+	}
+
+#ifdef FILELOADER_PREAD
+	if (m_backend != Backend::Stream)
+	{
+		m_used = Backend::Pread;
+		LoadPread(names, order, loaded, done);
+		return;
+	}
+#endif
+
+	m_used = Backend::Stream;
+	LoadStream(names, order, loaded, done);
+}
+
+void FileLoader::LoadStream(const std::vector<std::string>& names, const std::vector<size_t>& order, size_t first, const Callback& done)
+{
+	// the calling thread is one of the readers
+	std::atomic<size_t> next(first);
+	auto read = [&]()
+	{
+		for (size_t i = next++; i < order.size(); i = next++)
+			done(order[i], tools::readFromFile(names[order[i]]));
+	};
+	std::vector<std::thread> threads;
+	for (int t = 1; t < m_threads; t++)
+		threads.push_back(std::thread(read));
+	read();
+	for (auto& it : threads)
+		it.join();
+}
+
+#ifdef FILELOADER_PREAD
+static bool ReadWholeFile(int fd, size_t size, std::string& content)
+{
+	content.resize(size);
+	size_t offset = 0;
+	while (offset < size)
+	{
+		ssize_t n = pread(fd, &content[offset], size - offset, (off_t)offset);
+		if (n < 0)
+			return false;
+		if (n == 0)
+			break; // file shrunk
+		offset += (size_t)n;
+	}
+	content.resize(offset);
+	return true;
+}
+
+// false when the file cannot be opened or read, the content is empty then
+static bool ReadFile(const std::string& name, std::string& content)
+{
+	content.clear();
+	int fd = open(name.c_str(), O_RDONLY | O_CLOEXEC);
+	if (fd < 0)
+		return false;
+	struct stat st;
+	bool read = fstat(fd, &st) == 0 && ReadWholeFile(fd, (size_t)st.st_size, content);
+	close(fd);
+	if (!read)
+		content.clear();
+	return read;
+}
+
+void FileLoader::LoadPread(const std::vector<std::string>& names, const std::vector<size_t>& order, size_t first, const Callback& done)
+{
+	// the calling thread is one of the readers
+	std::atomic<size_t> next(first);
+	auto read = [&]()
+	{
+		for (size_t i = next++; i < order.size(); i = next++)
+		{
+			std::string content;
+			ReadFile(names[order[i]], content);
+			done(order[i], std::move(content));
+		}
+	};
+	std::vector<std::thread> threads;
+	for (int t = 1; t < m_threads; t++)
+		threads.push_back(std::thread(read));
+	read();
+	for (auto& it : threads)
+		it.join();
+}
+#else
+void FileLoader::LoadPread(const std::vector<std::string>& names, const std::vector<size_t>& order, size_t first, const Callback& done)
+{
+	LoadStream(names, order, first, done);
+}
+#endif
+
+#ifdef FILELOADER_IO_URING
+// minimal io_uring ring on top of the raw syscalls, so there is no dependency on liburing
+class FileLoaderRing
+{
+public:
+	~FileLoaderRing()
+	{
+		if (m_sqes)
+			munmap(m_sqes, m_sqesSize);
+		if (m_cqPtr && m_cqPtr != m_sqPtr)
+			munmap(m_cqPtr, m_cqSize);
+		if (m_sqPtr)
+			munmap(m_sqPtr, m_sqSize);
+		if (m_fd >= 0)
+			close(m_fd);
+	}
+
+	bool Setup(unsigned entries)
+	{
+		io_uring_params p;
+		memset(&p, 0, sizeof(p));
+		m_fd = (int)syscall(__NR_io_uring_setup, entries, &p);
+		if (m_fd < 0)
+			return false;
+
+		m_sqSize = p.sq_off.array + p.sq_entries * sizeof(unsigned);
+		m_cqSize = p.cq_off.cqes + p.cq_entries * sizeof(io_uring_cqe);
+		bool singleMap = (p.features & IORING_FEAT_SINGLE_MMAP) != 0;
+		if (singleMap)
+			m_sqSize = m_cqSize = std::max(m_sqSize, m_cqSize);
+
+		m_sqPtr = mmap(0, m_sqSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, m_fd, IORING_OFF_SQ_RING);
+		if (m_sqPtr == MAP_FAILED) { m_sqPtr = 0; return false; }
+		m_cqPtr = singleMap ? m_sqPtr : mmap(0, m_cqSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, m_fd, IORING_OFF_CQ_RING);
+		if (m_cqPtr == MAP_FAILED) { m_cqPtr = 0; return false; }
+		m_sqesSize = p.sq_entries * sizeof(io_uring_sqe);
+		m_sqes = (io_uring_sqe*)mmap(0, m_sqesSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, m_fd, IORING_OFF_SQES);
+		if (m_sqes == MAP_FAILED) { m_sqes = 0; return false; }
+
+		char* sq = (char*)m_sqPtr;
+		m_sqTail = (unsigned*)(sq + p.sq_off.tail);
+		m_sqMask = *(unsigned*)(sq + p.sq_off.ring_mask);
+		m_sqArray = (unsigned*)(sq + p.sq_off.array);
+		char* cq = (char*)m_cqPtr;
+		m_cqHead = (unsigned*)(cq + p.cq_off.head);
+		m_cqTail = (unsigned*)(cq + p.cq_off.tail);
+		m_cqMask = *(unsigned*)(cq + p.cq_off.ring_mask);
+		m_cqes = (io_uring_cqe*)(cq + p.cq_off.cqes);
+		m_entries = p.sq_entries;
+		return true;
+	}
+
+	unsigned Entries() const { return m_entries; }
+
+	// the caller never queues more than Entries() operations before Submit()
+	io_uring_sqe* Next()
+	{
+		unsigned tail = *m_sqTail + m_queued;
+		unsigned index = tail & m_sqMask;
+		io_uring_sqe* sqe = &m_sqes[index];
+		memset(sqe, 0, sizeof(*sqe));
+		m_sqArray[index] = index;
+		m_queued++;
+		return sqe;
+	}
+
+	// submits the queued operations and waits until all of them completed
+	bool SubmitAndWait(const std::function<void(const io_uring_cqe&)>& completed)
+	{
+		unsigned pending = m_queued;
+		__atomic_store_n(m_sqTail, *m_sqTail + m_queued, __ATOMIC_RELEASE);
+		unsigned toSubmit = m_queued;
+		m_queued = 0;
+
+		while (pending > 0)
+		{
+			int ret = (int)syscall(__NR_io_uring_enter, m_fd, toSubmit, 1, IORING_ENTER_GETEVENTS, 0, 0);
+			if (ret < 0)
+			{
+				if (errno == EINTR)
+					continue;
+				return false;
+			}
+			toSubmit -= std::min(toSubmit, (unsigned)ret);
+
+			unsigned head = *m_cqHead;
+			unsigned tail = __atomic_load_n(m_cqTail, __ATOMIC_ACQUIRE);
+			for (; head != tail; head++, pending--)
+				completed(m_cqes[head & m_cqMask]);
+			__atomic_store_n(m_cqHead, head, __ATOMIC_RELEASE);
+		}
+		return true;
+	}
+
+protected:
+	int m_fd = -1;
+	void* m_sqPtr = 0;
+	void* m_cqPtr = 0;
+	size_t m_sqSize = 0, m_cqSize = 0, m_sqesSize = 0;
+	io_uring_sqe* m_sqes = 0;
+	unsigned* m_sqTail = 0;
+	unsigned* m_sqArray = 0;
+	unsigned m_sqMask = 0;
+	unsigned* m_cqHead = 0;
+	unsigned* m_cqTail = 0;
+	unsigned m_cqMask = 0;
+	io_uring_cqe* m_cqes = 0;
+	unsigned m_entries = 0;
+	unsigned m_queued = 0;
+};
+
+size_t FileLoader::LoadIoUring(const std::vector<std::string>& names, const std::vector<size_t>& order, const Callback& done)
+{
+	FileLoaderRing ring;
+	if (!ring.Setup((unsigned)std::max<size_t>(2, m_batchSize * 2)))
+		return 0;
+
+	struct Pending
+	{
+		size_t index;
+		int fd;
+		struct statx st;
+		std::string content;
+		size_t offset;
+		bool sized;		// content has the size of the stat
+		bool complete;	// end of file reached early (the file shrunk)
+		bool failed;
+	};
+	size_t batchSize = ring.Entries() / 2;
+	std::vector<Pending> batch;
+	size_t loaded = 0;
+
+	while (loaded < order.size())
+	{
+		size_t count = std::min(batchSize, order.size() - loaded);
+		batch.resize(count);
+
+		// open and stat the whole batch
+		for (size_t i = 0; i < count; i++)
+		{
+			Pending& file = batch[i];
+			file.index = order[loaded + i];
+			file.fd = -1;
+			file.offset = 0;
+			file.sized = file.complete = file.failed = false;
+			file.content.clear();
+			const char* path = names[file.index].c_str();
+
+			io_uring_sqe* sqe = ring.Next();
+			sqe->opcode = IORING_OP_OPENAT;
+			sqe->fd = AT_FDCWD;
+			sqe->addr = (unsigned long long)(size_t)path;
+			sqe->open_flags = O_RDONLY | O_CLOEXEC;
+			sqe->user_data = i * 2;
+
+			sqe = ring.Next();
+			sqe->opcode = IORING_OP_STATX;
+			sqe->fd = AT_FDCWD;
+			sqe->addr = (unsigned long long)(size_t)path;
+			sqe->len = STATX_SIZE;
+			sqe->off = (unsigned long long)(size_t)&file.st;
+			sqe->user_data = i * 2 + 1;
+		}
+
+		bool unsupported = false;
+		std::vector<char> statOk(count, 0);
+		bool ok = ring.SubmitAndWait([&](const io_uring_cqe& cqe)
+		{
+			size_t i = (size_t)(cqe.user_data / 2);
+			if (cqe.res == -EINVAL || cqe.res == -EOPNOTSUPP)
+				unsupported = true; // kernel without these opcodes
+			else if (cqe.user_data % 2 == 0)
+				batch[i].fd = cqe.res >= 0 ? cqe.res : -1;
+			else
+				statOk[i] = cqe.res >= 0;
+		});
+		if (!ok || unsupported)
+		{
+			for (auto& it : batch)
+			{
+				if (it.fd >= 0)
+					close(it.fd);
+			}
+			return loaded;
+		}
+
+		// read until every file is complete, large files take several rounds
+		while (true)
+		{
+			unsigned queued = 0;
+			for (size_t i = 0; i < count; i++)
+			{
+				Pending& file = batch[i];
+				if (file.fd < 0 || !statOk[i] || file.complete || file.failed)
+					continue;
+				if (!file.sized)
+				{
+					file.content.resize((size_t)file.st.stx_size);
+					file.sized = true;
+				}
+				if (file.offset >= file.content.size())
+					continue;
+
+				io_uring_sqe* sqe = ring.Next();
+				sqe->opcode = IORING_OP_READ;
+				sqe->fd = file.fd;
+				sqe->addr = (unsigned long long)(size_t)&file.content[file.offset];
+				sqe->len = (unsigned)std::min<size_t>(file.content.size() - file.offset, 1u << 30);
+				sqe->off = file.offset;
+				sqe->user_data = i;
+				if (++queued == ring.Entries())
+					break;
+			}
+			if (queued == 0)
+				break;
+
+			ok = ring.SubmitAndWait([&](const io_uring_cqe& cqe)
+			{
+				Pending& file = batch[(size_t)cqe.user_data];
+				if (cqe.res > 0)
+					file.offset += (size_t)cqe.res;
+				else if (cqe.res == 0)
+				{
+					// end of file (file shrunk), keep what was read
+					file.content.resize(file.offset);
+					file.complete = true;
+				}
+				else
+					file.failed = true;
+			});
+			if (!ok)
+			{
+				// the buffers are only partly read, the batch is loaded again with pread
+				for (auto& it : batch)
+				{
+					if (it.fd >= 0)
+						close(it.fd);
+				}
+				return loaded;
+			}
+		}
+
+		for (size_t i = 0; i < count; i++)
+		{
+			Pending& file = batch[i];
+			if (file.fd >= 0)
+				close(file.fd);
+			// a failed open, stat or read is tried again with pread, like the other backends would read the file
+			if (file.fd < 0 || !statOk[i] || file.failed)
+				ReadFile(names[file.index], file.content);
+			done(file.index, std::move(file.content));
+		}
+		loaded += count;
+	}
+	return loaded;
+}
+#else
+size_t FileLoader::LoadIoUring(const std::vector<std::string>& names, const std::vector<size_t>& order, const Callback& done)
+{
+	return 0;
+}
+#endif
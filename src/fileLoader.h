@@ -0,0 +1,45 @@
+#pragma once
+
+#include <string>
+#include <vector>
+#include <functional>
+
+// Loads a list of files for the parser pipeline.
+// Backends: io_uring (Linux, open/stat/read submitted in batches), a thread pool doing pread (POSIX) and std::ifstream (everywhere).
+// Auto picks the first one that is available at runtime. Files that cannot be read are reported with empty content, like tools::readFromFile.
+class FileLoader
+{
+public:
+	enum class Backend
+	{
+		Auto,
+		IoUring,
+		Pread,
+		Stream,
+	};
+
+	// called once per file from a loader thread (the calling thread is one of them), in completion order
+	typedef std::function<void(size_t index, std::string&& content)> Callback;
+
+	FileLoader(Backend backend = Backend::Auto, int threads = 2, size_t batchSize = 64) : m_backend(backend), m_threads(threads), m_batchSize(batchSize) {}
+
+	// loads names[order[0]], names[order[1]], ... and returns when all callbacks are done, threads - 1 threads are started to help
+	void Load(const std::vector<std::string>& names, const std::vector<size_t>& order, const Callback& done);
+
+	// backend that was used by the last Load()
+	Backend UsedBackend() const { return m_used; }
+
+	static const char* BackendName(Backend backend);
+	static Backend ParseBackend(const std::string& name);
+
+protected:
+	// returns the number of files loaded, stops early when io_uring is not usable
+	size_t LoadIoUring(const std::vector<std::string>& names, const std::vector<size_t>& order, const Callback& done);
+	void LoadPread(const std::vector<std::string>& names, const std::vector<size_t>& order, size_t first, const Callback& done);
+	void LoadStream(const std::vector<std::string>& names, const std::vector<size_t>& order, size_t first, const Callback& done);
+
+	Backend m_backend;
+	Backend m_used = Backend::Auto;
+	int m_threads;
+	size_t m_batchSize;
+};
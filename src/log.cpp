@@ -0,0 +1,288 @@
+#include "log.h"
+#include "tools.h"
+#include <stdio.h>
+#include <stdarg.h>
+#include <string.h>
+#include <algorithm>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+static_assert((int)LogCategory::Count == 7, "a level for every category");
+std::atomic<int> Log::s_levels[(int)LogCategory::Count] = { { 2 }, { 2 }, { 2 }, { 2 }, { 2 }, { 2 }, { 2 } };
+
+namespace
+{
+	const size_t ChunkSize = 64 * 1024;
+	const size_t FlushAfter = 1024 * 1024;	// a thread flushes after writing this much
+
+	struct RecordHeader
+	{
+		unsigned long long sequence;
+		size_t length;
+	};
+
+	// the writer appends behind committed and links a new chunk when it is full, the flusher reads up to committed
+	// and frees a chunk once the writer moved on to the next one
+	struct Chunk
+	{
+		Chunk(size_t capacity) : data(new char[capacity]), capacity(capacity) {}
+		std::unique_ptr<char[]> data;
+		size_t capacity;
+		std::atomic<size_t> committed{ 0 };
+		std::atomic<Chunk*> next{ nullptr };
+		size_t read = 0;	// flusher only
+	};
+
+	struct ThreadBuffer
+	{
+		ThreadBuffer() : head(new Chunk(ChunkSize)), tail(head) {}
+		~ThreadBuffer()
+		{
+			while (head)
+			{
+				Chunk* next = head->next.load();
+				delete head;
+				head = next;
+			}
+		}
+		Chunk* head;	// flusher only
+		Chunk* tail;	// writer only
+		size_t written = 0;	// writer only, since its last flush
+		std::atomic<bool> retired{ false };	// the thread exited, the buffer goes after its last flush
+	};
+
+	struct Registry
+	{
+		~Registry()
+		{
+			Log::Flush();
+			for (auto it : buffers)
+				delete it;
+		}
+		std::mutex lock;
+		std::vector<ThreadBuffer*> buffers;
+		std::atomic<unsigned long long> sequence{ 0 };
+	};
+
+	Registry& GetRegistry()
+	{
+		static Registry registry;
+		return registry;
+	}
+
+	struct ThreadLog
+	{
+		~ThreadLog()
+		{
+			if (buffer)
+				buffer->retired.store(true, std::memory_order_release);
+		}
+		ThreadBuffer* buffer = 0;
+	};
+	thread_local ThreadLog tThreadLog;
+
+	ThreadBuffer* CurrentBuffer()
+	{
+		if (!tThreadLog.buffer)
+		{
+			Registry& registry = GetRegistry();
+			std::lock_guard<std::mutex> lk(registry.lock);
+			tThreadLog.buffer = new ThreadBuffer();
+			registry.buffers.push_back(tThreadLog.buffer);
+		}
+		return tThreadLog.buffer;
+	}
+
+	void Append(ThreadBuffer* buffer, const char* text, size_t length)
+	{
+		size_t size = sizeof(RecordHeader) + length;
+		Chunk* chunk = buffer->tail;
+		size_t used = chunk->committed.load(std::memory_order_relaxed);
+		if (chunk->capacity - used < size)
+		{
+			Chunk* next = new Chunk(std::max(ChunkSize, size));
+			chunk->next.store(next, std::memory_order_release);
+			buffer->tail = chunk = next;
+			used = 0;
+		}
+		RecordHeader header = { GetRegistry().sequence.fetch_add(1, std::memory_order_relaxed), length };
+		memcpy(chunk->data.get() + used, &header, sizeof(header));
+		memcpy(chunk->data.get() + used + sizeof(header), text, length);
+		chunk->committed.store(used + size, std::memory_order_release);
+		buffer->written += size;
+	}
+}
+
+void Log::Write(LogCategory /*category*/, LogLevel /*level*/, const char* fmt, ...)
+{
+	char stackBuffer[512];
+	std::string heapBuffer;
+	const char* text = stackBuffer;
+	va_list ap;
+	va_start(ap, fmt);
+	int n = vsnprintf(stackBuffer, sizeof(stackBuffer), fmt, ap);
+	va_end(ap);
+	if (n < 0)
+		return;
+	if (n >= (int)sizeof(stackBuffer))
+	{
+		heapBuffer.resize(n + 1);
+		va_start(ap, fmt);
+		vsnprintf(&heapBuffer[0], n + 1, fmt, ap);
+		va_end(ap);
+		text = heapBuffer.c_str();
+	}
+
+	ThreadBuffer* buffer = CurrentBuffer();
+	Append(buffer, text, (size_t)n);
+	if (buffer->written >= FlushAfter)
+	{
+		buffer->written = 0;
+		Flush();
+	}
+}
+
+void Log::Flush()
+{
+	struct Record
+	{
+		unsigned long long sequence;
+		const char* text;
+		size_t length;
+	};
+
+	Registry& registry = GetRegistry();
+	std::lock_guard<std::mutex> lk(registry.lock);
+	std::vector<Record> records;
+	std::vector<Chunk*> done;
+	std::vector<ThreadBuffer*> retiredBuffers;
+	for (auto& buffer : registry.buffers)
+	{
+		bool retired = buffer->retired.load(std::memory_order_acquire);
+		for (Chunk* chunk = buffer->head; chunk; )
+		{
+			// the writer commits its last record before it links the next chunk
+			Chunk* next = chunk->next.load(std::memory_order_acquire);
+			size_t end = chunk->committed.load(std::memory_order_acquire);
+			while (chunk->read < end)
+			{
+				RecordHeader header;
+				memcpy(&header, chunk->data.get() + chunk->read, sizeof(header));
+				Record record = { header.sequence, chunk->data.get() + chunk->read + sizeof(header), header.length };
+				records.push_back(record);
+				chunk->read += sizeof(header) + header.length;
+			}
+			if (!next)
+				break;
+			done.push_back(chunk);
+			buffer->head = chunk = next;
+		}
+		if (retired)
+		{
+			retiredBuffers.push_back(buffer);
+			buffer = 0;
+		}
+	}
+	registry.buffers.erase(std::remove(registry.buffers.begin(), registry.buffers.end(), (ThreadBuffer*)0), registry.buffers.end());
+
+	std::sort(records.begin(), records.end(), [](const Record& a, const Record& b) { return a.sequence < b.sequence; });
+	std::string out;
+	for (auto& it : records)
+		out.append(it.text, it.length);
+
+	// the records point into the chunks
+	for (auto it : done)
+		delete it;
+	for (auto it : retiredBuffers)
+		delete it;
+	if (!out.empty())
+	{
+		fwrite(out.data(), 1, out.size(), stderr);
+		fflush(stderr);
+	}
+}
+
+static const char* gCategoryNames[] = { "general", "parser", "transfigure", "wildcard", "output", "daemon", "watch" };
+static const char* gLevelNames[] = { "error", "warning", "info", "debug", "trace" };
+
+const char* Log::CategoryName(LogCategory category)
+{
+	return gCategoryNames[(int)category];
+}
+
+const char* Log::LevelName(LogLevel level)
+{
+	return gLevelNames[(int)level];
+}
+
+bool Log::Apply(const std::string& spec)
+{
+	size_t colon = spec.find(':');
+	std::string levelName = colon == std::string::npos ? spec : spec.substr(colon + 1);
+	int level = -1;
+	for (int i = 0; i <= (int)LogLevel::Trace; i++)
+	{
+		if (levelName == gLevelNames[i])
+			level = i;
+	}
+	if (level < 0)
+		return false;
+
+	if (colon == std::string::npos)
+	{
+		for (auto& it : s_levels)
+			it.store(level, std::memory_order_relaxed);
+		return true;
+	}
+	std::string categoryName = spec.substr(0, colon);
+	for (int i = 0; i < (int)LogCategory::Count; i++)
+	{
+		if (categoryName == gCategoryNames[i])
+		{
+			s_levels[i].store(level, std::memory_order_relaxed);
+			return true;
+		}
+	}
+	return false;
+}
+
+void Log::Configure(const tools::CommandLineParser& opts)
+{
+	// the command line tool configures before it runs and the run again, the settings are only applied (and reported) once
+	static std::mutex lock;
+	static std::string configured;
+	static const std::vector<std::string> none;
+	auto found = opts.optionsWithValues.find("log");
+	const std::vector<std::string>& specs = found == opts.optionsWithValues.end() ? none : found->second;
+	std::string settings = opts.options.count("verbose") ? "verbose" : "";
+	for (auto& it : specs)
+		settings += "," + it;
+	std::lock_guard<std::mutex> lk(lock);
+	if (settings == configured)
+		return;
+	configured = settings;
+
+	for (auto& it : s_levels)
+		it.store((int)(opts.options.count("verbose") ? LogLevel::Debug : LogLevel::Info), std::memory_order_relaxed);
+	for (auto& it : specs)
+	{
+		size_t begin = 0;
+		while (begin <= it.size())
+		{
+			size_t end = std::min(it.find(',', begin), it.size());
+			std::string spec = it.substr(begin, end - begin);
+			if (!spec.empty() && !Apply(spec))
+				LOG_WARNING(LogCategory::General, "Warning: Unknown log setting \"%s\", use [<category>:]<level>.\n", spec.c_str());
+			begin = end + 1;
+		}
+	}
+	for (auto& it : s_levels)
+	{
+		if (it.load(std::memory_order_relaxed) > LOG_MAX_LEVEL)
+		{
+			LOG_WARNING(LogCategory::General, "Warning: This build has no log messages above level \"%s\" (LOG_MAX_LEVEL).\n", LevelName((LogLevel)LOG_MAX_LEVEL));
+			break;
+		}
+	}
+}
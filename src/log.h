@@ -0,0 +1,54 @@
+#pragma once
+
+#include <string>
+#include <atomic>
+
+namespace tools { struct CommandLineParser; }
+
+enum class LogLevel { Error, Warning, Info, Debug, Trace };
+enum class LogCategory { General, Parser, Transfigure, Wildcard, Output, Daemon, Watch, Count };
+
+// Leveled log on stderr, with a level per category:
+//   --log=debug					every category
+//   --log=transfigure:trace,parser:warning	single categories, applied after the ones before
+//   --verbose					the same as --log=debug
+// The default is info. Messages are written to a buffer of the calling thread without taking a lock (a chain of chunks that
+// only the thread appends to) and Flush() writes the buffers of all threads in the order the messages were written.
+// The schedule flushes after every stage, a thread flushes when it wrote a lot, the rest is flushed at exit.
+// Levels above LOG_MAX_LEVEL are removed at compile time, including their arguments: debug and trace in a Release build
+// (NDEBUG), build with -DLOG_MAX_LEVEL=4 to keep them.
+class Log
+{
+public:
+	static bool Enabled(LogCategory category, LogLevel level) { return (int)level <= s_levels[(int)category].load(std::memory_order_relaxed); }
+	// printf style, the message includes its line break
+	static void Write(LogCategory category, LogLevel level, const char* fmt, ...);
+	// writes the messages of all threads to stderr
+	static void Flush();
+
+	// levels of --log and --verbose, the categories that are not named are at info
+	static void Configure(const tools::CommandLineParser& opts);
+	static const char* CategoryName(LogCategory category);
+	static const char* LevelName(LogLevel level);
+
+protected:
+	static bool Apply(const std::string& spec);
+
+	static std::atomic<int> s_levels[(int)LogCategory::Count];
+};
+
+#ifndef LOG_MAX_LEVEL
+#ifdef NDEBUG
+#define LOG_MAX_LEVEL 2
+#else
+#define LOG_MAX_LEVEL 4
+#endif
+#endif
+
+#define LOG_ENABLED(category, level) ((int)(level) <= LOG_MAX_LEVEL && Log::Enabled(category, level))
+#define LOG_AT(category, level, ...) do { if (LOG_ENABLED(category, level)) Log::Write(category, level, __VA_ARGS__); } while (0)
+#define LOG_ERROR(category, ...) LOG_AT(category, LogLevel::Error, __VA_ARGS__)
+#define LOG_WARNING(category, ...) LOG_AT(category, LogLevel::Warning, __VA_ARGS__)
+#define LOG_INFO(category, ...) LOG_AT(category, LogLevel::Info, __VA_ARGS__)
+#define LOG_DEBUG(category, ...) LOG_AT(category, LogLevel::Debug, __VA_ARGS__)
+#define LOG_TRACE(category, ...) LOG_AT(category, LogLevel::Trace, __VA_ARGS__)
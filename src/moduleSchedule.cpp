@@ -0,0 +1,396 @@
+#include "moduleSchedule.h"
+#include "tools.h"
+#include "ast.h"
+#include "astVisitor.h"
+#include "astProcessor.h"
+#include "cxxAstParser.h"
+#include "fileDiscovery.h"
+#include "log.h"
+#include <functional>
+#include <algorithm>
+#include <chrono>
+
+static double MillisecondsSince(std::chrono::steady_clock::time_point start)
+{
+	return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+}
+
+bool ModuleSchedule::Conflicts(const Entry& before, const Entry& after)
+{
+	// output is ordered by buffering, not by the schedule
+	unsigned int writesBefore = before.writes & ~ModuleAccess::Output;
+	unsigned int writesAfter = after.writes & ~ModuleAccess::Output;
+	return (writesBefore & (after.reads | writesAfter)) != 0 || (before.reads & writesAfter) != 0;
+}
+
+std::string ModuleSchedule::AccessString(unsigned int resources)
+{
+	static const struct { unsigned int resource; const char* name; } names[] = {
+		{ ModuleAccess::Files, "files" },
+		{ ModuleAccess::AST, "ast" },
+		{ ModuleAccess::Output, "output" },
+	};
+
+	std::string ret;
+	for (auto& it : names)
+	{
+		if ((resources & it.resource) == 0)
+			continue;
+		if (!ret.empty())
+			ret += " ";
+		ret += it.name;
+	}
+	return ret.empty() ? "-" : ret;
+}
+
+void ModuleSchedule::Build(const tools::CommandLineParser& opts)
+{
+	m_entries.clear();
+	m_captured.clear();
+	m_stageCount = 0;
+	m_streaming = false;
+	m_streamParser = 0;
+
+	auto& modules = ModuleRegistration::Modules();
+	auto itNames = opts.optionsWithValues.find("module");
+	if (itNames == opts.optionsWithValues.end())
+		return;
+
+	for (auto& itModule : itNames->second)
+	{
+		auto mod = modules.find(itModule);
+		if (mod == modules.end())
+		{
+			LOG_ERROR(LogCategory::General, "Error: Could not find module \"%s\".\n", itModule.c_str());
+			continue;
+		}
+
+		Entry entry;
+		entry.name = itModule;
+		entry.module = (*mod).second->Handler();
+		entry.reads = entry.module->Reads();
+		entry.writes = entry.module->Writes();
+		entry.visitor = dynamic_cast<VisitorModule*>(entry.module) != 0;
+
+		// --output=<module>=<file> wins over --output=<file>
+		auto itOutputs = opts.optionsWithValues.find("output");
+		if (itOutputs != opts.optionsWithValues.end())
+		{
+			for (auto& it : itOutputs->second)
+			{
+				size_t split = it.find('=');
+				if (split == std::string::npos)
+				{
+					if (entry.outputPath.empty())
+						entry.outputPath = it;
+				}
+				else if (it.compare(0, split, itModule) == 0)
+					entry.outputPath = it.substr(split + 1);
+			}
+		}
+
+		// a stage after all of the entries it depends on
+		for (size_t i = 0; i < m_entries.size(); i++)
+		{
+			if (!Conflicts(m_entries[i], entry))
+				continue;
+			entry.dependencies.push_back(i);
+			if (m_entries[i].stage + 1 > entry.stage)
+				entry.stage = m_entries[i].stage + 1;
+		}
+
+		if (entry.stage + 1 > m_stageCount)
+			m_stageCount = entry.stage + 1;
+		m_entries.push_back(entry);
+	}
+
+	if (opts.options.count("stream") || opts.optionsWithValues.count("memory-budget"))
+	{
+		m_memoryBudget = (size_t)std::max(1LL, opts.intOption("memory-budget", 512)) * 1024 * 1024;
+		m_streaming = CanStream();
+		if (!m_streaming)
+			LOG_WARNING(LogCategory::General, "Warning: Streaming needs a parser, optionally after wildcard, followed by per file modules only (print_structure, print_types, print_code, reflection_data), running them on the full tree.\n");
+	}
+}
+
+bool ModuleSchedule::CanStream()
+{
+	m_streamParser = 0;
+	while (m_streamParser < m_entries.size() && ((m_entries[m_streamParser].reads | m_entries[m_streamParser].writes) & ~ModuleAccess::Files) == 0)
+		m_streamParser++;
+	if (m_entries.size() < m_streamParser + 2 || !m_entries[m_streamParser].module->SupportsStreaming())
+		return false;
+	for (size_t i = m_streamParser + 1; i < m_entries.size(); i++)
+	{
+		if (!m_entries[i].visitor || !m_entries[i].module->VisitsPerFile())
+			return false;
+	}
+	return true;
+}
+
+std::vector<size_t> ModuleSchedule::Stage(int stage) const
+{
+	std::vector<size_t> ret;
+	for (size_t i = 0; i < m_entries.size(); i++)
+	{
+		if (m_entries[i].stage == stage)
+			ret.push_back(i);
+	}
+	return ret;
+}
+
+void ModuleSchedule::Print(FILE* dev) const
+{
+	fprintf(dev, "Schedule: %d module(s) in %d stage(s)\n", (int)m_entries.size(), m_stageCount);
+	if (m_streaming)
+	{
+		fprintf(dev, "streaming: %s hands over one file at a time to the other modules, memory budget %d MB\n",
+			m_entries[m_streamParser].name.c_str(), (int)(m_memoryBudget / (1024 * 1024)));
+	}
+	for (int s = 0; s < m_stageCount; s++)
+	{
+		auto stage = Stage(s);
+		size_t visitors = 0;
+		for (auto it : stage)
+			visitors += m_entries[it].visitor ? 1 : 0;
+		size_t tasks = stage.size() - visitors + (visitors > 0 ? 1 : 0);
+
+		fprintf(dev, "stage %d: %d module(s), %d concurrent task(s)\n", s, (int)stage.size(), (int)tasks);
+		for (auto it : stage)
+		{
+			auto& entry = m_entries[it];
+			std::string after;
+			for (auto itDep : entry.dependencies)
+				tools::appendFormat(after, after.empty() ? "%d" : " %d", (int)itDep);
+
+			fprintf(dev, "  [%d] %s reads: %s, writes: %s", (int)it, entry.name.c_str(), AccessString(entry.reads).c_str(), AccessString(entry.writes).c_str());
+			if (!after.empty())
+				fprintf(dev, ", after: %s", after.c_str());
+			if (entry.visitor && visitors > 1)
+				fprintf(dev, ", shared traversal");
+			if (!entry.outputPath.empty() && (entry.writes & ModuleAccess::Output))
+				fprintf(dev, ", output: \"%s\"", entry.outputPath.c_str());
+			fprintf(dev, "\n");
+		}
+	}
+}
+
+OutputSink* ModuleSchedule::Destination(size_t entry)
+{
+	if (m_capture)
+	{
+		auto& captured = m_captured[entry];
+		if (!captured)
+			captured.reset(new MemorySink());
+		return captured.get();
+	}
+
+	auto& path = m_entries[entry].outputPath;
+	if (path.empty())
+		return &OutputSink::Stdout();
+
+	auto& file = m_files[path];
+	if (!file)
+		file.reset(new FileSink(path));
+	return file.get();
+}
+
+void ModuleSchedule::OpenSinks(const std::vector<size_t>& entries, size_t nextOutput, std::vector<OutputSink*>& sinks, std::vector<std::unique_ptr<MemorySink>>& buffers)
+{
+	for (auto it : entries)
+	{
+		if (it == nextOutput || (m_entries[it].writes & ModuleAccess::Output) == 0)
+		{
+			sinks[it] = Destination(it);
+			continue;
+		}
+		buffers[it].reset(new MemorySink());
+		sinks[it] = buffers[it].get();
+	}
+}
+
+void ModuleSchedule::WriteBuffer(size_t entry, std::unique_ptr<MemorySink>& buffer)
+{
+	if (!buffer)
+		return;
+	Destination(entry)->Write(buffer->Buffer());
+	buffer.reset();
+}
+
+std::string ModuleSchedule::TakeOutput(size_t entry)
+{
+	std::string ret;
+	auto found = m_captured.find(entry);
+	if (found == m_captured.end())
+		return ret;
+	ret = found->second->Buffer();
+	m_captured.erase(found);
+	return ret;
+}
+
+void ModuleSchedule::CloseSinks()
+{
+	for (auto& it : m_files)
+		it.second->Close();
+	m_files.clear();
+	OutputSink::Stdout().Flush();
+}
+
+void ModuleSchedule::ExecuteStreaming(tools::CommandLineParser& opts, ASTNode* rootNode, std::vector<std::unique_ptr<ASTCxxParser>>& parsers, TaskScheduler& scheduler)
+{
+	// the file list is complete before the parser starts
+	m_milliseconds.assign(m_entries.size(), 0.0);
+	for (size_t i = 0; i < m_streamParser; i++)
+	{
+		auto start = std::chrono::steady_clock::now();
+		m_entries[i].module->Execute(opts, rootNode, parsers, scheduler);
+		FileDiscovery::Complete(opts);
+		m_milliseconds[i] = MillisecondsSince(start);
+	}
+
+	std::vector<size_t> consumers;
+	for (size_t i = m_streamParser + 1; i < m_entries.size(); i++)
+		consumers.push_back(i);
+	std::vector<OutputSink*> sinks(m_entries.size(), (OutputSink*)0);
+	std::vector<std::unique_ptr<MemorySink>> buffers(m_entries.size());
+	OpenSinks(consumers, m_streamParser + 1, sinks, buffers);
+
+	std::vector<std::unique_ptr<ASTVisitor>> visitors;
+	std::vector<ASTVisitor*> list;
+	for (auto it : consumers)
+	{
+		ModuleOutput::SetCurrent(sinks[it]);
+		visitors.push_back(std::unique_ptr<ASTVisitor>(m_entries[it].module->CreateVisitor(opts, parsers)));
+		ModuleOutput::SetCurrent(0);
+		list.push_back(visitors.back().get());
+	}
+
+	// every file is attached to the root while it is visited, so the visitors see the same parents as in a full tree
+	auto start = std::chrono::steady_clock::now();
+	ASTVisitorStream stream(rootNode, list);
+	m_entries[m_streamParser].module->ExecuteStreaming(opts, m_memoryBudget, scheduler, [&](ASTNode* file)
+	{
+		rootNode->AddNode(file);
+		stream.Visit(file);
+		rootNode->DestroyChildrenFrom(0);
+		Log::Flush();
+	});
+	stream.Finish();
+	for (size_t i = m_streamParser; i < m_entries.size(); i++)
+		m_milliseconds[i] = MillisecondsSince(start);
+
+	for (auto it : consumers)
+		WriteBuffer(it, buffers[it]);
+	CloseSinks();
+}
+
+void ModuleSchedule::Execute(tools::CommandLineParser& opts, ASTNode* rootNode, std::vector<std::unique_ptr<ASTCxxParser>>& parsers, TaskScheduler& scheduler)
+{
+	// a discovery of an earlier run that failed
+	FileDiscovery::SetCurrent(0);
+	if (m_streaming)
+	{
+		ExecuteStreaming(opts, rootNode, parsers, scheduler);
+		return;
+	}
+
+	// entries before nextOutput have written their output
+	m_milliseconds.assign(m_entries.size(), 0.0);
+	std::vector<OutputSink*> sinks(m_entries.size(), (OutputSink*)0);
+	std::vector<std::unique_ptr<MemorySink>> buffers(m_entries.size());
+	std::vector<bool> finished(m_entries.size(), false);
+	size_t nextOutput = 0;
+
+	for (int s = 0; s < m_stageCount; s++)
+	{
+		auto stage = Stage(s);
+
+		// the wildcard module walks the directories while a parser takes the files, other modules need the complete list
+		if (FileDiscovery::Current() && !(stage.size() == 1 && m_entries[stage[0]].module->TakesDiscoveredFiles()))
+			FileDiscovery::Complete(opts);
+
+		bool readsTree = false;
+		for (auto it : stage)
+			readsTree |= (m_entries[it].reads & ModuleAccess::AST) != 0;
+		OpenSinks(stage, nextOutput, sinks, buffers);
+
+		// one traversal for all visitors, and a task for every other module
+		std::vector<std::unique_ptr<ASTVisitor>> visitors;
+		std::vector<std::function<void()>> tasks;
+		for (auto it : stage)
+		{
+			auto& entry = m_entries[it];
+			OutputSink* output = sinks[it];
+			if (entry.visitor)
+			{
+				// visitors take the output when they are created
+				ModuleOutput::SetCurrent(output);
+				visitors.push_back(std::unique_ptr<ASTVisitor>(entry.module->CreateVisitor(opts, parsers)));
+				ModuleOutput::SetCurrent(0);
+				continue;
+			}
+
+			IModule* module = entry.module;
+			double* milliseconds = &m_milliseconds[it];
+			tasks.push_back([module, output, milliseconds, &opts, rootNode, &parsers, &scheduler]()
+			{
+				// a thread that waits for a group can run another stage task in between, keep its output
+				auto start = std::chrono::steady_clock::now();
+				OutputSink* previous = ModuleOutput::Current();
+				ModuleOutput::SetCurrent(output);
+				module->Execute(opts, rootNode, parsers, scheduler);
+				ModuleOutput::SetCurrent(previous);
+				*milliseconds = MillisecondsSince(start);
+			});
+		}
+		if (!visitors.empty())
+		{
+			tasks.push_back([this, &visitors, &stage, rootNode]()
+			{
+				auto start = std::chrono::steady_clock::now();
+				std::vector<ASTVisitor*> list;
+				for (auto& it : visitors)
+					list.push_back(it.get());
+				ASTVisitor::TraverseFused(rootNode, list);
+
+				double milliseconds = MillisecondsSince(start);
+				for (auto it : stage)
+				{
+					if (m_entries[it].visitor)
+						m_milliseconds[it] = milliseconds;
+				}
+			});
+		}
+
+		if (tasks.size() == 1)
+			tasks[0]();
+		else
+		{
+			// the tree caches spellings on first use, fill them before several tasks read it
+			if (readsTree)
+				ASTProcessor::FillCaches(rootNode, scheduler);
+
+			TaskScheduler::Group group(scheduler);
+			for (size_t i = 1; i < tasks.size(); i++)
+				group.Run(tasks[i]);
+			std::exception_ptr error;
+			try { tasks[0](); }
+			catch (...) { error = std::current_exception(); }
+			group.Wait();
+			if (error)
+				std::rethrow_exception(error);
+		}
+
+		// write the buffered output of everything that is finished, in command line order
+		for (auto it : stage)
+			finished[it] = true;
+		while (nextOutput < m_entries.size() && finished[nextOutput])
+		{
+			WriteBuffer(nextOutput, buffers[nextOutput]);
+			nextOutput++;
+		}
+		Log::Flush();
+	}
+	FileDiscovery::Complete(opts);
+	CloseSinks();
+}
@@ -0,0 +1,70 @@
+#pragma once
+
+#include <vector>
+#include <string>
+#include <memory>
+#include <map>
+#include <stdio.h>
+#include "modules.h"
+#include "taskScheduler.h"
+
+// Dependency graph of the --module= entries of the command line.
+// An entry depends on every earlier entry it conflicts with (one of them writes a resource the other reads or writes).
+// Entries of the same stage are independent and run concurrently as tasks of the driver's scheduler, visitor modules of a stage share one traversal.
+// Output is buffered where needed and written in command line order, to stdout or to the file given with
+// --output=<file> (all modules) or --output=<module>=<file>.
+// With --stream (or --memory-budget=<megabytes>) a parser followed by per file visitor modules runs as one stream:
+// every file is visited as soon as it is parsed and released right after, the parser keeps the files in flight within the budget.
+class ModuleSchedule
+{
+public:
+	struct Entry
+	{
+		std::string name;
+		IModule* module = 0;
+		unsigned int reads = 0;
+		unsigned int writes = 0;
+		bool visitor = false;
+		int stage = 0;
+		std::vector<size_t> dependencies; // earlier entries this one conflicts with
+		std::string outputPath; // empty for stdout
+	};
+
+	void Build(const tools::CommandLineParser& opts);
+	// keeps the output of every entry in memory instead of writing it to stdout or files (embedding API)
+	void CaptureOutput() { m_capture = true; }
+	// captured output of an entry after Execute(), empty when it wrote nothing
+	std::string TakeOutput(size_t entry);
+	// wall time of an entry in the last Execute(), visitors that share a traversal (or a stream) all report the time of it
+	double Milliseconds(size_t entry) const { return entry < m_milliseconds.size() ? m_milliseconds[entry] : 0.0; }
+	void Print(FILE* dev) const;
+	void Execute(tools::CommandLineParser& opts, ASTNode* rootNode, std::vector<std::unique_ptr<ASTCxxParser>>& parsers, TaskScheduler& scheduler);
+
+	const std::vector<Entry>& Entries() const { return m_entries; }
+	int StageCount() const { return m_stageCount; }
+	bool IsStreaming() const { return m_streaming; }
+
+	static bool Conflicts(const Entry& before, const Entry& after);
+	static std::string AccessString(unsigned int resources);
+
+protected:
+	std::vector<size_t> Stage(int stage) const;
+	bool CanStream();
+	void ExecuteStreaming(tools::CommandLineParser& opts, ASTNode* rootNode, std::vector<std::unique_ptr<ASTCxxParser>>& parsers, TaskScheduler& scheduler);
+
+	// the entry at nextOutput writes to its destination directly, the others into memory until it is their turn
+	OutputSink* Destination(size_t entry);
+	void OpenSinks(const std::vector<size_t>& entries, size_t nextOutput, std::vector<OutputSink*>& sinks, std::vector<std::unique_ptr<MemorySink>>& buffers);
+	void WriteBuffer(size_t entry, std::unique_ptr<MemorySink>& buffer);
+	void CloseSinks();
+
+	std::vector<Entry> m_entries;
+	int m_stageCount = 0;
+	bool m_streaming = false;
+	size_t m_streamParser = 0;	// the entries before it only change the file list (wildcard) and run before the parser streams
+	size_t m_memoryBudget = 0;
+	std::map<std::string, std::unique_ptr<FileSink>> m_files;
+	bool m_capture = false;
+	std::map<size_t, std::unique_ptr<MemorySink>> m_captured;
+	std::vector<double> m_milliseconds;
+};
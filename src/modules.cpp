@@ -1,4 +1,17 @@
 #include "modules.h"
+#include "astVisitor.h"
+
+static thread_local OutputSink* gModuleOutput = 0;
+
+OutputSink* ModuleOutput::Current()
+{
+	return gModuleOutput ? gModuleOutput : &OutputSink::Stdout();
+}
+
+void ModuleOutput::SetCurrent(OutputSink* sink)
+{
+	gModuleOutput = sink;
+}
 
 ModuleRegistration::ModuleRegistration(const char* moduleIdentifier, IModule* moduleHandler)
 {
@@ -20,3 +33,9 @@ std::map<std::string, ModuleRegistration*>& ModuleRegistration::i_Modules()
 	static std::map<std::string, ModuleRegistration*> gModules;
 	return gModules;
 }
+
+void VisitorModule::Execute(tools::CommandLineParser& cmdOpts, ASTNode* rootNode, std::vector<std::unique_ptr<ASTCxxParser>>& parsers, TaskScheduler& /*scheduler*/)
+{
+	std::unique_ptr<ASTVisitor> visitor(CreateVisitor(cmdOpts, parsers));
+	ASTVisitor::Traverse(rootNode, visitor.get());
+}
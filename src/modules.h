@@ -2,15 +2,77 @@
 #include <vector>
 #include <map>
 #include <memory>
+#include <string>
+#include <functional>
+#include <stdio.h>
+#include "outputSink.h"
 
 namespace tools { struct CommandLineParser; }
 class ASTNode;
 class ASTCxxParser;
+class ASTVisitor;
+class TaskScheduler;
 
+// Shared state a module can read or write, main.cpp runs modules that do not conflict concurrently (see ModuleSchedule).
+namespace ModuleAccess
+{
+	enum Resource : unsigned int
+	{
+		None = 0,
+		Files = 1 << 0,			// file list of the command line
+		AST = 1 << 1,			// parsed tree, parsers, the annotation index and the type links of the transfiguration
+		Output = 1 << 2,		// stdout, buffered per module and written in command line order, so it never orders modules by itself
+		All = Files | AST | Output,
+	};
+};
+
+// Sink a module writes its results to, instead of stdout (stdout, a buffer or the file of --output).
+// Set per thread by the scheduler, visitors should take it when they are created since they can run on another module's thread.
+class ModuleOutput
+{
+public:
+	static OutputSink* Current();
+	static void SetCurrent(OutputSink* sink);
+};
+
+// The scheduler is the process wide worker pool of the driver (--jobs=N), modules use it for their parallel work
+// instead of starting threads of their own.
 class IModule
 {
 public:
-	virtual void Execute(tools::CommandLineParser& cmdOpts, ASTNode* rootNode, std::vector<std::unique_ptr<ASTCxxParser>>& parsers) = 0;
+	virtual void Execute(tools::CommandLineParser& cmdOpts, ASTNode* rootNode, std::vector<std::unique_ptr<ASTCxxParser>>& parsers, TaskScheduler& scheduler) = 0;
+
+	// Resources the module reads and writes (ModuleAccess flags). The default is conservative:
+	// the module waits for every module before it, and every module after it waits for it.
+	virtual unsigned int Reads() const { return ModuleAccess::All; }
+	virtual unsigned int Writes() const { return ModuleAccess::All; }
+
+	// Read-only modules can return a new visitor (owned by the caller) instead of walking the tree themselves.
+	// Visitor modules that are scheduled in the same stage are run in a single traversal.
+	virtual ASTVisitor* CreateVisitor(tools::CommandLineParser& /*cmdOpts*/, std::vector<std::unique_ptr<ASTCxxParser>>& /*parsers*/) { return 0; }
+	// true when the visitor only looks at the root and the File it is in, so the files can be visited one at a time (--stream)
+	virtual bool VisitsPerFile() const { return false; }
+
+	// Parsers can hand the files over one at a time instead of attaching them all to the tree (--stream).
+	// The callback gets the File nodes in command line order and takes ownership, the tokens of a file are released when it returns.
+	// memoryBudget limits the estimated memory of the files that are in flight (read, parsed or waiting for their turn).
+	typedef std::function<void(ASTNode* file)> FileCallback;
+	virtual bool SupportsStreaming() const { return false; }
+	virtual void ExecuteStreaming(tools::CommandLineParser& /*cmdOpts*/, size_t /*memoryBudget*/, TaskScheduler& /*scheduler*/, const FileCallback& /*callback*/) {}
+
+	// true when the module takes the files of the wildcard module as they are found (FileDiscovery::Current()),
+	// the complete list is put into the names before any other module runs
+	virtual bool TakesDiscoveredFiles() const { return false; }
+};
+
+// Base for modules that are implemented as a visitor, Execute() runs the visitor on its own.
+class VisitorModule : public IModule
+{
+public:
+	virtual unsigned int Reads() const { return ModuleAccess::AST; }
+	virtual unsigned int Writes() const { return ModuleAccess::Output; }
+	virtual void Execute(tools::CommandLineParser& cmdOpts, ASTNode* rootNode, std::vector<std::unique_ptr<ASTCxxParser>>& parsers, TaskScheduler& scheduler);
+	virtual ASTVisitor* CreateVisitor(tools::CommandLineParser& cmdOpts, std::vector<std::unique_ptr<ASTCxxParser>>& parsers) = 0;
 };
 
 class ModuleRegistration
@@ -3,76 +3,893 @@
 #include "../cxxTokenizer.h"
 #include "../cxxAstParser.h"
 #include "../astProcessor.h" 
+#include <algorithm>
+#include <fstream>
+#include <atomic>
+#include <chrono>
+#include <thread>
 #include <mutex>
+#include <condition_variable>
+#include "../boundedQueue.h"
+#include "../fileLoader.h"
+#include "../taskScheduler.h"
+#include "../parseCache.h"
+#include "../astSerializer.h"
+#include "../fileDiscovery.h"
+#include "../log.h"
+#include <deque>
+#include <unordered_map>
+#include <fcntl.h>
+#include <sys/stat.h>
+#ifdef _WIN32
+#include <io.h>
+#else
+#include <unistd.h>
+#include <poll.h>
+#include <errno.h>
+#include <sys/wait.h>
+#endif
 
-#include <omp.h>
 
 class ModuleCppParser : public IModule
 {
 public:
 	ModuleCppParser(bool a_MT) : Multithreaded(a_MT) {}
 	bool Multithreaded;
-	virtual void Execute(tools::CommandLineParser& opts, ASTNode* rootNode, std::vector<std::unique_ptr<ASTCxxParser>>& parsers)
+
+	// result of one file, written only by the thread that parsed it
+	struct ParsedFile
 	{
-		fprintf(stderr, "********************* CPP PARSER (%s) ***********************\n", Multithreaded ? "MT" : "ST");
+		std::unique_ptr<ASTCxxParser> parser;
+		std::unique_ptr<ASTDataNode> root;
+	};
 
-		std::mutex lkSuperRoot;
+	virtual void Execute(tools::CommandLineParser& opts, ASTNode* rootNode, std::vector<std::unique_ptr<ASTCxxParser>>& parsers, TaskScheduler& scheduler)
+	{
+		LOG_INFO(LogCategory::Parser, "********************* CPP PARSER (%s) ***********************\n", Multithreaded ? "MT" : "ST");
 
-		// parse files
-		if (Multithreaded)
+		std::vector<ParsedFile> results;
+		int shards = (int)opts.intOption("shards", 1);
+		// the shards are balanced by file size, they need the complete list
+		if (shards > 1)
+			FileDiscovery::Complete(opts);
+		FileDiscovery* discovery = FileDiscovery::Current();
+		if (discovery)
 		{
-			#pragma omp parallel for
-			for (size_t i = 0; i < opts.names.size(); i++)
+			ParseDiscovered(opts, *discovery, results);
+		}
+		else
+		{
+			results.resize(opts.names.size());
+
+			// files the daemon kept from an earlier run (--serve) are not parsed again
+			ParseCache* cache = ParseCache::Current();
+			if (cache)
+			{
+				for (size_t i = 0; i < opts.names.size(); i++)
+					cache->Take(opts.names[i], results[i].parser, results[i].root);
+			}
+
+			// parse files
+			if (shards > 1)
+			{
+				ParseSharded(opts, results, shards, scheduler);
+			}
+			else if (Multithreaded)
+			{
+				ParsePipelined(opts, results, scheduler.Jobs());
+			}
+			else
 			{
-				ParseFile(opts, i, parsers, lkSuperRoot, rootNode);
+				for (size_t i = 0; i < opts.names.size(); i++)
+				{
+					if (!results[i].parser)
+						ParseFile(opts, opts.names[i], results[i]);
+				}
 			}
 		}
-		else
+
+		// attach in command line order, so the tree does not depend on the thread timing
+		for (auto& it : results)
 		{
-			for (size_t i = 0; i < opts.names.size(); i++)
+			if (!it.parser)
+				continue;
+
+			// store parser - we need the tokens later
+			AnnotationIndex::Global().Merge(it.parser->Annotations);
+			parsers.push_back(std::move(it.parser));
+			rootNode->AddNode(it.root.release());
+		}
+	}
+
+	virtual unsigned int Reads() const { return ModuleAccess::Files; }
+	virtual unsigned int Writes() const { return ModuleAccess::AST; }
+	virtual bool SupportsStreaming() const { return true; }
+	// the pipeline of the MT variant loads the largest files first, it needs the complete list
+	virtual bool TakesDiscoveredFiles() const { return !Multithreaded; }
+
+	// the files of the wildcard module are parsed as they are found, and put in the order of the expanded command line when the walk is done
+	void ParseDiscovered(tools::CommandLineParser& opts, FileDiscovery& discovery, std::vector<ParsedFile>& results)
+	{
+		FileDiscovery::SetCurrent(0);
+		ParseCache* cache = ParseCache::Current();
+		std::deque<std::pair<std::string, ParsedFile> > files;
+		auto parse = [&](const std::string& name)
+		{
+			files.push_back(std::make_pair(name, ParsedFile()));
+			auto& file = files.back();
+			if (!cache || !cache->Take(file.first, file.second.parser, file.second.root))
+				ParseFile(opts, file.first, file.second);
+		};
+		for (auto& it : opts.names)
+			parse(it);
+		std::string name;
+		while (discovery.Next(name))
+			parse(name);
+
+		std::vector<std::string> found = discovery.Finish();
+		opts.names.insert(opts.names.end(), found.begin(), found.end());
+		std::unordered_map<std::string, ParsedFile*> byName;
+		for (auto& it : files)
+			byName.insert(std::make_pair(it.first, &it.second));
+		for (auto& it : opts.names)
+		{
+			results.push_back(ParsedFile());
+			auto file = byName.find(it);
+			if (file != byName.end())
+				results.back() = std::move(*file->second);
+		}
+		LOG_INFO(LogCategory::Parser, "[PARSER] %d file(s) parsed while they were found\n", (int)files.size());
+	}
+
+	static std::vector<long long> FileSizes(const tools::CommandLineParser& opts)
+	{
+		std::vector<long long> ret;
+		for (auto& it : opts.names)
+		{
+			auto memory = opts.memorySource(it);
+			if (memory)
 			{
-				ParseFile(opts, i, parsers, lkSuperRoot, rootNode);
+				ret.push_back((long long)memory->length);
+				continue;
 			}
+			if (IsStream(it))
+			{
+				ret.push_back(0); // unknown until it is read, and it can only be read once
+				continue;
+			}
+			std::ifstream ifs(it, std::ios::binary | std::ios::ate);
+			ret.push_back(ifs ? (long long)ifs.tellg() : 0LL);
 		}
+		return ret;
+	}
+
+	static std::vector<size_t> LargestFirst(const tools::CommandLineParser& opts)
+	{
+		std::vector<long long> fileSizes = FileSizes(opts);
+		std::vector<std::pair<long long, size_t> > sizes;
+		for (size_t i = 0; i < opts.names.size(); i++)
+			sizes.push_back(std::make_pair(fileSizes[i], i));
+		std::stable_sort(sizes.begin(), sizes.end(), [](const std::pair<long long, size_t>& a, const std::pair<long long, size_t>& b) { return a.first > b.first; });
+
+		std::vector<size_t> ret;
+		for (auto& it : sizes)
+			ret.push_back(it.second);
+		return ret;
+	}
+
+	// "-" (stdin) and named pipes are tokenized and parsed while they are written, instead of being read first
+	static bool IsStream(const std::string& name)
+	{
+		if (name == "-")
+			return true;
+#ifdef _WIN32
+		return false;
+#else
+		struct stat st;
+		return stat(name.c_str(), &st) == 0 && S_ISFIFO(st.st_mode);
+#endif
+	}
+
+	// file descriptor of a stream, -1 when it cannot be opened
+	static int OpenStream(const std::string& name)
+	{
+		if (name == "-")
+			return 0;
+		return open(name.c_str(), O_RDONLY);
 	}
 
-	void ParseFile(tools::CommandLineParser &opts, size_t i, std::vector<std::unique_ptr<ASTCxxParser>> &parsers, std::mutex &lkSuperRoot, ASTNode* rootNode)
+	static void CloseStream(int fd)
 	{
-		fprintf(stderr, "[PARSER] Parsing file \"%s\"\n", opts.names[i].c_str());
-		CxxStringTokenizer stokenizer(opts.names[i], tools::readFromFile(opts.names[i]));
-		std::unique_ptr<ASTCxxParser> parser(new ASTCxxParser(stokenizer));
+		if (fd > 0)
+			close(fd);
+	}
 
-		// enable verbosity
-		if (opts.options.find("verbose") != opts.options.end())
-			parser->Verbose = true;
+	void ParseStream(tools::CommandLineParser &opts, const std::string& name, ParsedFile& result)
+	{
+		int fd = OpenStream(name);
+		if (fd < 0)
+		{
+			LOG_ERROR(LogCategory::Parser, "Error: Could not open \"%s\".\n", name.c_str());
+			return;
+		}
+		std::unique_ptr<ASTCxxParser> parser;
+		try
+		{
+			CxxStreamTokenizer tokenizer(name, fd);
+			parser.reset(new ASTCxxParser(tokenizer, true));
+			ParseTokens(opts, name, parser, result);
+		}
+		catch (const std::exception& e)
+		{
+			LOG_ERROR(LogCategory::Parser, "Error: Fatal error during tokenize of \"%s\": %s\n", name.c_str(), e.what());
+		}
+		CloseStream(fd);
+	}
 
+	void ParseFile(tools::CommandLineParser &opts, const std::string& name, ParsedFile& result)
+	{
+		LOG_INFO(LogCategory::Parser, "[PARSER] Parsing file \"%s\"\n", name.c_str());
+		std::unique_ptr<ASTCxxParser> parser;
+		auto memory = opts.memorySource(name);
+		if (!memory && IsStream(name))
+		{
+			ParseStream(opts, name, result);
+			return;
+		}
+		if (memory)
+			parser.reset(Tokenize(name, memory->data, memory->length));
+		else
+		{
+			std::string content = tools::readFromFile(name);
+			parser.reset(Tokenize(name, content.c_str(), content.size()));
+		}
+		ParseTokens(opts, name, parser, result);
+	}
+
+	// the source is tokenized in place, it can be released when this returns
+	ASTCxxParser* Tokenize(const std::string& name, const char* data, size_t length)
+	{
+		CxxBufferTokenizer tokenizer(name, data, length);
+		ASTCxxParser* parser = new ASTCxxParser(tokenizer);
+		return parser;
+	}
+
+	void ParseTokens(tools::CommandLineParser &opts, const std::string& name, std::unique_ptr<ASTCxxParser>& parser, ParsedFile& result)
+	{
 		std::unique_ptr<ASTDataNode> root(new ASTDataNode);
 		root->SetType(ASTNode::Type::File);
-		root->AddData(opts.names[i]);
+		root->AddData(name);
 
 		ASTCxxParser::ASTPosition position(*parser.get());
 		try
 		{
 			if (parser->Parse(root.get(), position))
 			{
-				// store parser - we need the tokens later
-				lkSuperRoot.lock();
-				parsers.push_back(std::move(parser));
-				rootNode->AddNode(root.release());
-				lkSuperRoot.unlock();
+				// the parser is kept alive for the tokens the tree refers to, drop the rest
+				if (opts.options.find("keep-tokens") == opts.options.end())
+					parser->CompactTokens(root.get(), opts.options.find("keep-comments") != opts.options.end());
+				result.parser = std::move(parser);
+				result.root = std::move(root);
 			}
 			else
-				fprintf(stderr, "Error: Parsing failed.\n");
+				LOG_ERROR(LogCategory::Parser, "Error: Parsing failed.\n");
 
 		}
 		catch (std::exception e)
 		{
-			fprintf(stderr, "Error: Fatal error during parse (line %d): %s\n", position.GetToken().TokenLine, e.what());
+			LOG_ERROR(LogCategory::Parser, "Error: Fatal error during parse (line %d): %s\n", position.GetToken().TokenLine, e.what());
+		}
+	}
+
+#pragma region Pipeline
+	// read -> tokenize -> parse, the stages run on their own threads and are connected by bounded queues
+	struct ReadItem { size_t index; std::string content; };
+	struct TokenizedItem { size_t index; std::unique_ptr<ASTCxxParser> parser; };
+
+	struct StageStats
+	{
+		StageStats(const char* a_name, int a_workers) : name(a_name), workers(a_workers), active(a_workers) {}
+		const char* name;
+		int workers;
+		std::atomic<int> active;			// workers still running, the last one closes the output queue
+		std::atomic<long long> busyMicroseconds{ 0 };
+		std::atomic<int> items{ 0 };
+	};
+
+	static long long MicrosecondsSince(std::chrono::steady_clock::time_point start)
+	{
+		return std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - start).count();
+	}
+
+	// the stages block on their queues, so they run on threads of their own instead of scheduler tasks. The scheduler workers
+	// are idle while the parser runs and the pipeline takes their place: the calling thread reads the files, the other
+	// reader threads, the tokenizers and the parsers share the remaining jobs - 1 of --jobs
+	void ParsePipelined(tools::CommandLineParser& opts, std::vector<ParsedFile>& results, int jobs)
+	{
+		// a tokenizer and a parser next to the reading thread at least
+		int budget = jobs - 1;
+		if (budget < 2)
+		{
+			LOG_INFO(LogCategory::Parser, "[PIPELINE] --jobs=%d is too small for the pipeline, parsing the files one by one\n", jobs);
+			for (size_t i = 0; i < opts.names.size(); i++)
+			{
+				if (!results[i].parser)
+					ParseFile(opts, opts.names[i], results[i]);
+			}
+			return;
+		}
+
+		size_t depth = (size_t)std::max(1LL, opts.intOption("pipeline-depth", 16));
+		std::string ioBackend = opts.optionsWithValues.count("io-backend") ? opts.optionsWithValues["io-backend"].back() : "auto";
+		int readers = (int)std::max(1LL, std::min<long long>(opts.intOption("pipeline-readers", 2), budget - 1));
+		int left = budget - (readers - 1);
+		int tokenizers = (int)std::max(1LL, std::min<long long>(opts.intOption("pipeline-tokenizers", std::max(1, left / 2)), left - 1));
+		int parserThreads = (int)std::max(1LL, std::min<long long>(opts.intOption("pipeline-parsers", left - tokenizers), left - tokenizers));
+
+		// largest files first, so one huge file does not end up last
+		// sources in memory go to the tokenizers right away, the loader reads the files
+		// streams are parsed by the reading thread when the files are read
+		std::vector<size_t> order, memoryOrder, streamOrder;
+		for (auto it : LargestFirst(opts))
+		{
+			if (results[it].parser)
+				continue;
+			if (opts.memorySource(opts.names[it]))
+				memoryOrder.push_back(it);
+			else
+				(IsStream(opts.names[it]) ? streamOrder : order).push_back(it);
+		}
+		std::atomic<size_t> nextRead(0);
+
+		BoundedQueue<ReadItem> readQueue(depth);
+		BoundedQueue<TokenizedItem> tokenizedQueue(depth);
+		StageStats readStats("read", readers), tokenizeStats("tokenize", tokenizers), parseStats("parse", parserThreads);
+
+		auto start = std::chrono::steady_clock::now();
+		std::vector<std::thread> threads;
+
+		// read ahead of the tokenizers, as far as the queue depth allows
+		FileLoader loader(FileLoader::ParseBackend(ioBackend), readers, (size_t)std::max(1LL, opts.intOption("io-batch", 64)));
+		auto read = [&]()
+		{
+			auto busy = std::chrono::steady_clock::now();
+			std::atomic<long long> blockedMicroseconds(0); // the pread backend calls back from several threads
+			auto push = [&](size_t index, std::string&& content)
+			{
+				LOG_INFO(LogCategory::Parser, "[PARSER] Parsing file \"%s\"\n", opts.names[index].c_str());
+				ReadItem item;
+				item.index = index;
+				item.content = std::move(content);
+				readStats.items++;
+
+				// waiting for the tokenizers does not count as busy
+				auto blocked = std::chrono::steady_clock::now();
+				readQueue.Push(std::move(item));
+				blockedMicroseconds += MicrosecondsSince(blocked);
+			};
+			for (auto it : memoryOrder)
+				push(it, std::string());
+			loader.Load(opts.names, order, push);
+			readStats.busyMicroseconds += MicrosecondsSince(busy) - blockedMicroseconds;
+			readQueue.Close();
+		};
+
+		for (int t = 0; t < tokenizers; t++)
+		{
+			threads.push_back(std::thread([&]()
+			{
+				ReadItem item;
+				while (readQueue.Pop(item))
+				{
+					auto busy = std::chrono::steady_clock::now();
+					TokenizedItem tokenized;
+					tokenized.index = item.index;
+					try
+					{
+						auto memory = opts.memorySource(opts.names[item.index]);
+						if (memory)
+							tokenized.parser.reset(Tokenize(opts.names[item.index], memory->data, memory->length));
+						else
+							tokenized.parser.reset(Tokenize(opts.names[item.index], item.content.c_str(), item.content.size()));
+					}
+					catch (const std::exception& e)
+					{
+						LOG_ERROR(LogCategory::Parser, "Error: Fatal error during tokenize of \"%s\": %s\n", opts.names[item.index].c_str(), e.what());
+					}
+					item.content = std::string(); // release the source text before waiting on the queue
+					tokenizeStats.busyMicroseconds += MicrosecondsSince(busy);
+					tokenizeStats.items++;
+					if (tokenized.parser)
+						tokenizedQueue.Push(std::move(tokenized));
+				}
+				if (--tokenizeStats.active == 0)
+					tokenizedQueue.Close();
+			}));
+		}
+
+		for (int t = 0; t < parserThreads; t++)
+		{
+			threads.push_back(std::thread([&]()
+			{
+				TokenizedItem item;
+				while (tokenizedQueue.Pop(item))
+				{
+					auto busy = std::chrono::steady_clock::now();
+					ParseTokens(opts, opts.names[item.index], item.parser, results[item.index]);
+					item.parser.reset();
+					parseStats.busyMicroseconds += MicrosecondsSince(busy);
+					parseStats.items++;
+				}
+			}));
+		}
+
+		read();
+		for (auto it : streamOrder)
+			ParseFile(opts, opts.names[it], results[it]);
+		for (auto& it : threads)
+			it.join();
+
+		// per stage utilization: busy time of all workers compared to the wall time they had available
+		long long wall = std::max(1LL, MicrosecondsSince(start));
+		StageStats* stages[] = { &readStats, &tokenizeStats, &parseStats };
+		LOG_INFO(LogCategory::Parser, "[PIPELINE] io backend: %s\n", FileLoader::BackendName(loader.UsedBackend()));
+		if (loader.UsedBackend() == FileLoader::Backend::IoUring)
+			readStats.workers = 1; // a single thread drives the ring
+		for (auto it : stages)
+		{
+			LOG_INFO(LogCategory::Parser, "[PIPELINE] %-8s %2d worker(s), %4d file(s), busy %8.2f ms, utilization %5.1f%%\n", it->name, it->workers, (int)it->items,
+				it->busyMicroseconds / 1000.0, 100.0 * it->busyMicroseconds / ((double)wall * it->workers));
 		}
+		LOG_INFO(LogCategory::Parser, "[PIPELINE] queue depth %d, read queue peak %d, tokenized queue peak %d, wall %.2f ms\n",
+			(int)depth, (int)readQueue.MaxDepth(), (int)tokenizedQueue.MaxDepth(), wall / 1000.0);
 	}
+#pragma endregion
+
+#pragma region Shards
+	// a file in the pipe of a shard: index, payload length, then the payload (empty when the file could not be parsed)
+	struct ShardFrameHeader { unsigned long long index; unsigned long long length; };
+
+	struct Shard
+	{
+		std::vector<size_t> files;
+		long long sourceBytes = 0;
+		long long receivedBytes = 0;
+		int received = 0;
+		int pid = -1;
+		int fd = -1;
+		std::string buffer;
+	};
 
+#ifdef _WIN32
+	void ParseSharded(tools::CommandLineParser& opts, std::vector<ParsedFile>& results, int shards, TaskScheduler& /*scheduler*/)
+	{
+		LOG_WARNING(LogCategory::Parser, "Warning: --shards needs fork(), which is not supported on this platform. Parsing in this process.\n");
+		for (size_t i = 0; i < opts.names.size(); i++)
+		{
+			if (!results[i].parser)
+				ParseFile(opts, opts.names[i], results[i]);
+		}
+	}
+#else
+	static bool WriteAll(int fd, const char* data, size_t length)
+	{
+		while (length > 0)
+		{
+			ssize_t written = write(fd, data, length);
+			if (written < 0 && errno == EINTR)
+				continue;
+			if (written <= 0)
+				return false;
+			data += written;
+			length -= (size_t)written;
+		}
+		return true;
+	}
+
+	// the forked worker process: parses its files one at a time and sends every file as soon as it is parsed
+	void RunShard(tools::CommandLineParser& opts, const std::vector<size_t>& files, int fd)
+	{
+		for (auto it : files)
+		{
+			ParsedFile file;
+			try
+			{
+				ParseFile(opts, opts.names[it], file);
+			}
+			catch (const std::exception& e)
+			{
+				LOG_ERROR(LogCategory::Parser, "Error: Fatal error during tokenize of \"%s\": %s\n", opts.names[it].c_str(), e.what());
+			}
+
+			std::string frame(sizeof(ShardFrameHeader), '\0');
+			if (file.parser)
+			{
+				try
+				{
+					ASTSerializer::Write(file.parser.get(), file.root.get(), frame);
+				}
+				catch (const std::exception& e)
+				{
+					LOG_ERROR(LogCategory::Parser, "Error: Could not serialize \"%s\": %s\n", opts.names[it].c_str(), e.what());
+					frame.resize(sizeof(ShardFrameHeader));
+				}
+			}
+			ShardFrameHeader header = { it, frame.size() - sizeof(ShardFrameHeader) };
+			memcpy(&frame[0], &header, sizeof(header));
+			if (!WriteAll(fd, frame.c_str(), frame.size()))
+				return;
+		}
+	}
+
+	// --shards=<count>: forked worker processes parse byte balanced subsets of the files and stream them back over pipes,
+	// so the tokens and trees of the parse are spread over several allocators. The files are rebuilt here and attached
+	// to the tree like parsed ones. A file a shard did not deliver (the process died) is parsed in this process.
+	void ParseSharded(tools::CommandLineParser& opts, std::vector<ParsedFile>& results, int shardCount, TaskScheduler& scheduler)
+	{
+		auto start = std::chrono::steady_clock::now();
+
+		// largest files first, each to the shard with the fewest bytes so far
+		// streams stay in this process, they are parsed in a task of the scheduler while the shards run
+		std::vector<long long> sizes = FileSizes(opts);
+		std::vector<size_t> order, streamOrder;
+		for (auto it : LargestFirst(opts))
+		{
+			if (!results[it].parser)
+				(!opts.memorySource(opts.names[it]) && IsStream(opts.names[it]) ? streamOrder : order).push_back(it);
+		}
+		std::vector<Shard> shards((size_t)std::min<long long>(shardCount, (long long)order.size()));
+		for (auto it : order)
+		{
+			Shard* least = &shards[0];
+			for (auto& it2 : shards)
+			{
+				if (it2.sourceBytes < least->sourceBytes)
+					least = &it2;
+			}
+			least->files.push_back(it);
+			least->sourceBytes += sizes[it];
+		}
+
+		std::vector<char> delivered(results.size(), 0);
+		for (size_t s = 0; s < shards.size(); s++)
+		{
+			int fds[2];
+			if (pipe(fds) != 0)
+			{
+				LOG_WARNING(LogCategory::Parser, "Warning: Could not create the pipe of shard %d.\n", (int)s);
+				continue;
+			}
+
+			// buffered output would be written by both processes
+			Log::Flush();
+			fflush(stdout);
+			fflush(stderr);
+			int pid = fork();
+			if (pid == 0)
+			{
+				close(fds[0]);
+				for (size_t s2 = 0; s2 < s; s2++)
+				{
+					if (shards[s2].fd >= 0)
+						close(shards[s2].fd);
+				}
+				RunShard(opts, shards[s].files, fds[1]);
+				close(fds[1]);
+				Log::Flush();
+				_exit(0);
+			}
+			close(fds[1]);
+			if (pid < 0)
+			{
+				LOG_WARNING(LogCategory::Parser, "Warning: Could not start shard %d.\n", (int)s);
+				close(fds[0]);
+				continue;
+			}
+			shards[s].pid = pid;
+			shards[s].fd = fds[0];
+		}
+
+		// without workers the task runs when the pipes are read
+		TaskScheduler::Group streams(scheduler);
+		if (!streamOrder.empty())
+		{
+			streams.Run([&]()
+			{
+				for (auto it : streamOrder)
+					ParseFile(opts, opts.names[it], results[it]);
+			});
+		}
+
+		// read all pipes as the data arrives, the files are rebuilt while the shards still parse
+		for (;;)
+		{
+			std::vector<pollfd> pfds;
+			std::vector<Shard*> polled;
+			for (auto& it : shards)
+			{
+				if (it.fd < 0)
+					continue;
+				pollfd pfd = { it.fd, POLLIN, 0 };
+				pfds.push_back(pfd);
+				polled.push_back(&it);
+			}
+			if (pfds.empty())
+				break;
+			if (poll(pfds.data(), pfds.size(), -1) < 0)
+			{
+				if (errno == EINTR)
+					continue;
+				break;
+			}
+
+			for (size_t p = 0; p < pfds.size(); p++)
+			{
+				if (!pfds[p].revents)
+					continue;
+				Shard& shard = *polled[p];
+				char chunk[65536];
+				ssize_t length = read(shard.fd, chunk, sizeof(chunk));
+				if (length < 0 && errno == EINTR)
+					continue;
+				if (length <= 0)
+				{
+					close(shard.fd);
+					shard.fd = -1;
+					continue;
+				}
+				shard.buffer.append(chunk, (size_t)length);
+				shard.receivedBytes += length;
+
+				size_t consumed = 0;
+				while (shard.buffer.size() - consumed >= sizeof(ShardFrameHeader))
+				{
+					ShardFrameHeader header;
+					memcpy(&header, shard.buffer.c_str() + consumed, sizeof(header));
+					if (shard.buffer.size() - consumed - sizeof(header) < header.length)
+						break;
+					const char* payload = shard.buffer.c_str() + consumed + sizeof(header);
+					consumed += sizeof(header) + (size_t)header.length;
+					if (header.index >= results.size())
+						continue;
+
+					delivered[header.index] = 1;
+					shard.received++;
+					if (header.length == 0)
+						continue; // the shard reported the error
+					try
+					{
+						ASTSerializer::Read(payload, (size_t)header.length, results[header.index].parser, results[header.index].root);
+					}
+					catch (const std::exception& e)
+					{
+						LOG_ERROR(LogCategory::Parser, "Error: Could not read \"%s\" from its shard: %s\n", opts.names[header.index].c_str(), e.what());
+						delivered[header.index] = 0;
+					}
+				}
+				shard.buffer.erase(0, consumed);
+			}
+		}
+
+		streams.Wait();
+		for (size_t s = 0; s < shards.size(); s++)
+		{
+			int status = 0;
+			if (shards[s].pid > 0 && (waitpid(shards[s].pid, &status, 0) < 0 || !WIFEXITED(status) || WEXITSTATUS(status) != 0))
+				LOG_WARNING(LogCategory::Parser, "Warning: Shard %d did not exit cleanly.\n", (int)s);
+			LOG_INFO(LogCategory::Parser, "[SHARDS] shard %d: %4d file(s), %8.1f KB source, %d received, %8.1f KB serialized\n", (int)s, (int)shards[s].files.size(),
+				shards[s].sourceBytes / 1024.0, shards[s].received, shards[s].receivedBytes / 1024.0);
+		}
+
+		int local = 0;
+		for (auto it : order)
+		{
+			if (delivered[it])
+				continue;
+			ParseFile(opts, opts.names[it], results[it]);
+			local++;
+		}
+		if (local > 0)
+			LOG_WARNING(LogCategory::Parser, "Warning: %d file(s) were not delivered by their shard and were parsed in this process.\n", local);
+		LOG_INFO(LogCategory::Parser, "[SHARDS] %d shard(s), %d file(s), wall %.2f ms\n", (int)shards.size(), (int)order.size(), MicrosecondsSince(start) / 1000.0);
+	}
+#endif
+#pragma endregion
+
+#pragma region Streaming
+	// estimated memory of the tokens and the tree per byte of source, measured on the test files
+	static const size_t MemoryPerSourceByte = 64;
+
+	virtual void ExecuteStreaming(tools::CommandLineParser& opts, size_t memoryBudget, TaskScheduler& scheduler, const FileCallback& callback)
+	{
+		LOG_INFO(LogCategory::Parser, "********************* CPP PARSER (%s, STREAMING) ***********************\n", Multithreaded ? "MT" : "ST");
+		if (opts.intOption("shards", 1) > 1)
+			LOG_WARNING(LogCategory::Parser, "Warning: --shards is not used with --stream, the files are parsed in this process.\n");
+
+		std::vector<long long> sizes = FileSizes(opts);
+		std::vector<ParsedFile> results(opts.names.size());
+		std::vector<bool> parsed(opts.names.size(), false);
+		std::mutex lock;
+		std::condition_variable changed;
+		size_t nextFile = 0;
+		size_t inFlight = 0, inFlightPeak = 0;
+		int filesInFlight = 0, filesPeak = 0;
+
+		// files start in command line order once they fit in the budget, a single file may always exceed it
+		auto startNext = [&]() -> size_t
+		{
+			size_t i = nextFile++;
+			inFlight += sizes[i] * MemoryPerSourceByte;
+			inFlightPeak = std::max(inFlightPeak, inFlight);
+			filesPeak = std::max(filesPeak, ++filesInFlight);
+			return i;
+		};
+		auto fits = [&]() { return nextFile < results.size() && (filesInFlight == 0 || inFlight + sizes[nextFile] * MemoryPerSourceByte <= memoryBudget); };
+		auto parse = [&](size_t i)
+		{
+			try
+			{
+				ParseFile(opts, opts.names[i], results[i]);
+			}
+			catch (const std::exception& e)
+			{
+				LOG_ERROR(LogCategory::Parser, "Error: Fatal error during tokenize of \"%s\": %s\n", opts.names[i].c_str(), e.what());
+			}
+		};
+
+		// one parse task per file on the scheduler workers, tasks never wait: a file is started (with the lock held) when a
+		// task finishes or this thread releases a file, as long as it fits in the budget and a worker is free
+		TaskScheduler::Group group(scheduler);
+		int workers = Multithreaded ? scheduler.Jobs() - 1 : 0;
+		int running = 0;
+		std::function<void()> launch = [&]()
+		{
+			while (running < workers && fits())
+			{
+				size_t i = startNext();
+				running++;
+				group.Run([&, i]()
+				{
+					parse(i);
+					{
+						std::lock_guard<std::mutex> lk(lock);
+						parsed[i] = true;
+						running--;
+						launch();
+					}
+					changed.notify_all();
+				});
+			}
+		};
+		{
+			std::lock_guard<std::mutex> lk(lock);
+			launch();
+		}
+
+		// hand the files over in command line order, the tree and the tokens are released right after.
+		// This thread is not a task of the scheduler, so it can wait for the workers (inline parsing without workers).
+		for (size_t i = 0; i < results.size(); i++)
+		{
+			ParsedFile file;
+			{
+				std::unique_lock<std::mutex> lk(lock);
+				if (workers == 0)
+				{
+					startNext();
+					lk.unlock();
+					parse(i);
+					lk.lock();
+				}
+				else
+					changed.wait(lk, [&]() { return parsed[i]; });
+				file = std::move(results[i]);
+			}
+
+			if (file.parser)
+			{
+				AnnotationIndex::Global().Merge(file.parser->Annotations);
+				callback(file.root.release());
+				AnnotationIndex::Global().Remove(file.parser->Annotations);
+			}
+			file.parser.reset();
+
+			{
+				std::lock_guard<std::mutex> lk(lock);
+				inFlight -= sizes[i] * MemoryPerSourceByte;
+				filesInFlight--;
+				launch();
+			}
+		}
+
+		group.Wait();
+
+		LOG_INFO(LogCategory::Parser, "[STREAM] %d file(s), peak in flight %d file(s) / %.1f MB estimated, budget %.1f MB\n",
+			(int)results.size(), filesPeak, inFlightPeak / (1024.0 * 1024.0), memoryBudget / (1024.0 * 1024.0));
+	}
+#pragma endregion
+
+};
+
+class ModuleCppParserEvents : public IModule
+{
+public:
+	// prints the event stream, the parsed particles are released right away (Particle() does not take them)
+	class EventPrinter : public ASTEventConsumer
+	{
+	public:
+		virtual void FileBegin(const ASTEvent& e) { Print("FILE", e, 1); }
+		virtual void FileEnd(const ASTEvent& e) { Print("END_FILE", e, -1); }
+		virtual void NamespaceBegin(const ASTEvent& e) { Print("NAMESPACE", e, 1); }
+		virtual void NamespaceEnd(const ASTEvent& e) { Print("END_NAMESPACE", e, -1); }
+		virtual void ClassBegin(const ASTEvent& e) { Print(e.node->GetTypeString(), e, 1); }
+		virtual void ClassEnd(const ASTEvent& e) { Print("END_CLASS", e, -1); }
+		virtual void Declaration(const ASTEvent& e) { Print("DECLARATION", e, 0); }
+		virtual void EnumBegin(const ASTEvent& e) { Print("ENUM", e, 1); }
+		virtual void EnumValue(const ASTEvent& e) { Print("ENUM_VALUE", e, 0); }
+		virtual void EnumEnd(const ASTEvent& e) { Print("END_ENUM", e, -1); }
+		virtual void Annotation(const ASTEvent& e) { Print("ANNOTATION", e, 0); }
+
+	protected:
+		void Print(const char* what, const ASTEvent& e, int levelChange)
+		{
+			if (levelChange < 0)
+				level--;
+			for (int i = 0; i < level; i++)
+				m_out->Put(' ');
+			if (e.tokens.empty())
+				m_out->Printf("%s %s\n", what, e.node->ToString().c_str());
+			else
+				m_out->Printf("%s %s (lines %d-%d)\n", what, e.node->ToString().c_str(), (int)e.source->Tokens[e.tokens.begin].TokenLine, (int)e.source->Tokens[e.tokens.end - 1].TokenLine);
+			if (levelChange > 0)
+				level++;
+		}
+		int level = 0;
+		OutputSink* m_out = ModuleOutput::Current();
+	};
+
+	virtual void Execute(tools::CommandLineParser& opts, ASTNode* /*rootNode*/, std::vector<std::unique_ptr<ASTCxxParser>>& /*parsers*/, TaskScheduler& /*scheduler*/)
+	{
+		LOG_INFO(LogCategory::Parser, "********************* CPP PARSER (EVENTS) ***********************\n");
+
+		for (size_t i = 0; i < opts.names.size(); i++)
+		{
+			LOG_INFO(LogCategory::Parser, "[PARSER] Parsing file \"%s\"\n", opts.names[i].c_str());
+			// files are read in chunks as well, the parser only holds the tokens of the particles it did not send yet
+			auto memory = opts.memorySource(opts.names[i]);
+			int fd = memory ? -1 : ModuleCppParser::OpenStream(opts.names[i]);
+			if (!memory && fd < 0)
+			{
+				LOG_ERROR(LogCategory::Parser, "Error: Could not open \"%s\".\n", opts.names[i].c_str());
+				continue;
+			}
+			CxxBufferTokenizer bufferTokenizer(opts.names[i], memory ? memory->data : "", memory ? memory->length : 0);
+			CxxStreamTokenizer streamTokenizer(opts.names[i], fd);
+			ASTCxxParser parser(memory ? (CxxTokenizer&)bufferTokenizer : (CxxTokenizer&)streamTokenizer, true);
+
+			ASTDataNode file;
+			file.SetType(ASTNode::Type::File);
+			file.AddData(opts.names[i]);
+
+			EventPrinter printer;
+			ASTCxxParser::ASTPosition position(parser);
+			try
+			{
+				if (!parser.Parse(&file, printer, position))
+					LOG_ERROR(LogCategory::Parser, "Error: Parsing failed.\n");
+			}
+			catch (const std::exception& e)
+			{
+				LOG_ERROR(LogCategory::Parser, "Error: Fatal error during parse (line %d): %s\n", position.GetToken().TokenLine, e.what());
+			}
+			ModuleCppParser::CloseStream(fd);
+		}
+	}
+
+	// parses on its own, the tree is not kept
+	virtual unsigned int Reads() const { return ModuleAccess::Files; }
+	virtual unsigned int Writes() const { return ModuleAccess::Output; }
 };
 
 static ModuleRegistration gModuleParser("cpp_parser", new ModuleCppParser(false));
 static ModuleRegistration gModuleParserMT("cpp_parser_mt", new ModuleCppParser(true) );
-
+static ModuleRegistration gModuleParserEvents("cpp_parser_events", new ModuleCppParserEvents());
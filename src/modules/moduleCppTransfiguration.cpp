@@ -1,21 +1,86 @@
 #include "../modules.h"
 #include "../astProcessor.h"
 #include "../tools.h"
+#include "../symbols.h"
+#include "../taskScheduler.h"
+#include "../log.h"
 
 #include <algorithm>
+#include <unordered_map>
 
 class ModuleCppTransfigure : public IModule
 {
 public:
 	std::vector<ASTNode*> allChildren;
-	std::map<std::string, ASTNode*> allCustomTypes;
+	std::unordered_map<SymbolId, ASTNode*> allCustomTypes;
+
+	// allCustomTypes under every (scope prefix, rest of the name) split of the qualified name: "a::b::C" is found as
+	// ("", "a::b::C"), ("a::", "b::C") and ("a::b::", "C"), so a lookup from a scope combines two ids instead of two strings
+	struct CustomType { ASTNode* node; SymbolId name; };
+	std::unordered_map<unsigned long long, CustomType> scopedCustomTypes;
+
+	static unsigned long long ScopedKey(SymbolId prefix, SymbolId name) { return ((unsigned long long)prefix << 32) | name; }
 
 	struct ScopeResolveTypes
 	{
 		std::vector<ASTNode*> inScopes;
+		std::vector<std::string> inScopePrefixes; // "a::b::" for every entry in inScopes
+		std::vector<SymbolId> inScopePrefixIds;   // interned inScopePrefixes
 		std::vector<std::string> usingNamespaces;
+		std::vector<SymbolId> usingNamespaceIds;  // interned "a::b::" for every entry in usingNamespaces
+		SymbolId context = SymbolTable::Empty; // identifies scope prefix + using namespaces, for the resolve cache
 	};
-	void ResolveTypes(ASTNode* node, ScopeResolveTypes& tscope, bool verbose=false)
+
+	// resolution results per unique type name and scope context
+	struct ResolvedType { ASTNode* node; SymbolId as; };
+	std::unordered_map<unsigned long long, ResolvedType> resolveCache;
+
+	void UpdateScopeContext(ScopeResolveTypes& tscope)
+	{
+		std::string context = tscope.inScopePrefixes.empty() ? std::string() : tscope.inScopePrefixes.back();
+		for (auto& it : tscope.usingNamespaces)
+			context += "|" + it;
+		tscope.context = SymbolTable::Global().Intern(context);
+	}
+
+	ASTNode* FindCustomType(SymbolId prefix, SymbolId name, SymbolId& outSymbol)
+	{
+		auto found = scopedCustomTypes.find(ScopedKey(prefix, name));
+		if (found == scopedCustomTypes.end())
+			return 0;
+		outSymbol = found->second.name;
+		return found->second.node;
+	}
+
+	void IndexCustomTypes()
+	{
+		scopedCustomTypes.clear();
+		for (auto& it : allCustomTypes)
+		{
+			CustomType type = { it.second, it.first };
+			if (it.first != SymbolTable::Empty)
+				scopedCustomTypes[ScopedKey(SymbolTable::Empty, it.first)] = type;
+
+			// split after every "::" outside of template arguments
+			std::string name = symbols::Lookup(it.first);
+			int depth = 0;
+			for (size_t i = 0; i + 1 < name.size(); i++)
+			{
+				if (name[i] == '<')
+					depth++;
+				else if (name[i] == '>')
+					depth--;
+				else if (depth == 0 && name[i] == ':' && name[i + 1] == ':')
+				{
+					SymbolId prefix = SymbolTable::Global().Intern(name.c_str(), i + 2);
+					SymbolId rest = SymbolTable::Global().Intern(name.c_str() + i + 2, name.size() - i - 2);
+					scopedCustomTypes[ScopedKey(prefix, rest)] = type;
+					i++;
+				}
+			}
+		}
+	}
+	void ResolveTypes(ASTNode* node, ScopeResolveTypes& tscope)
 	{
 #		define LOCATIONINFO " (line %d, source \"%s\").\n"
 #		define LOCATIONINFODATA  nodeType->tokenSource->Tokens[nodeType->typeName[0].Index].TokenLine, nodeType->tokenSource->SourceIdentifier()
@@ -24,83 +89,87 @@ public:
 		if (nodeType && nodeType->HasType() && nodeType->IsBuiltinType() == false)
 		{
 
-			bool typeNameFromRoot = false;
+			// a name from the root ("::a::b") is reported without the leading "::"
 			std::string typeName = nodeType->ToNameString(false);
 			if (typeName.size() >= 2 && typeName.at(0) == ':' && typeName.at(1) == ':')
-			{
-				typeNameFromRoot = true;
 				typeName.erase(typeName.begin(), typeName.begin() + 2);
-			}
 
-			if (verbose)
+			// every resolution, built only when it is logged
+			std::string trace;
+			bool traceResolve = LOG_ENABLED(LogCategory::Transfigure, LogLevel::Trace);
+			if (traceResolve)
 			{
-				fprintf(stderr, "RESOLVE ");
 				for (auto it : tscope.usingNamespaces)
-					fprintf(stderr, "{%s} ", it.c_str());
+					trace += "{" + it + "} ";
 				for (auto it : tscope.inScopes)
-					fprintf(stderr, "[%s] ", it->ToString().c_str());
-				fprintf(stderr, "%s", nodeType->ToNameString().c_str());
-
+					trace += "[" + it->ToString() + "] ";
+				trace += nodeType->ToNameString();
 			}
 
-			// check if name points directly to node
-			std::string resolvedAs;
-			//if (typeNameFromRoot)
+			// check the cache - identical type names resolve identically within the same scope context
+			SymbolId resolvedAs = SymbolTable::Empty;
+			nodeType->resolvedType = 0; // a tree that is transfigured again (--serve) must not keep links into replaced files
+			SymbolId nameSymbol = SymbolTable::Global().Intern(typeName);
+			unsigned long long cacheKey = ((unsigned long long)tscope.context << 32) | nameSymbol;
+			auto cached = resolveCache.find(cacheKey);
+			if (cached != resolveCache.end())
 			{
+				if (cached->second.node)
+					nodeType->resolvedType = cached->second.node;
+				resolvedAs = cached->second.as;
+			}
+			else
+			{
+				// check if name points directly to node
 
 				// try to find directly
-				if (resolvedAs.empty())
+				if (resolvedAs == SymbolTable::Empty)
 				{
-					auto found = allCustomTypes.find(typeName);
-					if (found != allCustomTypes.end())
-					{
-						nodeType->resolvedType = found->second;
-						resolvedAs = found->first;
-					}
+					ASTNode* found = FindCustomType(SymbolTable::Empty, nameSymbol, resolvedAs);
+					if (found)
+						nodeType->resolvedType = found;
 				}
 				
 				// go backwards over scopes and try to find that way
-				if (resolvedAs.empty())
+				if (resolvedAs == SymbolTable::Empty)
 				{
-					for (int i = tscope.inScopes.size() - 1; i >= 0; i--)
+					for (int i = tscope.inScopePrefixes.size() - 1; i >= 0; i--)
 					{
-						std::string prefix;
-						for (int j = 0; j <= i; j++)
-							prefix += tscope.inScopes[j]->ToString() + "::";
-
-						auto found = allCustomTypes.find(prefix + typeName);
-						if (found != allCustomTypes.end())
+						ASTNode* found = FindCustomType(tscope.inScopePrefixIds[i], nameSymbol, resolvedAs);
+						if (found)
 						{
-							nodeType->resolvedType = found->second;
-							resolvedAs = found->first;
+							nodeType->resolvedType = found;
 							break;
 						}
 					}
 				}
 
 				// try finding with "using namespace"
-				if (resolvedAs.empty())
+				if (resolvedAs == SymbolTable::Empty)
 				{
 					for (int i = 0; i < tscope.usingNamespaces.size(); i++)
 					{
-
-						auto found = allCustomTypes.find(tscope.usingNamespaces[i] + "::" + typeName);
-						if (found != allCustomTypes.end())
+						SymbolId foundAs = SymbolTable::Empty;
+						ASTNode* found = FindCustomType(tscope.usingNamespaceIds[i], nameSymbol, foundAs);
+						if (found)
 						{
-							if (resolvedAs.empty() == false)
-								fprintf(stderr, "Warning: Ambiguous \"using namespace\" detected during type resolve: \"%s\" could also be \"%s\". Using latter." LOCATIONINFO, resolvedAs.c_str(), found->first.c_str(), LOCATIONINFODATA);
-							nodeType->resolvedType = found->second;
-							resolvedAs = found->first;
+							if (resolvedAs != SymbolTable::Empty)
+								LOG_WARNING(LogCategory::Transfigure, "Warning: Ambiguous \"using namespace\" detected during type resolve: \"%s\" could also be \"%s\". Using latter." LOCATIONINFO, symbols::Lookup(resolvedAs).c_str(), symbols::Lookup(foundAs).c_str(), LOCATIONINFODATA);
+							nodeType->resolvedType = found;
+							resolvedAs = foundAs;
 						}
 					}
 				}
+
+				ResolvedType result = { resolvedAs != SymbolTable::Empty ? nodeType->resolvedType : 0, resolvedAs };
+				resolveCache[cacheKey] = result;
 			}
 
-			if (verbose)
-				fprintf(stderr, " AS \"%s\"\n", resolvedAs.c_str());
+			if (traceResolve)
+				LOG_TRACE(LogCategory::Transfigure, "RESOLVE %s AS \"%s\"\n", trace.c_str(), symbols::Lookup(resolvedAs).c_str());
 
-			if (resolvedAs.empty() && nodeType->GetType() != ASTNode::Type::TemplateArg)
-				fprintf(stderr, "Warning: Type \"%s\" could not be resolved " LOCATIONINFO, typeName.c_str(), LOCATIONINFODATA);
+			if (resolvedAs == SymbolTable::Empty && nodeType->GetType() != ASTNode::Type::TemplateArg)
+				LOG_WARNING(LogCategory::Transfigure, "Warning: Type \"%s\" could not be resolved " LOCATIONINFO, typeName.c_str(), LOCATIONINFODATA);
 #		undef LOCATIONINFO
 #		undef LOCATIONINFODATA
 		}
@@ -116,9 +185,10 @@ public:
 			isScope = true;
 			break;
 		case ASTNode::Type::NamespaceUsing:
-			if (verbose)
-				fprintf(stderr, "USING NAMESPACE %s\n", node->ToString().c_str());
+			LOG_TRACE(LogCategory::Transfigure, "USING NAMESPACE %s\n", node->ToString().c_str());
 			tscope.usingNamespaces.push_back(node->ToString());
+			tscope.usingNamespaceIds.push_back(SymbolTable::Global().Intern(node->ToString() + "::"));
+			UpdateScopeContext(tscope);
 			return; // has no subchildren
 			
 		}
@@ -128,12 +198,17 @@ public:
 			ScopeResolveTypes subscope = tscope;
 
 			if (node->GetType() != ASTNode::Type::File)
+			{
 				subscope.inScopes.push_back(node);
+				subscope.inScopePrefixes.push_back((tscope.inScopePrefixes.empty() ? std::string() : tscope.inScopePrefixes.back()) + node->ToString() + "::");
+				subscope.inScopePrefixIds.push_back(SymbolTable::Global().Intern(subscope.inScopePrefixes.back()));
+				UpdateScopeContext(subscope);
+			}
 
 			auto& children = node->Children();
 			for (size_t i = 0; i < children.size(); i++)
 			{
-				ResolveTypes(children[i], subscope, verbose);
+				ResolveTypes(children[i], subscope);
 			}
 
 		}
@@ -142,14 +217,27 @@ public:
 			auto& children = node->Children();
 			for (size_t i = 0; i < children.size(); i++)
 			{
-				ResolveTypes(children[i], tscope, verbose);
+				ResolveTypes(children[i], tscope);
 			}
 		}
 	}
-	void CollectCustomTypes_Structures(bool verbose=false)
+	// qualified names only read the tree, they are built in parallel and added in tree order afterwards
+	template<typename NameOf>
+	static std::vector<std::string> QualifiedNames(const std::vector<ASTNode*>& nodes, TaskScheduler& scheduler, NameOf nameOf)
+	{
+		std::vector<std::string> ret(nodes.size());
+		scheduler.ParallelFor(0, nodes.size(), 256, [&](size_t begin, size_t end)
+		{
+			for (size_t i = begin; i < end; i++)
+				ret[i] = nameOf(nodes[i]);
+		});
+		return ret;
+	}
+
+	void CollectCustomTypes_Structures(TaskScheduler& scheduler)
 	{
 		auto structures = tools::LINQSelect(allChildren, [](ASTNode* it) { return it->GetType() >= ASTNode::Type::Class && it->GetType() <= ASTNode::Type::UnionFwdDcl; });
-		for (auto it : structures)
+		auto names = QualifiedNames(structures, scheduler, [](ASTNode* it)
 		{
 			auto parents = it->GatherParents();
 			auto scopes = tools::LINQSelect(parents, [](ASTNode* it) { return it->GetType() == ASTNode::Type::Namespace || it->GetType() == ASTNode::Type::Template || (it->GetType() >= ASTNode::Type::Class && it->GetType() <= ASTNode::Type::Union); });
@@ -165,16 +253,17 @@ public:
 				v.append("::");
 			}
 			v.append(it->ToString());
-			if (verbose)
-			{
-				fprintf(stderr, "CollectCustomType_Structure: %s\n", v.c_str());
-			}
-			
+			return v;
+		});
 
-			CollectCustomTypes_AddBoth(v, it);
+		for (size_t i = 0; i < structures.size(); i++)
+		{
+			LOG_DEBUG(LogCategory::Transfigure, "CollectCustomType_Structure: %s\n", names[i].c_str());
+
+			CollectCustomTypes_AddBoth(names[i], structures[i]);
 		}
 	}
-	void CollectCustomTypes_Typedefs(bool verbose = false)
+	void CollectCustomTypes_Typedefs()
 	{
 		auto typedefs = tools::LINQSelect(allChildren, [](ASTNode* it) { return it->GetType() == ASTNode::Type::TypedefSub; });
 		for (auto it : typedefs)
@@ -193,26 +282,29 @@ public:
 				v.append("::");
 			}
 			v.append(it->ToString());
-			if (verbose)
-			{
-				fprintf(stderr, "CollectCustomType_Typedef: %s\n", v.c_str());
-			}
+			LOG_DEBUG(LogCategory::Transfigure, "CollectCustomType_Typedef: %s\n", v.c_str());
 
 
 			CollectCustomTypes_AddBoth(v, it);
 		}
 	}
-	void CollectCustomTypes_TemplateArguments(bool verbose = false)
+	void CollectCustomTypes_TemplateArguments(TaskScheduler& scheduler)
 	{
-		auto templateArguments = tools::LINQSelect(allChildren, [](ASTNode* it) { return it->GetType() == ASTNode::Type::TemplateArg; });
-		for (auto it : templateArguments)
+		std::vector<ASTNode*> templateArguments;
+		for (auto it : allChildren)
 		{
+			if (it->GetType() != ASTNode::Type::TemplateArg)
+				continue;
 			ASTType* itType = (ASTType*)it;
 			if (itType->ToIdentifierString().empty() == false)
 				continue; // template argument does not define a type
 			if (itType->HasModifier(CxxToken::Type::Class) == false && itType->HasModifier(CxxToken::Type::Typename))
 				continue; // template argument does not have "class" or "typename"
+			templateArguments.push_back(it);
+		}
 
+		auto names = QualifiedNames(templateArguments, scheduler, [](ASTNode* it)
+		{
 			auto parents = it->GatherParents();
 			auto scopes = tools::LINQSelect(parents, [](ASTNode* it) { return it->GetType() == ASTNode::Type::Namespace || it->GetType() == ASTNode::Type::Template || (it->GetType() >= ASTNode::Type::Class && it->GetType() <= ASTNode::Type::Union); });
 			std::reverse(scopes.begin(), scopes.end());
@@ -224,14 +316,15 @@ public:
 				v.append("::");
 			}
 
-			v.append(itType->ToNameString());
-			if (verbose)
-			{
-				fprintf(stderr, "CollectCustomType_TemplateArgument: %s\n", v.c_str());
-			}
+			v.append(((ASTType*)it)->ToNameString());
+			return v;
+		});
 
+		for (size_t i = 0; i < templateArguments.size(); i++)
+		{
+			LOG_DEBUG(LogCategory::Transfigure, "CollectCustomType_TemplateArgument: %s\n", names[i].c_str());
 
-			CollectCustomTypes_Add(v, it);
+			CollectCustomTypes_Add(names[i], templateArguments[i]);
 		}
 	}
 
@@ -268,20 +361,20 @@ public:
 
 	void CollectCustomTypes_Add(const std::string &v, ASTNode* it)
 	{
-		auto& currentMapping = allCustomTypes[v];
+		auto& currentMapping = allCustomTypes[SymbolTable::Global().Intern(v)];
 		if (currentMapping != 0)
 		{
 			if (currentMapping->GetType() >= ASTNode::Type::Class && currentMapping->GetType() <= ASTNode::Type::Union)
 			{
-				fprintf(stderr, "Warning: Identifier intersects with class/struct/union \"%s\" - overwriting mapping.\n", v.c_str());
+				LOG_WARNING(LogCategory::Transfigure, "Warning: Identifier intersects with class/struct/union \"%s\" - overwriting mapping.\n", v.c_str());
 			}
 			else if (currentMapping->GetType() == ASTNode::Type::TypedefSub)
 			{
-				fprintf(stderr, "Warning: Identifier intersects with typedef \"%s\" - overwriting mapping.\n", v.c_str());
+				LOG_WARNING(LogCategory::Transfigure, "Warning: Identifier intersects with typedef \"%s\" - overwriting mapping.\n", v.c_str());
 			}
 			else if (currentMapping->GetType() == ASTNode::Type::TemplateArg)
 			{
-				fprintf(stderr, "Warning: Identifier intersects with template argument \"%s\" - overwriting mapping.\n", v.c_str());
+				LOG_WARNING(LogCategory::Transfigure, "Warning: Identifier intersects with template argument \"%s\" - overwriting mapping.\n", v.c_str());
 			}
 
 		}
@@ -289,6 +382,26 @@ public:
 	}
 
 
+	// same order as GatherChildrenRecursively(), the files are gathered in parallel
+	static std::vector<ASTNode*> GatherChildren(ASTNode* rootNode, TaskScheduler& scheduler)
+	{
+		auto& files = rootNode->Children();
+		std::vector<std::vector<ASTNode*>> perFile(files.size());
+		scheduler.ParallelFor(0, files.size(), 1, [&](size_t begin, size_t end)
+		{
+			for (size_t i = begin; i < end; i++)
+				perFile[i] = files[i]->GatherChildrenRecursively();
+		});
+
+		std::vector<ASTNode*> ret;
+		for (size_t i = 0; i < files.size(); i++)
+		{
+			ret.push_back(files[i]);
+			ret.insert(ret.end(), perFile[i].begin(), perFile[i].end());
+		}
+		return ret;
+	}
+
 	void UnanonimizeNamespaces()
 	{
 		auto namespaces = tools::LINQSelect(allChildren, [](ASTNode* it) { return it->GetType() == ASTNode::Type::Namespace; });
@@ -344,18 +457,25 @@ public:
 			}
 		}
 	}
-	virtual void Execute(tools::CommandLineParser& cmdOpts, ASTNode* rootNode, std::vector<std::unique_ptr<ASTCxxParser>>& parsers)
+	virtual void Execute(tools::CommandLineParser& cmdOpts, ASTNode* rootNode, std::vector<std::unique_ptr<ASTCxxParser>>& parsers, TaskScheduler& scheduler)
 	{
 
-		fprintf(stderr, "********************* CPP TRANSFIGURATION ***********************\n");
-		allChildren = rootNode->GatherChildrenRecursively();
+		LOG_INFO(LogCategory::Transfigure, "********************* CPP TRANSFIGURATION ***********************\n");
+		allChildren = GatherChildren(rootNode, scheduler);
+		allCustomTypes.clear(); // the module is run again on a new tree by the embedding API
+		resolveCache.clear();
 		UnanonimizeNamespaces();
 		UnanonimizeTemplates();
-		CollectCustomTypes_Structures(true);
-		CollectCustomTypes_TemplateArguments(true);
-		{ ScopeResolveTypes srt; ResolveTypes(rootNode, srt, true); } 
+		CollectCustomTypes_Structures(scheduler);
+		CollectCustomTypes_TemplateArguments(scheduler);
+		IndexCustomTypes();
+		{ ScopeResolveTypes srt; ResolveTypes(rootNode, srt); }
 	}
 
+	// renames anonymous namespaces and templates in the tree, and links the types to their declarations
+	virtual unsigned int Reads() const { return ModuleAccess::AST; }
+	virtual unsigned int Writes() const { return ModuleAccess::AST; }
+
 };
 
 static ModuleRegistration gModulePrintStructure("cpp_transfigure", new ModuleCppTransfigure());
@@ -1,17 +1,29 @@
 #include "../modules.h"
 #include "../astProcessor.h"
 #include "../tools.h"
+#include "../cxxAstParser.h"
+#include "../astVisitor.h"
+#include "../log.h"
+
+#ifdef ALLOC_STATS_ENABLED
+#include <atomic>
+#include <new>
+#endif
 
 #pragma region ModulePrintAST
 class ModulePrintAST: public IModule
 {
 public:
-	virtual void Execute(tools::CommandLineParser& cmdOpts, ASTNode* rootNode, std::vector<std::unique_ptr<ASTCxxParser>>& parsers)
+	virtual void Execute(tools::CommandLineParser& cmdOpts, ASTNode* rootNode, std::vector<std::unique_ptr<ASTCxxParser>>& parsers, TaskScheduler& scheduler)
 	{
-		fprintf(stderr, "********************* PRINT AST ***********************\n");
-		ASTProcessor::Print(stdout, rootNode);
+		LOG_INFO(LogCategory::General, "********************* PRINT AST ***********************\n");
+		// the files are rendered in parallel
+		ASTProcessor::Print(ModuleOutput::Current(), rootNode, scheduler);
 	}
 
+	virtual unsigned int Reads() const { return ModuleAccess::AST; }
+	virtual unsigned int Writes() const { return ModuleAccess::Output; }
+
 };
 
 static ModuleRegistration gModulePrintAST("print_ast", new ModulePrintAST());
@@ -20,70 +32,54 @@ static ModuleRegistration gModulePrintAST("print_ast", new ModulePrintAST());
 
 #pragma region ModulePrintStructure
 
-class ModulePrintStructure : public IModule
+class ModulePrintStructure : public VisitorModule
 {
 public:
-
-	void WalkAST(ASTNode* node, int level = 0)
+	class Visitor : public ASTVisitor
 	{
-		int levelIncrement = 0;
-
-		if (node->GetType() == ASTNode::Type::Root ||
-			node->GetType() == ASTNode::Type::File ||
-			node->GetType() == ASTNode::Type::Class ||
-			node->GetType() == ASTNode::Type::Struct ||
-			node->GetType() == ASTNode::Type::Union ||
-			node->GetType() == ASTNode::Type::Template ||
-			node->GetType() == ASTNode::Type::Namespace ||
-			node->GetType() == ASTNode::Type::Inherit ||
-			node->GetType() == ASTNode::Type::Parent ||
-			node->GetType() == ASTNode::Type::Public ||
-			node->GetType() == ASTNode::Type::Private ||
-			node->GetType() == ASTNode::Type::Protected ||
-			node->GetType() == ASTNode::Type::Friend ||		// Sup
-			node->GetType() == ASTNode::Type::Using ||
-			node->GetType() == ASTNode::Type::NamespaceUsing ||
-			node->GetType() == ASTNode::Type::Instances ||
-			node->GetType() == ASTNode::Type::Friend ||		// Hi friend
-			node->GetType() == ASTNode::Type::Typedef ||
-			node->GetType() == ASTNode::Type::TypedefHead ||
-			node->GetType() == ASTNode::Type::TypedefSub ||
-			//node->GetType() == ASTNode::Type::AntFwd ||
-			//node->GetType() == ASTNode::Type::AntBack ||
-			node->GetType() == ASTNode::Type::ArgDcl ||
-			node->GetType() == ASTNode::Type::DclHead ||
-			node->GetType() == ASTNode::Type::DclSub)
+	public:
+		Visitor()
 		{
-			for (int i = 0; i < level; i++)
-				putc(' ', stdout);
+			SetFilter({ ASTNode::Type::Root, ASTNode::Type::File, ASTNode::Type::Class, ASTNode::Type::Struct, ASTNode::Type::Union,
+				ASTNode::Type::Template, ASTNode::Type::Namespace, ASTNode::Type::Inherit, ASTNode::Type::Parent,
+				ASTNode::Type::Public, ASTNode::Type::Private, ASTNode::Type::Protected, ASTNode::Type::Friend,
+				ASTNode::Type::Using, ASTNode::Type::NamespaceUsing, ASTNode::Type::Instances,
+				ASTNode::Type::Typedef, ASTNode::Type::TypedefHead, ASTNode::Type::TypedefSub,
+				ASTNode::Type::ArgDcl, ASTNode::Type::DclHead, ASTNode::Type::DclSub });
+		}
 
+		virtual void Begin(ASTNode* /*root*/)
+		{
+			LOG_INFO(LogCategory::General, "********************* PRINT STRUCTURE ***********************\n");
+		}
 
+		virtual bool Pre(ASTNode* node)
+		{
+			for (int i = 0; i < level; i++)
+				m_out->Put(' ');
 
 			std::string annotationTypes;
 			if (node->GetType() == ASTNode::Type::Class || node->GetType() == ASTNode::Type::DclSub)
 			{
-				auto annotations = node->GatherAnnotations();
-				for (auto it : annotations)
+				for (auto it : node->Annotations())
 					annotationTypes += "[" + it->ToString() + "] ";
 			}
 
-			printf("%s %s %s\n", node->GetTypeString(), node->ToString().c_str(), annotationTypes.c_str());
-			levelIncrement++;
+			m_out->Printf("%s %s %s\n", node->GetTypeString(), node->ToString().c_str(), annotationTypes.c_str());
+			level++;
+			return true;
 		}
 
+		virtual void Post(ASTNode* /*node*/) { level--; }
 
-		auto& children = node->Children();
-		for (size_t i = 0; i < children.size(); i++)
-		{
-			WalkAST(children[i], level + levelIncrement);
-		}
-	}
-	virtual void Execute(tools::CommandLineParser& cmdOpts, ASTNode* rootNode, std::vector<std::unique_ptr<ASTCxxParser>>& parsers)
-	{
-		fprintf(stderr, "********************* PRINT STRUCTURE ***********************\n");
-		WalkAST(rootNode);
-	}
 
+	protected:
+		int level = 0;
+		OutputSink* m_out = ModuleOutput::Current();
+	};
+
+	virtual ASTVisitor* CreateVisitor(tools::CommandLineParser& cmdOpts, std::vector<std::unique_ptr<ASTCxxParser>>& parsers) { return new Visitor(); }
+	virtual bool VisitsPerFile() const { return true; }
 };
 
 static ModuleRegistration gModulePrintStructure("print_structure", new ModulePrintStructure());
@@ -93,27 +89,136 @@ static ModuleRegistration gModulePrintStructure("print_structure", new ModulePri
 #pragma region ModulePrintTypes
 
 
-class ModulePrintTypes : public IModule
+class ModulePrintTypes : public VisitorModule
 {
 public:
-	virtual void Execute(tools::CommandLineParser& cmdOpts, ASTNode* rootNode, std::vector<std::unique_ptr<ASTCxxParser>>& parsers)
+	class Visitor : public ASTVisitor
 	{
-		fprintf(stderr, "********************* PRINT TYPES ***********************\n");
+	public:
+		virtual void Begin(ASTNode* /*root*/)
+		{
+			LOG_INFO(LogCategory::General, "********************* PRINT TYPES ***********************\n");
+		}
 
-		auto allChildren = rootNode->GatherChildrenRecursively();
-		auto typeChildren = tools::LINQSelect(allChildren, [](ASTNode* it) { return dynamic_cast<ASTType*>(it) != nullptr; });
+		virtual bool Pre(ASTNode* node)
+		{
+			ASTType* itType = dynamic_cast<ASTType*>(node);
+			if (itType)
+			{
+				std::string header; ASTNode* nd = itType; while (nd) { header += " "; nd = nd->GetParent(); }
+				m_out->Printf("(%s) %s %s\n", itType->ToNameString().c_str(), header.c_str(), itType->ToString().c_str());
+			}
+			return true;
+		}
+
+
+	protected:
+		OutputSink* m_out = ModuleOutput::Current();
+	};
+
+	virtual ASTVisitor* CreateVisitor(tools::CommandLineParser& cmdOpts, std::vector<std::unique_ptr<ASTCxxParser>>& parsers) { return new Visitor(); }
+	virtual bool VisitsPerFile() const { return true; }
+};
+
+static ModuleRegistration gModulePrintTypes("print_types", new ModulePrintTypes());
+#pragma endregion
+
+#pragma region ModulePrintAnnotations
 
-		for (auto& it : typeChildren)
+class ModulePrintAnnotations : public IModule
+{
+public:
+	virtual void Execute(tools::CommandLineParser& /*cmdOpts*/, ASTNode* /*rootNode*/, std::vector<std::unique_ptr<ASTCxxParser>>& /*parsers*/, TaskScheduler& /*scheduler*/)
+	{
+		LOG_INFO(LogCategory::General, "********************* PRINT ANNOTATIONS ***********************\n");
+
+		OutputSink* out = ModuleOutput::Current();
+		auto& index = AnnotationIndex::Global();
+		for (auto name : index.Names())
 		{
-			ASTNode* itNode = it;
-			ASTType* itType = reinterpret_cast<ASTType*>(itNode);
-			std::string header; ASTNode* nd = itType; while (nd) { header += " "; nd = nd->GetParent(); }
-			printf("(%s) %s %s\n",itType->ToNameString().c_str(), header.c_str(), itType->ToString().c_str());
+			out->Printf("%s\n", symbols::Lookup(name).c_str());
+			for (auto& it : index.Find(name))
+			{
+				std::string arguments;
+				for (auto itArg : it.arguments)
+				{
+					if (!arguments.empty())
+						arguments += ", ";
+					itArg->AppendToString(arguments);
+				}
+				out->Printf("  %s %s (%s)\n", it.target->GetTypeString(), it.target->ToString().c_str(), arguments.c_str());
+			}
+		}
+	}
+
+	virtual unsigned int Reads() const { return ModuleAccess::AST; }
+	virtual unsigned int Writes() const { return ModuleAccess::Output; }
+
+};
+
+static ModuleRegistration gModulePrintAnnotations("print_annotations", new ModulePrintAnnotations());
+#pragma endregion
+
+#pragma region ModulePrintAllocStats
+
+#ifdef ALLOC_STATS_ENABLED
+// process wide allocation counters (replaces global new/delete, only compiled in with premake --alloc-stats)
+static std::atomic<size_t> gAllocCount(0);
+static std::atomic<size_t> gAllocBytes(0);
+
+void* operator new(size_t size)
+{
+	gAllocCount++;
+	gAllocBytes += size;
+	void* ptr = malloc(size ? size : 1);
+	if (ptr == 0)
+		throw std::bad_alloc();
+	return ptr;
+}
+void* operator new[](size_t size) { return operator new(size); }
+void operator delete(void* ptr) noexcept { free(ptr); }
+void operator delete[](void* ptr) noexcept { free(ptr); }
+void operator delete(void* ptr, size_t) noexcept { free(ptr); }
+void operator delete[](void* ptr, size_t) noexcept { free(ptr); }
+#endif
+
+// keeps the conservative access of IModule: the allocation counters are process wide, so nothing may run next to it
+class ModulePrintAllocStats : public IModule
+{
+public:
+	virtual void Execute(tools::CommandLineParser& cmdOpts, ASTNode* rootNode, std::vector<std::unique_ptr<ASTCxxParser>>& parsers, TaskScheduler& scheduler)
+	{
+		LOG_INFO(LogCategory::General, "********************* PRINT ALLOC STATS ***********************\n");
+		OutputSink* out = ModuleOutput::Current();
+#ifdef ALLOC_STATS_ENABLED
+		// sample before gathering nodes, so only the allocations of the previous modules are counted
+		unsigned long long allocs = gAllocCount, bytes = gAllocBytes;
+#endif
+
+		size_t tokens = 0;
+		for (auto& it : parsers)
+			tokens += it->Tokens.size();
 
+		auto allChildren = rootNode->GatherChildrenRecursively();
+		size_t declarations = 0;
+		for (auto it : allChildren)
+		{
+			if (dynamic_cast<ASTType*>(it) != nullptr)
+				declarations++;
 		}
+
+#ifdef ALLOC_STATS_ENABLED
+		out->Printf("allocations: %llu (%llu bytes)\n", allocs, bytes);
+		out->Printf("tokens: %d, nodes: %d, declarations: %d\n", (int)tokens, (int)allChildren.size(), (int)declarations);
+		if (declarations > 0)
+			out->Printf("allocations per declaration: %.2f\n", (double)allocs / (double)declarations);
+#else
+		out->Printf("tokens: %d, nodes: %d, declarations: %d\n", (int)tokens, (int)allChildren.size(), (int)declarations);
+		LOG_WARNING(LogCategory::General, "Warning: allocation counting is not compiled in (generate with premake --alloc-stats).\n");
+#endif
 	}
 
 };
 
-static ModuleRegistration gModulePrintTypes("print_types", new ModulePrintTypes());
-#pragma endregion
\ No newline at end of file
+static ModuleRegistration gModulePrintAllocStats("print_alloc_stats", new ModulePrintAllocStats());
+#pragma endregion
@@ -1,9 +1,15 @@
 #include <stdio.h>
 #include "../modules.h"
 #include "../ast.h"
+#include "../astVisitor.h"
+#include "../log.h"
+#include "../annotationIndex.h"
+#include "../tools.h"
+#include <deque>
+#include <unordered_set>
 #include <stdarg.h>
 
-class ModuleReflectionDataGenerator : public IModule
+class ReflectionDataVisitor : public ASTVisitor
 {
 public:
 	struct StateDefinition
@@ -29,10 +35,33 @@ public:
 		StructureScope* StructScope = 0;
 	};
 
+	State stateData;
+	State* state = &stateData;
+	std::string data;
+	std::deque<StructureScope> scopes; // Root, Class and Struct open a scope
+
 
 
 	int vCount = 0;
-	
+	std::string identifier; // reused buffers for member identifiers and types
+	std::string typeName;
+	OutputSink* m_out = ModuleOutput::Current();
+
+	// --reflect-annotation: only classes with this annotation are reflected, looked up in the annotation index per file
+	SymbolId m_annotation = SymbolTable::Empty;
+	std::unordered_set<const ASTNode*> m_annotated;
+
+	ReflectionDataVisitor(tools::CommandLineParser& cmdOpts)
+	{
+		auto found = cmdOpts.optionsWithValues.find("reflect-annotation");
+		if (found != cmdOpts.optionsWithValues.end() && !found->second.empty())
+			m_annotation = SymbolTable::Global().Intern(found->second.back());
+	}
+
+	bool Reflected(ASTNode* node) const
+	{
+		return m_annotation == SymbolTable::Empty || m_annotated.count(node) > 0;
+	}
 
 	std::string intToString(int vv)
 	{
@@ -62,24 +91,49 @@ public:
 		return str;
 	}
 
-	void Traverse(State* state, ASTNode* node)
+	virtual void Begin(ASTNode* /*root*/)
+	{
+		LOG_INFO(LogCategory::General, "********************* REFLECTOR ***********************\n");
+		state->Data = &data;
+	}
+
+	virtual void End(ASTNode* /*root*/)
+	{
+		m_out->Write(data);
+	}
+
+	void PushScope()
+	{
+		scopes.push_back(StructureScope());
+		state->StructScope = &scopes.back();
+	}
+
+	void PopScope()
+	{
+		scopes.pop_back();
+		state->StructScope = scopes.empty() ? 0 : &scopes.back();
+	}
+
+	virtual bool Pre(ASTNode* node)
 	{
 		bool recurse = true;
-		
-		StructureScope scope;
-		StructureScope* backup;
-		// PRE
+
 		switch (node->GetType())
 		{
 		case ASTNode::Type::Root:
 			*state->Data += string_format("namespace reflector {\n");
-			backup = state->StructScope;
-			state->StructScope = &scope;
+			PushScope();
 			state->StructScope->Name = "~ROOT~";
 
 			break;
 		case ASTNode::Type::File:
 			*state->Data += string_format("// FILE: \"%s\"\n", node->ToString().c_str());
+			// streamed files are only in the index while they are visited
+			if (m_annotation != SymbolTable::Empty)
+			{
+				m_annotated.clear();
+				AnnotationIndex::Global().ForEach(m_annotation, [&](const AnnotationIndex::Entry& e) { m_annotated.insert(e.target); });
+			}
 			break;
 		case ASTNode::Type::Namespace:
 			*state->Data += string_format("// NAMESPACE: \"%s\"\n", node->ToString().c_str());
@@ -95,8 +149,13 @@ public:
 			break;
 		case ASTNode::Type::Class:
 		case ASTNode::Type::Struct:
-			backup = state->StructScope;
-			state->StructScope = &scope;
+			// skipped with their nested classes
+			if (!Reflected(node))
+			{
+				recurse = false;
+				break;
+			}
+			PushScope();
 			state->StructScope->Name = node->ToString();
 			break;
 		case ASTNode::Type::DclHead:    // recurse these
@@ -113,45 +172,42 @@ public:
 		};
 
 
-		// recurse
-
-		if (recurse)
-		{
-			auto& children = node->Children();
-			for (size_t i = 0; i < children.size(); i++)
-			{
-				Traverse(state, children[i]);
-			}
-		}
+		return recurse;
+	}
 
-			
+	virtual void Post(ASTNode* node)
+	{
 		// POST
 		switch (node->GetType())
 		{
 		case ASTNode::Type::DclSub:
 		{
 			ASTType* typeNode = (ASTType*)node;
-			ASTType combined(typeNode->tokenSource);
-			if (typeNode->head != 0)
-				combined = typeNode->CombineWithHead();
-			else
-				combined.MergeData(typeNode);
+			ASTTypeView combined = typeNode->CombinedView();
 			state->StructScope->Members[Types::Member].push_back(vCount);
+
+			// the member's own spelling, the canonical type merges "const volatile" with "volatile const"
+			typeName.clear();
+			combined.AppendToString(typeName, false);
+			identifier.clear();
+			combined.AppendIdentifierString(identifier);
 			*state->Data += string_format("StructureMember m_%d = { VisibilityEnum::%s, \"%s\", \"%s\", reflector_offsetof(%s, %s), reflector_sizeof(%s, %s), 1 };\n", 
-				vCount++, state->StructScope->VisibilityType, combined.ToIdentifierString().c_str(), combined.ToString(false).c_str(),
-				state->StructScope->Name.c_str(), combined.ToIdentifierString().c_str(), state->StructScope->Name.c_str(), combined.ToIdentifierString().c_str());
-			recurse = false;
+				vCount++, state->StructScope->VisibilityType, identifier.c_str(), typeName.c_str(),
+				state->StructScope->Name.c_str(), identifier.c_str(), state->StructScope->Name.c_str(), identifier.c_str());
 			break;
 		}
 		case ASTNode::Type::Root:
 			*state->Data += string_format("} // end namespace reflector\n\n");
-			state->StructScope = backup;
+			PopScope();
 			break;
 		case ASTNode::Type::File:
 			*state->Data += string_format("// END FILE: \"%s\"\n", node->ToString().c_str());
 			break;
 		case ASTNode::Type::Class:
 		case ASTNode::Type::Struct:
+			if (!Reflected(node))
+				break;
+
 			// collect members
 			std::string memberLocation = "0";
 			if (state->StructScope->Members[Types::Member].size() > 0)
@@ -176,23 +232,20 @@ public:
 				vCount++, state->StructScope->VisibilityType, type, node->ToString().c_str(), state->StructScope->Members[Types::Member].size(), memberLocation.c_str());
 
 			// return structscope
-			state->StructScope = backup;
+			PopScope();
 			break;
 		};
 
 
 	}
 
-	virtual void Execute(tools::CommandLineParser& cmdOpts, ASTNode* rootNode, std::vector<std::unique_ptr<ASTCxxParser>>& parsers)
-	{
-		fprintf(stderr, "********************* REFLECTOR ***********************\n");
-		State state;
-		std::string stateData;
-		state.Data = &stateData;
-		Traverse(&state, rootNode);
-		printf("%s", stateData.c_str());
-	}
+};
 
+class ModuleReflectionDataGenerator : public VisitorModule
+{
+public:
+	virtual ASTVisitor* CreateVisitor(tools::CommandLineParser& cmdOpts, std::vector<std::unique_ptr<ASTCxxParser>>& parsers) { return new ReflectionDataVisitor(cmdOpts); }
+	virtual bool VisitsPerFile() const { return true; }
 };
 
 static ModuleRegistration gModulePrintStructure("reflection_data", new ModuleReflectionDataGenerator());
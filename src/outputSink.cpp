@@ -0,0 +1,106 @@
+#include "outputSink.h"
+#include "log.h"
+#include <stdarg.h>
+#include <string.h>
+#include <stdexcept>
+#ifdef _WIN32
+#include <windows.h>
+#endif
+
+void OutputSink::Printf(const char* fmt, ...)
+{
+	// format directly into the end of the buffer, a second pass when it did not fit
+	const size_t guess = 256;
+	size_t start = m_buffer.size();
+	m_buffer.resize(start + guess);
+
+	va_list ap;
+	va_start(ap, fmt);
+	int n = vsnprintf(&m_buffer[start], guess, fmt, ap);
+	va_end(ap);
+	if (n < 0)
+	{
+		m_buffer.resize(start);
+		return;
+	}
+	if ((size_t)n >= guess)
+	{
+		m_buffer.resize(start + n + 1);
+		va_start(ap, fmt);
+		vsnprintf(&m_buffer[start], n + 1, fmt, ap);
+		va_end(ap);
+	}
+	m_buffer.resize(start + n);
+
+	if (m_buffer.size() >= m_flushAt)
+		Flush();
+}
+
+OutputSink& OutputSink::Stdout()
+{
+	static StreamSink gStdout(stdout);
+	return gStdout;
+}
+
+void StreamSink::Flush()
+{
+	if (m_buffer.empty())
+		return;
+	fwrite(m_buffer.c_str(), 1, m_buffer.size(), m_file);
+	m_buffer.clear(); // keeps the capacity
+}
+
+bool FileSink::SameAsExisting() const
+{
+	FILE* file = fopen(m_path.c_str(), "rb");
+	if (!file)
+		return false;
+
+	// compared chunk by chunk, the first difference ends the read
+	bool same = true;
+	size_t size = 0;
+	char chunk[FlushThreshold];
+	size_t length;
+	while (same && (length = fread(chunk, 1, sizeof(chunk), file)) > 0)
+	{
+		same = size + length <= m_buffer.size() && memcmp(chunk, m_buffer.data() + size, length) == 0;
+		size += length;
+	}
+	fclose(file);
+
+	return same && size == m_buffer.size();
+}
+
+void FileSink::Close()
+{
+	if (SameAsExisting())
+	{
+		LOG_INFO(LogCategory::Output, "[OUTPUT] \"%s\" is unchanged, not written\n", m_path.c_str());
+		return;
+	}
+
+	std::string temporary = m_path + ".tmp";
+	FILE* file = fopen(temporary.c_str(), "wb");
+	if (!file)
+		throw std::runtime_error("could not create \"" + temporary + "\"");
+	size_t written = fwrite(m_buffer.c_str(), 1, m_buffer.size(), file);
+	if (fclose(file) != 0 || written != m_buffer.size())
+	{
+		remove(temporary.c_str());
+		throw std::runtime_error("could not write \"" + temporary + "\"");
+	}
+
+#ifdef _WIN32
+	bool renamed = MoveFileExA(temporary.c_str(), m_path.c_str(), MOVEFILE_REPLACE_EXISTING) != 0;
+#else
+	bool renamed = rename(temporary.c_str(), m_path.c_str()) == 0;
+#endif
+	if (!renamed)
+	{
+		remove(temporary.c_str());
+		throw std::runtime_error("could not replace \"" + m_path + "\"");
+	}
+
+	m_written = true;
+	LOG_INFO(LogCategory::Output, "[OUTPUT] wrote \"%s\" (%d bytes)\n", m_path.c_str(), (int)m_buffer.size());
+}
@@ -0,0 +1,71 @@
+#pragma once
+
+#include <string>
+#include <stdio.h>
+
+// Buffered destination for module output. Writes are collected in a large buffer that is reused,
+// so producing output does not take the stdio lock for every line.
+class OutputSink
+{
+public:
+	virtual ~OutputSink() {}
+
+	void Write(const char* data, size_t length) { m_buffer.append(data, length); if (m_buffer.size() >= m_flushAt) Flush(); }
+	void Write(const std::string& data) { Write(data.c_str(), data.size()); }
+	void Put(char c) { m_buffer.push_back(c); if (m_buffer.size() >= m_flushAt) Flush(); }
+	void Printf(const char* fmt, ...);
+
+	// hands the buffered data to the target, sinks that need the whole content keep it
+	virtual void Flush() {}
+	// called once after the last write
+	virtual void Close() { Flush(); }
+
+	const std::string& Buffer() const { return m_buffer; }
+
+	// buffered stdout of the process
+	static OutputSink& Stdout();
+
+protected:
+	enum { FlushThreshold = 1 << 16 };
+
+	std::string m_buffer;
+	size_t m_flushAt = (size_t)-1;
+};
+
+// Writes to a stdio stream every time the buffer holds FlushThreshold bytes.
+class StreamSink : public OutputSink
+{
+public:
+	StreamSink(FILE* file) : m_file(file) { m_buffer.reserve(FlushThreshold * 2); m_flushAt = FlushThreshold; }
+	virtual ~StreamSink() { Flush(); }
+	virtual void Flush();
+
+protected:
+	FILE* m_file;
+};
+
+// Keeps all output in memory, the module schedule copies it to the real target in command line order.
+class MemorySink : public OutputSink
+{
+public:
+	void Clear() { m_buffer.clear(); }
+};
+
+// Writes a file on Close(), but only when the content differs from the existing file (compared byte by byte),
+// so generated sources do not trigger rebuilds on runs that change nothing.
+// The content goes to a temporary file first that is renamed over the target, readers never see a partial file.
+class FileSink : public OutputSink
+{
+public:
+	FileSink(const std::string& path) : m_path(path) {}
+	virtual void Close();
+
+	const std::string& Path() const { return m_path; }
+	bool Written() const { return m_written; }
+
+protected:
+	bool SameAsExisting() const;
+
+	std::string m_path;
+	bool m_written = false;
+};
@@ -0,0 +1,163 @@
+#include "parseCache.h"
+#include "ast.h"
+#include "cxxAstParser.h"
+#include "tools.h"
+#include <sys/stat.h>
+
+static ParseCache* gParseCache = 0;
+
+ParseCache* ParseCache::Current()
+{
+	return gParseCache;
+}
+
+void ParseCache::SetCurrent(ParseCache* cache)
+{
+	gParseCache = cache;
+}
+
+static bool FileTime(const std::string& name, long long& modified, long long& size)
+{
+	struct stat st;
+	if (stat(name.c_str(), &st) != 0)
+		return false;
+#ifdef __linux__
+	modified = (long long)st.st_mtim.tv_sec * 1000000000LL + st.st_mtim.tv_nsec;
+#else
+	modified = (long long)st.st_mtime * 1000000000LL;
+#endif
+	size = (long long)st.st_size;
+	return true;
+}
+
+ParseCache::FileState ParseCache::Check(const std::string& name, std::string& content, bool& hasContent)
+{
+	FileState ret;
+	hasContent = false;
+	if (!FileTime(name, ret.modified, ret.size))
+	{
+		ret.size = -1;
+		return ret;
+	}
+
+	auto found = m_entries.find(name);
+	if (found != m_entries.end() && found->second.state.modified == ret.modified && found->second.state.size == ret.size)
+	{
+		ret.hash = found->second.state.hash;
+		return ret;
+	}
+
+	// touched or new, the content decides
+	content = tools::readFromFile(name);
+	hasContent = true;
+	ret.size = (long long)content.size();
+	ret.hash = tools::Hash64(content.c_str(), content.size());
+	return ret;
+}
+
+void ParseCache::Validate(const std::string& name, const FileState& state)
+{
+	auto found = m_entries.find(name);
+	if (found != m_entries.end())
+	{
+		if (state.size < 0 || found->second.state.size != state.size || found->second.state.hash != state.hash)
+		{
+			Destroy(found->second);
+			m_entries.erase(found);
+		}
+		else
+			found->second.state.modified = state.modified;
+	}
+
+	if (state.size >= 0)
+		m_validated[name] = state;
+}
+
+bool ParseCache::Take(const std::string& name, std::unique_ptr<ASTCxxParser>& parser, std::unique_ptr<ASTDataNode>& file)
+{
+	auto found = m_entries.find(name);
+	if (found == m_entries.end() || m_validated.count(name) == 0)
+	{
+		m_misses++;
+		return false;
+	}
+
+	parser.reset(found->second.parser);
+	file.reset(found->second.file);
+	m_residentBytes -= found->second.bytes;
+	m_entries.erase(found);
+	m_hits++;
+	return true;
+}
+
+void ParseCache::Return(std::vector<std::unique_ptr<ASTCxxParser>>& parsers, ASTNode* rootNode)
+{
+	std::map<std::string, size_t> parserOf;
+	for (size_t i = 0; i < parsers.size(); i++)
+	{
+		if (parsers[i])
+			parserOf[parsers[i]->SourceIdentifier()] = i;
+	}
+
+	for (auto it : rootNode->Children())
+	{
+		ASTDataNode* file = it->GetType() == ASTNode::Type::File ? dynamic_cast<ASTDataNode*>(it) : 0;
+		std::string name = file ? file->ToString() : std::string();
+		auto validated = m_validated.find(name);
+		auto parser = parserOf.find(name);
+		if (!file || validated == m_validated.end() || parser == parserOf.end() || !parsers[parser->second] || m_entries.count(name))
+		{
+			it->DestroyChildrenAndSelf();
+			continue;
+		}
+
+		Entry& entry = m_entries[name];
+		entry.state = validated->second;
+		entry.parser = parsers[parser->second].release();
+		entry.file = file;
+		entry.bytes = (size_t)entry.state.size * MemoryPerSourceByte;
+		entry.lastUse = ++m_useCounter;
+		m_residentBytes += entry.bytes;
+	}
+
+	rootNode->ClearChildrenWithoutDestruction();
+	parsers.clear();
+	m_validated.clear();
+}
+
+size_t ParseCache::Trim(size_t budget)
+{
+	size_t evicted = 0;
+	while (m_residentBytes > budget && !m_entries.empty())
+	{
+		auto oldest = m_entries.begin();
+		for (auto it = m_entries.begin(); it != m_entries.end(); ++it)
+		{
+			if (it->second.lastUse < oldest->second.lastUse)
+				oldest = it;
+		}
+		Destroy(oldest->second);
+		m_entries.erase(oldest);
+		evicted++;
+	}
+	return evicted;
+}
+
+void ParseCache::Clear()
+{
+	for (auto& it : m_entries)
+		Destroy(it.second);
+	m_entries.clear();
+	m_validated.clear();
+}
+
+void ParseCache::Destroy(Entry& entry)
+{
+	if (entry.file)
+		entry.file->DestroyChildrenAndSelf();
+	delete entry.parser;
+	entry.file = 0;
+	entry.parser = 0;
+	m_residentBytes -= entry.bytes;
+	entry.bytes = 0;
+}
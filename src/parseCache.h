@@ -0,0 +1,70 @@
+#pragma once
+
+#include <string>
+#include <vector>
+#include <map>
+#include <memory>
+
+class ASTNode;
+class ASTDataNode;
+class ASTCxxParser;
+
+// Parsed files that are kept between the runs of the daemon (--serve), by path. An entry is valid as long as the
+// modification time and size of the file are unchanged, or the content still has the same hash.
+// The parser takes the valid entries of a run instead of parsing them (Take), and the files of the run are put back afterwards (Return).
+class ParseCache
+{
+public:
+	struct FileState
+	{
+		long long modified = 0;		// nanoseconds where the platform has them
+		long long size = -1;		// -1 when the file could not be read
+		unsigned long long hash = 0;
+	};
+
+	// estimated memory of the tokens and the tree per byte of source (as the streaming parser estimates it)
+	static const size_t MemoryPerSourceByte = 64;
+
+	~ParseCache() { Clear(); }
+
+	// state of the file on disk, content is read only when the modification time or the size differ from the entry
+	// (and returned in content, so it does not have to be read again by the parser)
+	FileState Check(const std::string& name, std::string& content, bool& hasContent);
+	// drops the entry when it does not match state, remembers the state for the files of the next Return()
+	void Validate(const std::string& name, const FileState& state);
+
+	// moves a valid entry into the run, false when the file has to be parsed
+	bool Take(const std::string& name, std::unique_ptr<ASTCxxParser>& parser, std::unique_ptr<ASTDataNode>& file);
+	// takes the parsers and files of a finished run back, destroys the ones that were not validated
+	void Return(std::vector<std::unique_ptr<ASTCxxParser>>& parsers, ASTNode* rootNode);
+	// drops the least recently used entries until the estimate is below budget
+	size_t Trim(size_t budget);
+	void Clear();
+
+	size_t ResidentBytes() const { return m_residentBytes; }
+	size_t Count() const { return m_entries.size(); }
+	size_t Hits() const { return m_hits; }
+	size_t Misses() const { return m_misses; }
+
+	// cache of the current run (the modules of a run can execute on any thread), 0 outside the daemon
+	static ParseCache* Current();
+	static void SetCurrent(ParseCache* cache);
+
+protected:
+	struct Entry
+	{
+		FileState state;
+		ASTCxxParser* parser = 0;
+		ASTDataNode* file = 0;
+		size_t bytes = 0;
+		unsigned long long lastUse = 0;
+	};
+	void Destroy(Entry& entry);
+
+	std::map<std::string, Entry> m_entries;
+	std::map<std::string, FileState> m_validated;
+	size_t m_residentBytes = 0;
+	unsigned long long m_useCounter = 0;
+	size_t m_hits = 0;
+	size_t m_misses = 0;
+};
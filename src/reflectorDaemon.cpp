@@ -0,0 +1,400 @@
+#include "reflectorDaemon.h"
+#include "tools.h"
+#include "outputSink.h"
+#include "log.h"
+#include "symbols.h"
+#include "canonicalTypes.h"
+#include <chrono>
+#include <stdexcept>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <algorithm>
+#ifndef _WIN32
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+#include <signal.h>
+#endif
+
+static double MillisecondsSince(std::chrono::steady_clock::time_point start)
+{
+	return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+}
+
+ReflectorDaemon::ReflectorDaemon(const tools::CommandLineParser& opts)
+{
+	m_memoryCap = (size_t)std::max(1LL, opts.intOption("cache-memory", 1024)) * 1024 * 1024;
+}
+
+void ReflectorDaemon::AddPhase(const std::string& name, double milliseconds)
+{
+	Phase& phase = m_phases[name];
+	phase.count++;
+	phase.total += milliseconds;
+	phase.last = milliseconds;
+}
+
+std::string ReflectorDaemon::Run(const std::vector<std::string>& arguments)
+{
+	auto start = std::chrono::steady_clock::now();
+	std::vector<char*> argv(1, (char*)"");
+	for (auto& it : arguments)
+		argv.push_back((char*)it.c_str());
+	tools::CommandLineParser opts;
+	tools::CommandLineParser::parse(opts, (int)argv.size(), argv.data());
+
+	// the cached files are only valid for the working directory and the options they were parsed with
+	char cwd[4096] = "";
+#ifndef _WIN32
+	if (!getcwd(cwd, sizeof(cwd)))
+		cwd[0] = 0;
+#endif
+	std::string context = cwd;
+	const char* parseOptions[] = { "keep-tokens", "keep-comments", "verbose" };
+	for (auto it : parseOptions)
+		context += opts.options.count(it) ? std::string(" --") + it : std::string();
+	if (context != m_parseContext)
+	{
+		// nothing holds a symbol or type id anymore
+		m_parseCache.Clear();
+		ClearTables();
+		m_parseContext = context;
+	}
+
+	// every input is checked, the ones that changed are read once and handed to the parser from memory
+	unsigned long long key = tools::Hash64Seed;
+	for (auto& it : arguments)
+		key = tools::Hash64(it.c_str(), it.size() + 1, key);
+	bool cacheable = true;
+	std::vector<std::string> contents(opts.names.size());
+	std::vector<bool> hasContent(opts.names.size(), false);
+	for (size_t i = 0; i < opts.names.size(); i++)
+	{
+		bool read = false;
+		ParseCache::FileState state = m_parseCache.Check(opts.names[i], contents[i], read);
+		hasContent[i] = read;
+		m_parseCache.Validate(opts.names[i], state);
+		cacheable &= state.size >= 0;
+		key = tools::Hash64(&state.hash, sizeof(state.hash), key);
+	}
+	AddPhase("validate", MillisecondsSince(start));
+
+	std::string response;
+	auto found = cacheable ? m_outputs.find(key) : m_outputs.end();
+	bool cached = found != m_outputs.end();
+	size_t parsed = 0;
+	const std::vector<CppReflector::Result>* results = 0;
+	std::vector<CppReflector::Result> ran;
+	if (cached)
+	{
+		m_outputHits++;
+		found->second.lastUse = ++m_useCounter;
+		results = &found->second.results;
+	}
+	else
+	{
+		m_outputMisses++;
+		CppReflector reflector;
+		reflector.SetParseCache(&m_parseCache);
+		for (auto& it : arguments)
+			reflector.AddArgument(it);
+		for (size_t i = 0; i < opts.names.size(); i++)
+		{
+			if (hasContent[i])
+				reflector.AddSource(opts.names[i], contents[i].c_str(), contents[i].size());
+		}
+
+		auto run = std::chrono::steady_clock::now();
+		size_t misses = m_parseCache.Misses();
+		ran = reflector.Run();
+		parsed = m_parseCache.Misses() - misses;
+		AddPhase("run", MillisecondsSince(run));
+		for (auto& it : ran)
+			AddPhase(it.module, it.milliseconds);
+
+		results = &ran;
+		if (cacheable)
+		{
+			CachedOutput& output = m_outputs[key];
+			output.results = ran;
+			for (auto& it : ran)
+				output.bytes += it.output.size();
+			output.lastUse = ++m_useCounter;
+			m_outputBytes += output.bytes;
+		}
+		Trim();
+	}
+
+	for (auto& it : *results)
+	{
+		tools::appendFormat(response, "output %s %d %.3f\n", it.module.c_str(), (int)it.output.size(), it.milliseconds);
+		response += it.output;
+	}
+	double total = MillisecondsSince(start);
+	AddPhase("request", total);
+	tools::appendFormat(response, "done %.3f %s %d\n", total, cached ? "cached" : "parsed", (int)parsed);
+	return response;
+}
+
+void ReflectorDaemon::Trim()
+{
+	size_t tables = TableBytes();
+	while (m_outputBytes + m_parseCache.ResidentBytes() + tables > m_memoryCap && !m_outputs.empty())
+	{
+		auto oldest = m_outputs.begin();
+		for (auto it = m_outputs.begin(); it != m_outputs.end(); ++it)
+		{
+			if (it->second.lastUse < oldest->second.lastUse)
+				oldest = it;
+		}
+		m_outputBytes -= oldest->second.bytes;
+		m_outputs.erase(oldest);
+		m_evictions++;
+	}
+	if (m_outputBytes + tables < m_memoryCap)
+		m_evictions += m_parseCache.Trim(m_memoryCap - m_outputBytes - tables);
+
+	// the tables keep every symbol and type ever seen, when they alone are over the cap they are built again from the
+	// files of the next request; the cached files hold ids of the tables and go with them
+	if (m_outputBytes + m_parseCache.ResidentBytes() + tables > m_memoryCap)
+	{
+		m_evictions += m_parseCache.Count();
+		m_parseCache.Clear();
+		ClearTables();
+		m_tableRebuilds++;
+	}
+}
+
+size_t ReflectorDaemon::TableBytes() const
+{
+	return SymbolTable::Global().MemoryBytes() + CanonicalTypeTable::Global().MemoryBytes();
+}
+
+void ReflectorDaemon::ClearTables()
+{
+	CanonicalTypeTable::Global().Clear();
+	SymbolTable::Global().Clear();
+}
+
+std::string ReflectorDaemon::Stats() const
+{
+	auto rate = [](size_t hits, size_t misses) { return hits + misses ? 100.0 * hits / (hits + misses) : 0.0; };
+	const double mb = 1024.0 * 1024.0;
+
+	std::string ret;
+	tools::appendFormat(ret, "requests %d\n", (int)m_requests);
+	tools::appendFormat(ret, "output cache: %d hit(s), %d miss(es), hit rate %.1f%%, %d entries, %.2f MB\n",
+		(int)m_outputHits, (int)m_outputMisses, rate(m_outputHits, m_outputMisses), (int)m_outputs.size(), m_outputBytes / mb);
+	tools::appendFormat(ret, "parse cache: %d hit(s), %d miss(es), hit rate %.1f%%, %d file(s), %.2f MB estimated\n",
+		(int)m_parseCache.Hits(), (int)m_parseCache.Misses(), rate(m_parseCache.Hits(), m_parseCache.Misses()), (int)m_parseCache.Count(), m_parseCache.ResidentBytes() / mb);
+	tools::appendFormat(ret, "symbol tables: %d symbol(s), %d type(s), %.2f MB estimated, rebuilt %d time(s)\n",
+		(int)SymbolTable::Global().Count(), (int)CanonicalTypeTable::Global().Count(), TableBytes() / mb, (int)m_tableRebuilds);
+	tools::appendFormat(ret, "resident %.2f MB of %.0f MB, %d eviction(s)\n", (m_outputBytes + m_parseCache.ResidentBytes() + TableBytes()) / mb, m_memoryCap / mb, (int)m_evictions);
+	for (auto& it : m_phases)
+	{
+		tools::appendFormat(ret, "phase %s: %d time(s), average %.3f ms, last %.3f ms\n",
+			it.first.c_str(), (int)it.second.count, it.second.total / it.second.count, it.second.last);
+	}
+	return ret;
+}
+
+std::string ReflectorDaemon::Handle(const std::string& command, const std::string& directory, const std::vector<std::string>& arguments, bool& stop)
+{
+	m_requests++;
+	if (command == "stats")
+		return Stats() + "done\n";
+	if (command == "shutdown")
+	{
+		stop = true;
+		return "done\n";
+	}
+	if (command != "run")
+		return "error unknown request \"" + command + "\"\n";
+
+#ifndef _WIN32
+	if (!directory.empty() && chdir(directory.c_str()) != 0)
+		return "error could not change to \"" + directory + "\"\n";
+#endif
+	try
+	{
+		return Run(arguments);
+	}
+	catch (const std::exception& e)
+	{
+		return std::string("error ") + e.what() + "\n";
+	}
+}
+
+#ifdef _WIN32
+int ReflectorDaemon::Serve(const std::string& path)
+{
+	LOG_ERROR(LogCategory::Daemon, "Error: --serve needs Unix domain sockets, which are not supported on this platform.\n");
+	return 1;
+}
+
+int ReflectorDaemon::Request(const std::string& socketPath, int argc, char** argv)
+{
+	LOG_ERROR(LogCategory::Daemon, "Error: --connect needs Unix domain sockets, which are not supported on this platform.\n");
+	return 1;
+}
+#else
+static bool SendAll(int fd, const std::string& data)
+{
+	size_t sent = 0;
+	while (sent < data.size())
+	{
+		ssize_t n = write(fd, data.c_str() + sent, data.size() - sent);
+		if (n <= 0)
+			return false;
+		sent += (size_t)n;
+	}
+	return true;
+}
+
+static int OpenSocket(const std::string& socketPath, sockaddr_un& address)
+{
+	if (socketPath.size() >= sizeof(address.sun_path))
+	{
+		LOG_ERROR(LogCategory::Daemon, "Error: Socket path \"%s\" is too long.\n", socketPath.c_str());
+		return -1;
+	}
+	memset(&address, 0, sizeof(address));
+	address.sun_family = AF_UNIX;
+	strcpy(address.sun_path, socketPath.c_str());
+
+	int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+	if (fd < 0)
+		LOG_ERROR(LogCategory::Daemon, "Error: Could not create a socket.\n");
+	return fd;
+}
+
+int ReflectorDaemon::Serve(const std::string& path)
+{
+	signal(SIGPIPE, SIG_IGN); // a client that goes away must not stop the daemon
+
+	// requests change to the directory of their client
+	std::string socketPath = path;
+	char cwd[4096];
+	if (!path.empty() && path[0] != '/' && getcwd(cwd, sizeof(cwd)))
+		socketPath = std::string(cwd) + "/" + path;
+
+	sockaddr_un address;
+	int listener = OpenSocket(socketPath, address);
+	if (listener < 0)
+		return 1;
+	unlink(socketPath.c_str());
+	if (bind(listener, (sockaddr*)&address, sizeof(address)) != 0 || listen(listener, 16) != 0)
+	{
+		close(listener);
+		LOG_ERROR(LogCategory::Daemon, "Error: Could not listen on \"%s\".\n", socketPath.c_str());
+		return 1;
+	}
+	LOG_INFO(LogCategory::Daemon, "[DAEMON] listening on \"%s\", cache memory %d MB\n", socketPath.c_str(), (int)(m_memoryCap / (1024 * 1024)));
+	Log::Flush();
+
+	bool stop = false;
+	while (!stop)
+	{
+		int client = accept(listener, 0, 0);
+		if (client < 0)
+			continue;
+
+		// the request ends with an empty line
+		std::string request;
+		char chunk[4096];
+		ssize_t n;
+		while (request.find("\n\n") == std::string::npos && (n = read(client, chunk, sizeof(chunk))) > 0)
+			request.append(chunk, (size_t)n);
+
+		std::vector<std::string> lines;
+		size_t begin = 0, end;
+		while ((end = request.find('\n', begin)) != std::string::npos && end != begin)
+		{
+			lines.push_back(request.substr(begin, end - begin));
+			begin = end + 1;
+		}
+
+		std::string response = "error incomplete request\n";
+		if (lines.size() >= 2)
+			response = Handle(lines[0], lines[1], std::vector<std::string>(lines.begin() + 2, lines.end()), stop);
+		SendAll(client, response);
+		close(client);
+	}
+
+	close(listener);
+	unlink(socketPath.c_str());
+	LOG_INFO(LogCategory::Daemon, "[DAEMON] stopped\n");
+	return 0;
+}
+
+int ReflectorDaemon::Request(const std::string& socketPath, int argc, char** argv)
+{
+	std::string command = "run";
+	std::string arguments;
+	for (int i = 1; i < argc; i++)
+	{
+		std::string arg = argv[i];
+		if (arg == "--daemon-stats")
+			command = "stats";
+		else if (arg == "--daemon-shutdown")
+			command = "shutdown";
+		else if (arg.compare(0, 10, "--connect=") != 0)
+			arguments += arg + "\n";
+	}
+	char cwd[4096] = "";
+	if (!getcwd(cwd, sizeof(cwd)))
+		cwd[0] = 0;
+
+	sockaddr_un address;
+	int fd = OpenSocket(socketPath, address);
+	if (fd < 0)
+		return 1;
+	if (connect(fd, (sockaddr*)&address, sizeof(address)) != 0)
+	{
+		close(fd);
+		LOG_ERROR(LogCategory::Daemon, "Error: Could not connect to \"%s\".\n", socketPath.c_str());
+		return 1;
+	}
+	SendAll(fd, command + "\n" + cwd + "\n" + arguments + "\n");
+
+	std::string response;
+	char chunk[1 << 16];
+	ssize_t n;
+	while ((n = read(fd, chunk, sizeof(chunk))) > 0)
+		response.append(chunk, (size_t)n);
+	close(fd);
+
+	// output blocks go to stdout, the rest of the answer is reported on stderr
+	OutputSink& out = OutputSink::Stdout();
+	size_t pos = 0;
+	int ret = 1;
+	while (pos < response.size())
+	{
+		size_t end = response.find('\n', pos);
+		if (end == std::string::npos)
+			end = response.size();
+		std::string line = response.substr(pos, end - pos);
+		pos = end + 1;
+
+		char module[256];
+		int bytes = 0;
+		if (command == "run" && sscanf(line.c_str(), "output %255s %d", module, &bytes) == 2)
+		{
+			out.Write(response.c_str() + pos, std::min((size_t)bytes, response.size() - pos));
+			pos += bytes;
+		}
+		else if (command == "stats" && line != "done")
+			out.Write(line + "\n");
+		else if (line.compare(0, 4, "done") == 0)
+		{
+			LOG_INFO(LogCategory::Daemon, "[DAEMON] %s\n", line.c_str());
+			ret = 0;
+		}
+		else if (line.compare(0, 6, "error ") == 0)
+			LOG_ERROR(LogCategory::Daemon, "Error: %s\n", line.c_str() + 6);
+	}
+	out.Flush();
+	return ret;
+}
+#endif
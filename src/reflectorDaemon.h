@@ -0,0 +1,69 @@
+#pragma once
+
+#include <string>
+#include <vector>
+#include <map>
+#include "cppReflector.h"
+#include "parseCache.h"
+
+namespace tools { struct CommandLineParser; }
+
+// Resident daemon (--serve=<socket>): answers requests on a local Unix domain socket and keeps the parsed files and the
+// output of earlier requests in memory. Files are validated by modification time, size and content hash on every request,
+// only the changed ones are parsed again, and a request whose arguments and inputs are unchanged is answered from the output cache.
+// --cache-memory=<megabytes> caps the estimated memory of both caches and the symbol and type tables (default 1024),
+// the least recently used entries go first, the tables are built again when they alone exceed the cap.
+//
+// A request is a command ("run", "stats" or "shutdown"), the working directory of the client and one argument per line, ended by an empty line.
+// "run" answers "output <module> <bytes> <milliseconds>" followed by the bytes for every module and "done <milliseconds> <cached|parsed> <files parsed>",
+// or "error <message>". "stats" answers lines of text and "done". The daemon handles one request at a time.
+class ReflectorDaemon
+{
+public:
+	ReflectorDaemon(const tools::CommandLineParser& opts);
+
+	int Serve(const std::string& path);
+	// --connect=<socket>: sends the other arguments as a run request and writes the output of the modules to stdout,
+	// --daemon-stats and --daemon-shutdown send the other requests
+	static int Request(const std::string& socketPath, int argc, char** argv);
+
+protected:
+	struct CachedOutput
+	{
+		std::vector<CppReflector::Result> results;
+		size_t bytes = 0;
+		unsigned long long lastUse = 0;
+	};
+	struct Phase
+	{
+		size_t count = 0;
+		double total = 0;
+		double last = 0;
+	};
+
+	// handles one request, sets stop for "shutdown"
+	std::string Handle(const std::string& command, const std::string& directory, const std::vector<std::string>& arguments, bool& stop);
+	std::string Run(const std::vector<std::string>& arguments);
+	std::string Stats() const;
+	void AddPhase(const std::string& name, double milliseconds);
+	// evicts outputs first (cheap to make again when the files are still parsed), then parsed files, then the tables
+	void Trim();
+	// estimated memory of the global symbol and canonical type tables
+	size_t TableBytes() const;
+	// only while no parsed file is cached
+	void ClearTables();
+
+	ParseCache m_parseCache;
+	std::string m_parseContext; // working directory and parse options of the cached files
+	std::map<unsigned long long, CachedOutput> m_outputs;
+	size_t m_outputBytes = 0;
+	size_t m_memoryCap;
+	unsigned long long m_useCounter = 0;
+
+	size_t m_requests = 0;
+	size_t m_outputHits = 0;
+	size_t m_outputMisses = 0;
+	size_t m_evictions = 0;
+	size_t m_tableRebuilds = 0;
+	std::map<std::string, Phase> m_phases;
+};
@@ -0,0 +1,232 @@
+#include "reflectorWatch.h"
+#include "cppReflector.h"
+#include "moduleSchedule.h"
+#include "fileDiscovery.h"
+#include "log.h"
+#include <chrono>
+#include <map>
+#include <stdexcept>
+#include <stdio.h>
+#include <string.h>
+#ifdef __linux__
+#include <sys/inotify.h>
+#include <poll.h>
+#include <unistd.h>
+#include <limits.h>
+#endif
+
+ReflectorWatch::ReflectorWatch(const tools::CommandLineParser& opts) : m_opts(opts)
+{
+	m_delay = (int)std::max(0LL, m_opts.intOption("watch-delay", 200));
+	// streaming releases the files that should be kept
+	m_opts.options.erase("stream");
+	m_opts.optionsWithValues.erase("memory-budget");
+	m_names = m_opts.names;
+}
+
+bool ReflectorWatch::HasWildcards() const
+{
+	for (auto& it : m_opts.names)
+	{
+		if (it.find('*') != std::string::npos)
+			return true;
+	}
+	return false;
+}
+
+static std::string DirectoryOf(const std::string& name)
+{
+	size_t split = name.find_last_of("/\\");
+	if (split == std::string::npos)
+		return ".";
+	return split == 0 ? "/" : name.substr(0, split);
+}
+
+static std::string PathIn(const std::string& directory, const char* name)
+{
+	if (directory == ".")
+		return name;
+	if (directory.back() == '/' || directory.back() == '\\')
+		return directory + name;
+	return directory + "/" + name;
+}
+
+void ReflectorWatch::AddSubdirectories(const std::string& directory, std::set<std::string>& directories)
+{
+	FileDiscovery::ReadDirectory(directory == "." ? std::string() : directory, [&](const char* name, bool /*isFile*/, bool isDirectory)
+	{
+		if (!isDirectory || strcmp(name, ".") == 0 || strcmp(name, "..") == 0)
+			return;
+		// the directories of the inputs can be in the set already, their subdirectories not
+		std::string path = PathIn(directory, name);
+		directories.insert(path);
+		AddSubdirectories(path, directories);
+	});
+}
+
+std::set<std::string> ReflectorWatch::Directories(const std::vector<std::string>& names) const
+{
+	std::set<std::string> ret;
+	for (auto& it : names)
+		ret.insert(DirectoryOf(it));
+	for (auto& it : m_opts.names)
+	{
+		size_t wildcard = it.find_first_of("*?");
+		if (wildcard == std::string::npos)
+			continue;
+
+		// a pattern with ** or a wildcard in a directory component can match files in every directory below its base,
+		// also in the ones that do not have a matching file yet
+		std::string base = DirectoryOf(it.substr(0, wildcard));
+		ret.insert(base);
+		if (it.find("**") != std::string::npos || it.find_first_of("/\\", wildcard) != std::string::npos)
+			AddSubdirectories(base, ret);
+	}
+	return ret;
+}
+
+std::vector<std::string> ReflectorWatch::RunOnce(size_t changed)
+{
+	auto start = std::chrono::steady_clock::now();
+	tools::CommandLineParser opts = m_opts;
+
+	// the inputs of the last run are checked, the changed ones are read once and parsed from memory
+	std::vector<std::string> contents(m_names.size());
+	for (size_t i = 0; i < m_names.size(); i++)
+	{
+		bool read = false;
+		ParseCache::FileState state = m_parseCache.Check(m_names[i], contents[i], read);
+		m_parseCache.Validate(m_names[i], state);
+		if (read)
+		{
+			tools::MemorySource source = { contents[i].c_str(), contents[i].size() };
+			opts.memorySources[m_names[i]] = source;
+		}
+	}
+
+	size_t misses = m_parseCache.Misses();
+	try
+	{
+		ModuleSchedule schedule;
+		schedule.Build(opts);
+		CppReflector::Execute(opts, schedule, &m_parseCache);
+	}
+	catch (const std::exception& e)
+	{
+		LOG_ERROR(LogCategory::Watch, "Error: %s\n", e.what());
+	}
+
+	LOG_INFO(LogCategory::Watch, "[WATCH] %d changed file(s), %d parsed, %d kept, %.1f ms\n", (int)changed, (int)(m_parseCache.Misses() - misses),
+		(int)m_parseCache.Count(), std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count());
+	Log::Flush();
+	return opts.names;
+}
+
+#ifndef __linux__
+int ReflectorWatch::Run()
+{
+	LOG_ERROR(LogCategory::Watch, "Error: --watch needs inotify, which is not supported on this platform.\n");
+	return 1;
+}
+#else
+int ReflectorWatch::Run()
+{
+	int fd = inotify_init1(IN_CLOEXEC);
+	if (fd < 0)
+	{
+		LOG_ERROR(LogCategory::Watch, "Error: Could not initialize inotify.\n");
+		return 1;
+	}
+
+	const unsigned int events = IN_CLOSE_WRITE | IN_MOVED_TO | IN_MOVED_FROM | IN_CREATE | IN_DELETE;
+	std::map<int, std::string> watched; // watch descriptor to directory
+	std::set<std::string> directories;
+	bool wildcards = HasWildcards();
+	auto watch = [&](const std::string& directory)
+	{
+		if (directories.count(directory))
+			return;
+		int wd = inotify_add_watch(fd, directory.c_str(), events);
+		if (wd < 0)
+		{
+			LOG_WARNING(LogCategory::Watch, "Warning: Could not watch \"%s\".\n", directory.c_str());
+			return;
+		}
+		watched[wd] = directory;
+		directories.insert(directory);
+	};
+
+	m_names = RunOnce(0);
+	for (;;)
+	{
+		// inputs by directory and file name, new directories of a wildcard expansion are watched as well
+		std::set<std::pair<std::string, std::string>> inputs;
+		for (auto& it : m_names)
+		{
+			size_t split = it.find_last_of("/\\");
+			inputs.insert(std::make_pair(DirectoryOf(it), split == std::string::npos ? it : it.substr(split + 1)));
+		}
+		for (auto& it : Directories(m_names))
+			watch(it);
+		LOG_INFO(LogCategory::Watch, "[WATCH] watching %d file(s) in %d director%s\n", (int)m_names.size(), (int)directories.size(), directories.size() == 1 ? "y" : "ies");
+		Log::Flush();
+
+		// wait for a change of an input, then until the burst is over
+		std::set<std::string> changed;
+		int timeout = -1;
+		for (;;)
+		{
+			pollfd pfd = { fd, POLLIN, 0 };
+			int ready = poll(&pfd, 1, timeout);
+			if (ready < 0)
+				continue;
+			if (ready == 0)
+				break;
+
+			alignas(inotify_event) char buffer[sizeof(inotify_event) * 64 + NAME_MAX + 1];
+			ssize_t length = read(fd, buffer, sizeof(buffer));
+			for (ssize_t pos = 0; pos < length; )
+			{
+				const inotify_event* event = (const inotify_event*)(buffer + pos);
+				pos += sizeof(inotify_event) + event->len;
+				auto directory = watched.find(event->wd);
+				if (directory == watched.end())
+					continue;
+
+				// the directory was removed, it is watched again when it comes back
+				if (event->mask & IN_IGNORED)
+				{
+					directories.erase(directory->second);
+					watched.erase(directory);
+					continue;
+				}
+				if (event->len == 0)
+					continue;
+
+				std::string name = event->name;
+				std::string path = PathIn(directory->second, name.c_str());
+
+				// a new directory below a pattern is watched right away, files can appear in it before the next run
+				if (wildcards && (event->mask & IN_ISDIR) && (event->mask & (IN_CREATE | IN_MOVED_TO)))
+				{
+					std::set<std::string> added;
+					added.insert(path);
+					AddSubdirectories(path, added);
+					for (auto& it : added)
+						watch(it);
+					changed.insert(path);
+					continue;
+				}
+				if (name.size() > 4 && name.compare(name.size() - 4, 4, ".tmp") == 0)
+					continue; // the temporary file of an output that is being replaced
+				if (inputs.count(std::make_pair(directory->second, name)) || wildcards)
+					changed.insert(path);
+			}
+			if (!changed.empty())
+				timeout = m_delay;
+		}
+
+		m_names = RunOnce(changed.size());
+	}
+}
+#endif
@@ -0,0 +1,37 @@
+#pragma once
+
+#include <string>
+#include <vector>
+#include <set>
+#include "tools.h"
+#include "parseCache.h"
+
+// Watch mode (--watch, Linux): runs the modules, then waits for changes of the input files with inotify and runs them again.
+// Bursts of changes are collected until the files were quiet for --watch-delay=<milliseconds> (default 200).
+// The parsed files are kept between runs (ParseCache), so only the changed files are parsed again, and --output files
+// are only rewritten when their content changed (FileSink).
+// The directories of the inputs are watched instead of the files, editors often replace a file instead of writing to it.
+// With wildcard arguments every change in a watched directory counts, a new file can match the pattern. Patterns with ** or a
+// wildcard directory watch every directory below their base, and directories created there are watched as soon as they appear.
+class ReflectorWatch
+{
+public:
+	ReflectorWatch(const tools::CommandLineParser& opts);
+
+	// returns when watching fails, runs until the process is stopped otherwise
+	int Run();
+
+protected:
+	// one run of the modules, returns the input names after wildcard expansion
+	std::vector<std::string> RunOnce(size_t changed);
+	// directories of the inputs, and the directories of the wildcard patterns
+	std::set<std::string> Directories(const std::vector<std::string>& names) const;
+	// adds every directory below directory, symbolic links are not followed
+	static void AddSubdirectories(const std::string& directory, std::set<std::string>& directories);
+	bool HasWildcards() const;
+
+	tools::CommandLineParser m_opts;
+	ParseCache m_parseCache;
+	int m_delay;
+	std::vector<std::string> m_names; // inputs of the last run, after wildcard expansion
+};
@@ -0,0 +1,186 @@
+#pragma once
+
+#include <stddef.h>
+#include <new>
+#include <utility>
+#include <type_traits>
+#include <initializer_list>
+
+// Vector with inline storage for the first N elements, only allocates on the heap once it grows beyond N.
+// Used for the per declaration token lists in ASTType, which mostly hold zero to two entries.
+template <class T, size_t N> class SmallVector
+{
+public:
+	typedef T value_type;
+	typedef T* iterator;
+	typedef const T* const_iterator;
+
+	SmallVector() : m_data(InlineData()), m_size(0), m_capacity(N) {}
+	SmallVector(std::initializer_list<T> init) : SmallVector() { assign(init.begin(), init.end()); }
+	SmallVector(const SmallVector& o) : SmallVector() { assign(o.begin(), o.end()); }
+	SmallVector(SmallVector&& o) : SmallVector() { MoveFrom(o); }
+	~SmallVector() { clear(); FreeHeap(); }
+
+	SmallVector& operator = (const SmallVector& o) { if (this != &o) assign(o.begin(), o.end()); return *this; }
+	SmallVector& operator = (SmallVector&& o) { if (this != &o) { clear(); MoveFrom(o); } return *this; }
+
+	size_t size() const { return m_size; }
+	size_t capacity() const { return m_capacity; }
+	bool empty() const { return m_size == 0; }
+	bool is_inline() const { return m_data == InlineData(); }
+
+	iterator begin() { return m_data; }
+	iterator end() { return m_data + m_size; }
+	const_iterator begin() const { return m_data; }
+	const_iterator end() const { return m_data + m_size; }
+
+	T& operator [] (size_t index) { return m_data[index]; }
+	const T& operator [] (size_t index) const { return m_data[index]; }
+	T& front() { return m_data[0]; }
+	const T& front() const { return m_data[0]; }
+	T& back() { return m_data[m_size - 1]; }
+	const T& back() const { return m_data[m_size - 1]; }
+
+	void push_back(const T& v)
+	{
+		if (m_size == m_capacity)
+		{
+			T copy(v); // v may live inside this container
+			Grow(m_size + 1);
+			new (m_data + m_size) T(std::move(copy));
+		}
+		else
+			new (m_data + m_size) T(v);
+		m_size++;
+	}
+	void push_back(T&& v)
+	{
+		if (m_size == m_capacity)
+		{
+			T moved(std::move(v));
+			Grow(m_size + 1);
+			new (m_data + m_size) T(std::move(moved));
+		}
+		else
+			new (m_data + m_size) T(std::move(v));
+		m_size++;
+	}
+	void pop_back() { m_data[--m_size].~T(); }
+
+	void clear()
+	{
+		for (size_t i = 0; i < m_size; i++)
+			m_data[i].~T();
+		m_size = 0;
+	}
+
+	void reserve(size_t count) { if (count > m_capacity) Grow(count); }
+
+	template <class It> void assign(It first, It last)
+	{
+		clear();
+		insert(end(), first, last);
+	}
+
+	template <class It> iterator insert(iterator pos, It first, It last)
+	{
+		size_t index = pos - m_data;
+		size_t count = 0;
+		for (It it = first; it != last; ++it)
+			count++;
+		if (count == 0)
+			return m_data + index;
+
+		// inserting a range of ourselves is not supported when the storage moves
+		if (m_size + count > m_capacity)
+			Grow(m_size + count);
+
+		// shift the tail up
+		for (size_t i = m_size; i > index; i--)
+		{
+			new (m_data + i - 1 + count) T(std::move(m_data[i - 1]));
+			m_data[i - 1].~T();
+		}
+		for (size_t i = 0; i < count; i++, ++first)
+			new (m_data + index + i) T(*first);
+		m_size += count;
+		return m_data + index;
+	}
+
+	void swap(SmallVector& o)
+	{
+		SmallVector tmp(std::move(o));
+		o = std::move(*this);
+		*this = std::move(tmp);
+	}
+
+	template <size_t N2> bool operator == (const SmallVector<T, N2>& o) const
+	{
+		if (m_size != o.size())
+			return false;
+		for (size_t i = 0; i < m_size; i++)
+		{
+			if (!(m_data[i] == o[i]))
+				return false;
+		}
+		return true;
+	}
+
+protected:
+	T* InlineData() { return reinterpret_cast<T*>(&m_inline); }
+	const T* InlineData() const { return reinterpret_cast<const T*>(&m_inline); }
+
+	void Grow(size_t minCapacity)
+	{
+		size_t newCapacity = m_capacity * 2;
+		if (newCapacity < minCapacity)
+			newCapacity = minCapacity;
+
+		// through operator new, so the allocation counters of print_alloc_stats see it
+		T* newData = static_cast<T*>(::operator new(newCapacity * sizeof(T)));
+		for (size_t i = 0; i < m_size; i++)
+		{
+			new (newData + i) T(std::move(m_data[i]));
+			m_data[i].~T();
+		}
+		FreeHeap();
+		m_data = newData;
+		m_capacity = newCapacity;
+	}
+
+	void FreeHeap()
+	{
+		if (!is_inline())
+			::operator delete(m_data);
+		m_data = InlineData();
+		m_capacity = N;
+	}
+
+	// expects this container to be empty
+	void MoveFrom(SmallVector& o)
+	{
+		if (o.is_inline())
+		{
+			for (size_t i = 0; i < o.m_size; i++)
+				new (m_data + i) T(std::move(o.m_data[i]));
+			m_size = o.m_size;
+			o.clear();
+		}
+		else
+		{
+			// steal the heap buffer
+			FreeHeap();
+			m_data = o.m_data;
+			m_size = o.m_size;
+			m_capacity = o.m_capacity;
+			o.m_data = o.InlineData();
+			o.m_size = 0;
+			o.m_capacity = N;
+		}
+	}
+
+	T* m_data;
+	size_t m_size;
+	size_t m_capacity;
+	typename std::aligned_storage<sizeof(T) * N, std::alignment_of<T>::value>::type m_inline;
+};
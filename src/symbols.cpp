@@ -0,0 +1,97 @@
+#include "symbols.h"
+#include "tools.h"
+#include <stdexcept>
+
+SymbolId SymbolTable::Intern(const char* data, size_t length)
+{
+	if (length == 0)
+		return Empty;
+
+	Key key = { data, length, (size_t)tools::Hash64(data, length) };
+	unsigned int shardIndex = (unsigned int)(key.hash >> 7) & (ShardCount - 1);
+	Shard& shard = m_shards[shardIndex];
+
+	std::lock_guard<std::mutex> lk(shard.lock);
+	auto found = shard.index.find(key);
+	if (found != shard.index.end())
+		return found->second;
+
+	// store the spelling and point the key at the stored copy
+	shard.strings.push_back(std::string(data, length));
+	key.data = shard.strings.back().c_str();
+
+	SymbolId id = (SymbolId)((shard.strings.size() << ShardBits) | shardIndex);
+	shard.index[key] = id;
+	// the spelling, the string and an index node
+	shard.bytes += length + 1 + sizeof(std::string) + sizeof(Key) + sizeof(SymbolId) + 2 * sizeof(void*);
+	return id;
+}
+
+SymbolId SymbolTable::Find(const char* data, size_t length) const
+{
+	if (length == 0)
+		return Empty;
+
+	Key key = { data, length, (size_t)tools::Hash64(data, length) };
+	unsigned int shardIndex = (unsigned int)(key.hash >> 7) & (ShardCount - 1);
+	const Shard& shard = m_shards[shardIndex];
+
+	std::lock_guard<std::mutex> lk(shard.lock);
+	auto found = shard.index.find(key);
+	if (found != shard.index.end())
+		return found->second;
+	return Empty;
+}
+
+const std::string& SymbolTable::Lookup(SymbolId id) const
+{
+	if (id == Empty)
+		return m_empty;
+
+	const Shard& shard = m_shards[id & (ShardCount - 1)];
+	size_t index = (id >> ShardBits) - 1;
+
+	std::lock_guard<std::mutex> lk(shard.lock);
+	if (index >= shard.strings.size())
+		throw std::runtime_error("invalid symbol id");
+	return shard.strings[index];
+}
+
+size_t SymbolTable::Count() const
+{
+	size_t ret = 0;
+	for (auto& it : m_shards)
+	{
+		std::lock_guard<std::mutex> lk(it.lock);
+		ret += it.strings.size();
+	}
+	return ret;
+}
+
+size_t SymbolTable::MemoryBytes() const
+{
+	size_t ret = 0;
+	for (auto& it : m_shards)
+	{
+		std::lock_guard<std::mutex> lk(it.lock);
+		ret += it.bytes + it.index.bucket_count() * sizeof(void*);
+	}
+	return ret;
+}
+
+void SymbolTable::Clear()
+{
+	for (auto& it : m_shards)
+	{
+		std::lock_guard<std::mutex> lk(it.lock);
+		std::unordered_map<Key, SymbolId, KeyHash>().swap(it.index);
+		std::deque<std::string>().swap(it.strings);
+		it.bytes = 0;
+	}
+}
+
+SymbolTable& SymbolTable::Global()
+{
+	static SymbolTable gSymbols;
+	return gSymbols;
+}
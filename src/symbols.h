@@ -0,0 +1,64 @@
+#pragma once
+
+#include <string>
+#include <deque>
+#include <unordered_map>
+#include <mutex>
+#include <string.h>
+
+typedef unsigned int SymbolId;
+
+// Thread-safe string interner, turns identifier spellings and qualified names into 32-bit symbol ids.
+// Symbol 0 is reserved for the empty string. Ids are stable until Clear().
+class SymbolTable
+{
+public:
+	static const SymbolId Empty = 0;
+
+	SymbolId Intern(const char* data, size_t length);
+	SymbolId Intern(const std::string& str) { return Intern(str.c_str(), str.size()); }
+	SymbolId Intern(const char* str) { return Intern(str, strlen(str)); }
+
+	// returns the id of an already interned string, or Empty when it was never interned
+	SymbolId Find(const char* data, size_t length) const;
+	SymbolId Find(const std::string& str) const { return Find(str.c_str(), str.size()); }
+
+	const std::string& Lookup(SymbolId id) const;
+	size_t Count() const;
+	// estimated heap bytes of the spellings and the index
+	size_t MemoryBytes() const;
+	// forgets every symbol, only while no id of the table is held anywhere
+	void Clear();
+
+	static SymbolTable& Global();
+
+protected:
+	enum { ShardBits = 4, ShardCount = 1 << ShardBits };
+
+	struct Key
+	{
+		const char* data;
+		size_t length;
+		size_t hash;
+		bool operator == (const Key& o) const { return length == o.length && memcmp(data, o.data, length) == 0; }
+	};
+	struct KeyHash { size_t operator () (const Key& k) const { return k.hash; } };
+
+	struct Shard
+	{
+		mutable std::mutex lock;
+		std::unordered_map<Key, SymbolId, KeyHash> index;
+		std::deque<std::string> strings; // deque keeps string addresses stable for the keys
+		size_t bytes = 0;
+	};
+
+	Shard m_shards[ShardCount];
+	std::string m_empty;
+};
+
+namespace symbols
+{
+	static inline SymbolId Intern(const std::string& str) { return SymbolTable::Global().Intern(str); }
+	static inline SymbolId Find(const std::string& str) { return SymbolTable::Global().Find(str); }
+	static inline const std::string& Lookup(SymbolId id) { return SymbolTable::Global().Lookup(id); }
+}
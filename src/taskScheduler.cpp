@@ -0,0 +1,171 @@
+#include "taskScheduler.h"
+#include <algorithm>
+#include <chrono>
+
+// worker index of the current thread, for the scheduler it belongs to
+static thread_local const TaskScheduler* gWorkerOf = 0;
+static thread_local size_t gWorkerIndex = 0;
+
+TaskScheduler::TaskScheduler(int jobs) : m_jobs(std::max(1, jobs))
+{
+	for (int i = 0; i < m_jobs; i++)
+		m_queues.push_back(std::unique_ptr<Queue>(new Queue()));
+	for (int i = 0; i < m_jobs - 1; i++)
+		m_workers.push_back(std::thread([this, i]() { WorkerLoop((size_t)i); }));
+}
+
+TaskScheduler::~TaskScheduler()
+{
+	{
+		std::lock_guard<std::mutex> lk(m_sleepLock);
+		m_stop = true;
+	}
+	m_wake.notify_all();
+	for (auto& it : m_workers)
+		it.join();
+}
+
+int TaskScheduler::DefaultJobs()
+{
+	return std::max(1, (int)std::thread::hardware_concurrency());
+}
+
+size_t TaskScheduler::OwnQueue() const
+{
+	return gWorkerOf == this ? gWorkerIndex : m_queues.size() - 1;
+}
+
+void TaskScheduler::Push(Item&& item)
+{
+	Queue& queue = *m_queues[OwnQueue()];
+	{
+		std::lock_guard<std::mutex> lk(queue.lock);
+		queue.items.push_back(std::move(item));
+	}
+	m_queued++;
+
+	// taking the lock makes sure a worker that is about to sleep sees the new task
+	{
+		std::lock_guard<std::mutex> lk(m_sleepLock);
+	}
+	m_wake.notify_one();
+}
+
+bool TaskScheduler::RunOne()
+{
+	size_t self = OwnQueue();
+	Item item;
+	bool found = false;
+
+	// newest task of the own queue first, it is most likely still in the cache
+	{
+		Queue& queue = *m_queues[self];
+		std::lock_guard<std::mutex> lk(queue.lock);
+		if (!queue.items.empty())
+		{
+			item = std::move(queue.items.back());
+			queue.items.pop_back();
+			found = true;
+		}
+	}
+
+	// steal the oldest task of another queue, these tend to be the largest pieces of work
+	for (size_t i = 1; !found && i < m_queues.size(); i++)
+	{
+		Queue& queue = *m_queues[(self + i) % m_queues.size()];
+		std::lock_guard<std::mutex> lk(queue.lock);
+		if (!queue.items.empty())
+		{
+			item = std::move(queue.items.front());
+			queue.items.pop_front();
+			found = true;
+		}
+	}
+	if (!found)
+		return false;
+
+	m_queued--;
+	std::exception_ptr error;
+	try
+	{
+		item.task();
+	}
+	catch (...)
+	{
+		error = std::current_exception();
+	}
+	item.group->Finished(error);
+	return true;
+}
+
+void TaskScheduler::WorkerLoop(size_t index)
+{
+	gWorkerOf = this;
+	gWorkerIndex = index;
+	for (;;)
+	{
+		if (RunOne())
+			continue;
+
+		std::unique_lock<std::mutex> lk(m_sleepLock);
+		m_wake.wait(lk, [this]() { return m_stop || m_queued > 0; });
+		if (m_stop && m_queued == 0)
+			return;
+	}
+}
+
+void TaskScheduler::ParallelFor(size_t begin, size_t end, size_t grain, const std::function<void(size_t, size_t)>& body)
+{
+	grain = std::max((size_t)1, grain);
+	Group group(*this);
+	for (size_t i = begin; i < end; i += grain)
+	{
+		size_t chunkEnd = std::min(end, i + grain);
+		group.Run([&body, i, chunkEnd]() { body(i, chunkEnd); });
+	}
+	group.Wait();
+}
+
+TaskScheduler::Group::~Group()
+{
+	// never leave tasks behind that point to this group, errors were not asked for
+	try { Wait(); }
+	catch (...) {}
+}
+
+void TaskScheduler::Group::Run(Task task)
+{
+	m_pending++;
+	Item item = { std::move(task), this };
+	m_scheduler.Push(std::move(item));
+}
+
+void TaskScheduler::Group::Finished(std::exception_ptr error)
+{
+	std::lock_guard<std::mutex> lk(m_lock);
+	if (error && !m_error)
+		m_error = error;
+	if (--m_pending == 0)
+		m_done.notify_all();
+}
+
+void TaskScheduler::Group::Wait()
+{
+	while (m_pending > 0)
+	{
+		if (m_scheduler.RunOne())
+			continue;
+
+		// the remaining tasks run elsewhere, check again for new work now and then
+		std::unique_lock<std::mutex> lk(m_lock);
+		m_done.wait_for(lk, std::chrono::milliseconds(1), [this]() { return m_pending == 0; });
+	}
+
+	std::exception_ptr error;
+	{
+		std::lock_guard<std::mutex> lk(m_lock);
+		std::swap(error, m_error);
+	}
+	if (error)
+		std::rethrow_exception(error);
+}
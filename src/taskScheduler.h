@@ -0,0 +1,80 @@
+#pragma once
+
+#include <vector>
+#include <deque>
+#include <memory>
+#include <functional>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+#include <exception>
+
+// Process wide pool of worker threads, owned by the driver and sized with --jobs=N.
+// Every worker has its own task deque: it runs its newest task first and steals the oldest task of another worker when it runs dry.
+// Waiting for a Group runs queued tasks on the waiting thread, so nested fork/join does not tie up a worker.
+// Tasks should not block on each other (use own threads for blocking pipelines), waiting for a Group is fine.
+class TaskScheduler
+{
+public:
+	typedef std::function<void()> Task;
+
+	// jobs includes the calling thread, jobs - 1 workers are started
+	explicit TaskScheduler(int jobs);
+	~TaskScheduler();
+
+	int Jobs() const { return m_jobs; }
+	// hardware threads
+	static int DefaultJobs();
+
+	// fork/join: tasks started with Run() are done when Wait() returns
+	class Group
+	{
+	public:
+		Group(TaskScheduler& scheduler) : m_scheduler(scheduler) {}
+		~Group();
+
+		void Run(Task task);
+		// helps running queued tasks until all tasks of the group are done, rethrows the first exception of a task
+		void Wait();
+
+	protected:
+		friend class TaskScheduler;
+		void Finished(std::exception_ptr error);
+
+		TaskScheduler& m_scheduler;
+		std::atomic<int> m_pending{ 0 };
+		std::mutex m_lock;
+		std::condition_variable m_done;
+		std::exception_ptr m_error;
+	};
+
+	// calls body(begin, end) for consecutive chunks of at most grain indices, on the workers and the calling thread
+	void ParallelFor(size_t begin, size_t end, size_t grain, const std::function<void(size_t, size_t)>& body);
+
+protected:
+	struct Item
+	{
+		Task task;
+		Group* group;
+	};
+	struct Queue
+	{
+		std::mutex lock;
+		std::deque<Item> items;
+	};
+
+	void Push(Item&& item);
+	// runs one task of the own queue or a stolen one, returns false when there was nothing to run
+	bool RunOne();
+	size_t OwnQueue() const;
+	void WorkerLoop(size_t index);
+
+	int m_jobs;
+	std::vector<std::unique_ptr<Queue>> m_queues; // one per worker, the last one is shared by threads outside the pool
+	std::vector<std::thread> m_workers;
+	std::atomic<int> m_queued{ 0 };
+	std::mutex m_sleepLock;
+	std::condition_variable m_wake;
+	bool m_stop = false;
+};
@@ -89,4 +89,18 @@ namespace tools
 		}
 	}
 
+	long long CommandLineParser::intOption(const std::string& name, long long defaultValue) const
+	{
+		auto found = optionsWithValues.find(name);
+		if (found == optionsWithValues.end() || found->second.empty())
+			return defaultValue;
+		return atoll(found->second.back().c_str());
+	}
+
+	const MemorySource* CommandLineParser::memorySource(const std::string& name) const
+	{
+		auto found = memorySources.find(name);
+		return found == memorySources.end() ? 0 : &found->second;
+	}
+
 }; // end namespace tools
@@ -7,6 +7,8 @@
 
 #include <stdlib.h>
 #include <string.h>
+#include <stdio.h>
+#include <stdarg.h>
 #ifdef _MSC_VER
 #include <intrin.h>
 #endif
@@ -29,6 +31,46 @@ namespace tools
 			return;
 		v.push_back(' ');
 	}
+
+	// printf into the end of a string
+	static inline void appendFormat(std::string& out, const char* fmt, ...)
+	{
+		char buffer[512];
+		va_list ap;
+		va_start(ap, fmt);
+		int n = vsnprintf(buffer, sizeof(buffer), fmt, ap);
+		va_end(ap);
+		if (n < 0)
+			return;
+		if (n < (int)sizeof(buffer))
+		{
+			out.append(buffer, n);
+			return;
+		}
+
+		// did not fit, format again directly into the string
+		size_t start = out.size();
+		out.resize(start + n + 1);
+		va_start(ap, fmt);
+		vsnprintf(&out[start], n + 1, fmt, ap);
+		va_end(ap);
+		out.resize(start + n);
+	}
+#pragma endregion
+#pragma region Hash
+	const unsigned long long Hash64Seed = 14695981039346656037ULL;
+
+	// FNV-1a, a hash of several pieces continues from the hash of the ones before (seed)
+	static inline unsigned long long Hash64(const void* data, size_t length, unsigned long long seed = Hash64Seed)
+	{
+		const unsigned char* bytes = (const unsigned char*)data;
+		for (size_t i = 0; i < length; i++)
+		{
+			seed ^= bytes[i];
+			seed *= 1099511628211ULL;
+		}
+		return seed;
+	}
 #pragma endregion
 #pragma region CRC32
 	extern unsigned int crc32_tab[];
@@ -119,13 +161,26 @@ namespace tools
 #pragma endregion
 
 #pragma region Command Line Parser
+	// input text owned by the embedding application (see cppReflector.h)
+	struct MemorySource
+	{
+		const char* data;
+		size_t length;
+	};
+
 	struct CommandLineParser
 	{
 		std::vector<std::string> names;
 		std::set<std::string> options;
 		std::map<std::string, std::vector<std::string> > optionsWithValues;
+		// names that are parsed from memory instead of being read from disk (they are in names as well)
+		std::map<std::string, MemorySource> memorySources;
 
 		static void parse(CommandLineParser& opts, int argc, char** argv);
+		// last value of --name=value as a number, or defaultValue when it is not given
+		long long intOption(const std::string& name, long long defaultValue) const;
+		// the memory source given for name, or 0 when it is a file
+		const MemorySource* memorySource(const std::string& name) const;
 	};
 #pragma endregion
 
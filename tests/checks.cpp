@@ -0,0 +1,41 @@
+#include "checks.h"
+#include <string.h>
+#include <exception>
+
+int CheckRegistration::Failures = 0;
+
+std::vector<CheckCase>& CheckRegistration::Cases()
+{
+	static std::vector<CheckCase> gCases;
+	return gCases;
+}
+
+// CppReflectorTests [name...] runs the given cases, or all of them
+int main(int argc, char** argv)
+{
+	int run = 0;
+	for (auto& it : CheckRegistration::Cases())
+	{
+		bool selected = argc < 2;
+		for (int i = 1; i < argc; i++)
+			selected |= strcmp(argv[i], it.name) == 0;
+		if (!selected)
+			continue;
+
+		int failuresBefore = CheckRegistration::Failures;
+		try
+		{
+			it.func();
+		}
+		catch (const std::exception& e)
+		{
+			fprintf(stderr, "%s: exception: %s\n", it.name, e.what());
+			CheckRegistration::Failures++;
+		}
+		printf("[CHECK] %s %s\n", it.name, CheckRegistration::Failures == failuresBefore ? "ok" : "FAILED");
+		run++;
+	}
+
+	printf("[CHECK] %d case(s), %d failure(s)\n", run, CheckRegistration::Failures);
+	return CheckRegistration::Failures == 0 && run > 0 ? 0 : 1;
+}
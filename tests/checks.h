@@ -0,0 +1,24 @@
+#pragma once
+
+#include <stdio.h>
+#include <vector>
+
+// Checks of the library internals, built as CppReflectorTests (see premake5.lua) and run by tests/run_checks.sh.
+// Every checks*.cpp registers its cases from static constructors, the same way the modules register themselves.
+struct CheckCase
+{
+	const char* name;
+	void (*func)();
+};
+
+class CheckRegistration
+{
+public:
+	CheckRegistration(const char* name, void (*func)()) { CheckCase c = { name, func }; Cases().push_back(c); }
+
+	static std::vector<CheckCase>& Cases();
+	static int Failures;
+};
+
+#define CHECK_CASE(name) static void name(); static CheckRegistration gCheck_##name(#name, &name); static void name()
+#define CHECK(expr) do { if (!(expr)) { fprintf(stderr, "%s(%d): check failed: %s\n", __FILE__, __LINE__, #expr); CheckRegistration::Failures++; } } while (0)
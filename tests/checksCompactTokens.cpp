@@ -0,0 +1,122 @@
+#include "checks.h"
+#include "cxxAstParser.h"
+#include <string>
+
+static const char* gSource =
+	"// comment in front\n"
+	"namespace ns {\n"
+	"/* a block comment */\n"
+	"class Sample\n"
+	"{\n"
+	"public:\n"
+	"	static const int count = 4;\n"
+	"	virtual void Run(int a, const char* b) throw ( int , float ) { if (a) { b++; } }\n"
+	"	int data[4][2]; //@<[Max(3)]\n"
+	"	unsigned flags : 3;\n"
+	"	Sample& operator = (const Sample& o) { return *this; }\n"
+	"	__attribute__ (( aligned ( 16 ) )) int aligned;\n"
+	"	static __declspec( thread ) int local;\n"
+	"};\n"
+	"template <class T> struct Box { T value; };\n"
+	"}\n"
+	"int (*callback)(int x, float y);\n";
+
+static std::string Spell(ASTTokenSource* source, ASTTokenIndex index)
+{
+	return source->Tokens[index].TokenData;
+}
+
+// the node types with the spelling of every token index they refer to, a range with all the tokens in between
+static void Dump(ASTNode* node, ASTTokenSource* source, std::string& out)
+{
+	out += node->GetTypeString();
+	ASTTokenNode* tokenNode = dynamic_cast<ASTTokenNode*>(node);
+	if (tokenNode)
+	{
+		for (auto it : tokenNode->Tokens)
+			out += " " + Spell(source, it);
+	}
+	ASTType* type = dynamic_cast<ASTType*>(node);
+	if (type)
+	{
+		for (auto& it : type->typeName)
+			out += " name:" + Spell(source, it.Index);
+		for (auto it : type->typeIdentifier)
+			out += " id:" + Spell(source, it);
+		for (auto& it : type->typeModifiers)
+		{
+			out += " mod:";
+			for (ASTTokenIndex i = it.first; i <= it.second; i++)
+				out += Spell(source, i);
+		}
+		for (auto it : type->typeOperatorTokens)
+			out += " op:" + Spell(source, it);
+		for (auto it : type->typeBitfieldTokens)
+			out += " bits:" + Spell(source, it);
+		for (auto& it : type->typeArrayTokens)
+		{
+			out += " array:";
+			for (auto it2 : it)
+				out += Spell(source, it2);
+		}
+	}
+	out += "\n";
+	for (auto it : node->Children())
+		Dump(it, source, out);
+}
+
+static size_t CountComments(ASTTokenSource* source)
+{
+	size_t ret = 0;
+	for (auto& it : source->Tokens)
+	{
+		if (it.TokenType == CxxToken::Type::CommentSingleLine || it.TokenType == CxxToken::Type::CommentMultiLine)
+			ret++;
+	}
+	return ret;
+}
+
+static void CheckCompaction(bool keepComments)
+{
+	CxxStringTokenizer tokenizer("sample.h", gSource);
+	ASTCxxParser parser(tokenizer);
+	ASTDataNode root;
+	root.SetType(ASTNode::Type::File);
+	ASTCxxParser::ASTPosition position(parser);
+	CHECK(parser.Parse(&root, position));
+
+	std::string before;
+	Dump(&root, &parser, before);
+	size_t tokensBefore = parser.Tokens.size();
+	size_t commentsBefore = CountComments(&parser);
+	CHECK(commentsBefore == 2);
+	ASTHash hash = root.StructuralHash();
+
+	size_t dropped = parser.CompactTokens(&root, keepComments);
+	CHECK(dropped > 0);
+	CHECK(parser.Tokens.size() == tokensBefore - dropped);
+	CHECK(CountComments(&parser) == (keepComments ? commentsBefore : 0));
+
+	// every node still spells the same tokens, ranges keep the whitespace between their ends
+	std::string after;
+	Dump(&root, &parser, after);
+	CHECK(after == before);
+	CHECK(after.find("mod:__attribute__ (( aligned ( 16 ) ))") != std::string::npos);
+	CHECK(after.find("mod:__declspec( thread )") != std::string::npos);
+
+	root.InvalidateStructuralHash();
+	CHECK(root.StructuralHash() == hash);
+
+	// compacting again has nothing left to drop
+	CHECK(parser.CompactTokens(&root, keepComments) == 0);
+}
+
+CHECK_CASE(CompactTokensRemap)
+{
+	CheckCompaction(false);
+}
+
+CHECK_CASE(CompactTokensKeepComments)
+{
+	CheckCompaction(true);
+}
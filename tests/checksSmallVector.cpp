@@ -0,0 +1,143 @@
+#include "checks.h"
+#include "smallVector.h"
+#include <string>
+
+// counts the live instances, so leaked or doubly destroyed elements show up
+struct Counted
+{
+	static int Live;
+	int value;
+	Counted(int v = 0) : value(v) { Live++; }
+	Counted(const Counted& o) : value(o.value) { Live++; }
+	Counted(Counted&& o) : value(o.value) { o.value = -1; Live++; }
+	~Counted() { Live--; }
+	Counted& operator = (const Counted& o) { value = o.value; return *this; }
+	bool operator == (const Counted& o) const { return value == o.value; }
+};
+int Counted::Live = 0;
+
+template <size_t N> static bool HasValues(const SmallVector<Counted, N>& v, int first, int count)
+{
+	if (v.size() != (size_t)count)
+		return false;
+	for (int i = 0; i < count; i++)
+	{
+		if (v[i].value != first + i)
+			return false;
+	}
+	return true;
+}
+
+CHECK_CASE(SmallVectorOverflow)
+{
+	{
+		SmallVector<Counted, 2> v;
+		CHECK(v.is_inline());
+		v.push_back(Counted(0));
+		v.push_back(Counted(1));
+		CHECK(v.is_inline());
+		CHECK(v.capacity() == 2);
+
+		// the third element moves the storage to the heap
+		v.push_back(Counted(2));
+		CHECK(!v.is_inline());
+		CHECK(v.capacity() >= 3);
+		for (int i = 3; i < 100; i++)
+			v.push_back(Counted(i));
+		CHECK(HasValues(v, 0, 100));
+		CHECK(Counted::Live == 100);
+
+		// an element of the vector itself while it grows
+		SmallVector<Counted, 1> w;
+		w.push_back(Counted(7));
+		w.push_back(w[0]);
+		CHECK(w.size() == 2 && w[0].value == 7 && w[1].value == 7);
+
+		v.pop_back();
+		CHECK(HasValues(v, 0, 99));
+		v.clear();
+		CHECK(v.empty());
+		CHECK(Counted::Live == 2);
+	}
+	CHECK(Counted::Live == 0);
+}
+
+CHECK_CASE(SmallVectorInsert)
+{
+	{
+		SmallVector<Counted, 4> v;
+		v.push_back(Counted(0));
+		v.push_back(Counted(3));
+		Counted middle[] = { Counted(1), Counted(2) };
+		v.insert(v.begin() + 1, middle, middle + 2);
+		CHECK(v.is_inline());
+		CHECK(HasValues(v, 0, 4));
+
+		// in the middle again, beyond the inline capacity
+		Counted more[] = { Counted(10), Counted(11), Counted(12) };
+		v.insert(v.begin() + 2, more, more + 3);
+		CHECK(!v.is_inline());
+		CHECK(v.size() == 7);
+		int expected[] = { 0, 1, 10, 11, 12, 2, 3 };
+		for (int i = 0; i < 7; i++)
+			CHECK(v[i].value == expected[i]);
+		CHECK(Counted::Live == 7 + 2 + 3);
+	}
+	CHECK(Counted::Live == 0);
+}
+
+CHECK_CASE(SmallVectorCopyMove)
+{
+	{
+		SmallVector<Counted, 2> inlineVector, heapVector;
+		inlineVector.push_back(Counted(0));
+		for (int i = 0; i < 5; i++)
+			heapVector.push_back(Counted(i));
+
+		// copies are independent of the original
+		SmallVector<Counted, 2> copy(heapVector);
+		CHECK(copy == heapVector);
+		copy[0].value = 42;
+		CHECK(heapVector[0].value == 0);
+		// the heap buffer is kept for smaller contents, like the capacity of a std::vector
+		copy = inlineVector;
+		CHECK(!copy.is_inline() && HasValues(copy, 0, 1));
+		copy = heapVector;
+		CHECK(HasValues(copy, 0, 5));
+		copy = copy;
+		CHECK(HasValues(copy, 0, 5));
+
+		// moving a heap vector takes its buffer, moving an inline vector moves the elements
+		const Counted* buffer = heapVector.begin();
+		SmallVector<Counted, 2> moved(std::move(heapVector));
+		CHECK(moved.begin() == buffer);
+		CHECK(HasValues(moved, 0, 5));
+		CHECK(heapVector.empty() && heapVector.is_inline());
+
+		SmallVector<Counted, 2> movedInline(std::move(inlineVector));
+		CHECK(movedInline.is_inline() && HasValues(movedInline, 0, 1));
+		CHECK(inlineVector.empty());
+
+		// move assignment releases what the target held
+		copy = std::move(moved);
+		CHECK(HasValues(copy, 0, 5));
+		CHECK(moved.empty());
+		copy = std::move(movedInline);
+		CHECK(HasValues(copy, 0, 1));
+		CHECK(movedInline.empty());
+
+		SmallVector<Counted, 2> a, b;
+		a.push_back(Counted(0));
+		for (int i = 0; i < 3; i++)
+			b.push_back(Counted(i));
+		a.swap(b);
+		CHECK(HasValues(a, 0, 3) && HasValues(b, 0, 1));
+		CHECK(Counted::Live == (int)(copy.size() + a.size() + b.size()));
+	}
+	CHECK(Counted::Live == 0);
+
+	SmallVector<std::string, 1> strings = { "a", "bb", "a much longer string than the small string buffer" };
+	SmallVector<std::string, 1> stringsCopy(strings);
+	strings.clear();
+	CHECK(stringsCopy.size() == 3 && stringsCopy[2] == "a much longer string than the small string buffer");
+}
@@ -0,0 +1,67 @@
+#include "checks.h"
+#include "symbols.h"
+#include <string>
+#include <thread>
+
+CHECK_CASE(SymbolsRoundTrip)
+{
+	SymbolTable table;
+	CHECK(table.Intern("") == SymbolTable::Empty);
+	CHECK(table.Lookup(SymbolTable::Empty).empty());
+
+	std::vector<std::string> names = { "int", "std::vector", "m_size", "operator []", "a", "A", "std::vector<int>" };
+	std::vector<SymbolId> ids;
+	for (auto& it : names)
+		ids.push_back(table.Intern(it));
+
+	for (size_t i = 0; i < names.size(); i++)
+	{
+		CHECK(ids[i] != SymbolTable::Empty);
+		CHECK(table.Lookup(ids[i]) == names[i]);
+		CHECK(table.Intern(names[i]) == ids[i]);
+		CHECK(table.Find(names[i]) == ids[i]);
+		for (size_t j = 0; j < i; j++)
+			CHECK(ids[i] != ids[j]);
+	}
+	CHECK(table.Count() == names.size());
+
+	// lookups by length, not by terminator
+	const char* text = "m_sizeX";
+	CHECK(table.Intern(text, 6) == table.Find("m_size"));
+	CHECK(table.Find("never interned") == SymbolTable::Empty);
+	CHECK(table.Count() == names.size());
+
+	table.Clear();
+	CHECK(table.Count() == 0);
+	CHECK(table.Find("int") == SymbolTable::Empty);
+}
+
+CHECK_CASE(SymbolsConcurrentIntern)
+{
+	// every thread interns the same names in another order, they all have to agree on the ids
+	SymbolTable table;
+	const int threadCount = 4, nameCount = 2000;
+	std::vector<std::vector<SymbolId>> ids(threadCount, std::vector<SymbolId>(nameCount));
+	std::vector<std::thread> threads;
+	for (int t = 0; t < threadCount; t++)
+	{
+		threads.push_back(std::thread([&, t]()
+		{
+			for (int i = 0; i < nameCount; i++)
+			{
+				int n = t % 2 ? nameCount - 1 - i : i;
+				ids[t][n] = table.Intern("name" + std::to_string(n));
+			}
+		}));
+	}
+	for (auto& it : threads)
+		it.join();
+
+	CHECK(table.Count() == (size_t)nameCount);
+	for (int i = 0; i < nameCount; i++)
+	{
+		for (int t = 1; t < threadCount; t++)
+			CHECK(ids[t][i] == ids[0][i]);
+		CHECK(table.Lookup(ids[0][i]) == "name" + std::to_string(i));
+	}
+}
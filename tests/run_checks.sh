@@ -0,0 +1,65 @@
+#!/bin/sh
+# Runs the checks of tests/: the library checks (CppReflectorTests) and the checks of the command line tool.
+# usage: tests/run_checks.sh <directory of CppReflector and CppReflectorTests>, from the repository root
+BIN=${1:?usage: tests/run_checks.sh <directory of CppReflector and CppReflectorTests>}
+INPUTS="tests/*.xh tests/*.xcpp"
+FAILED=0
+
+# output of the command line tool, the addresses in the names of anonymous namespaces and templates differ between runs
+run()
+{
+	"$BIN/CppReflector" "$@" 2>/dev/null | sed -E 's/(anon|tmpl)_[0-9A-F]{8}_[0-9A-F]{8}/\1/g'
+}
+
+# same <name> <expected output> <output>
+same()
+{
+	if [ -n "$2" ] && [ "$2" = "$3" ]; then
+		echo "[CHECK] $1 ok"
+	else
+		echo "[CHECK] $1 FAILED"
+		FAILED=1
+	fi
+}
+
+"$BIN/CppReflectorTests" || FAILED=1
+
+# the files go through the wire format of the shards (ASTSerializer) and are rebuilt in the main process
+GENERATORS="--module=cpp_parser --module=cpp_transfigure --module=print_structure --module=reflection_data --module=print_code"
+EXPECTED=$(run $GENERATORS $INPUTS)
+same ShardsRoundTrip "$EXPECTED" "$(run --shards=3 $GENERATORS $INPUTS)"
+same ShardsRoundTripKeepComments "$(run --keep-comments $GENERATORS $INPUTS)" "$(run --shards=2 --keep-comments $GENERATORS $INPUTS)"
+
+# standard input and named pipes are tokenized and parsed as the data arrives, the result has to equal the parse of the file
+PIPELINE="--module=cpp_parser_mt --module=cpp_transfigure --module=print_structure --module=reflection_data --module=print_code"
+TMP=$(mktemp -d)
+for f in $INPUTS; do
+	EXPECTED=$(run $GENERATORS "$f" | sed -e "s|FILE $f|FILE -|" -e "s|\"$f\"|\"-\"|")
+	same "Stdin $f" "$EXPECTED" "$(run $GENERATORS - < "$f")"
+	EXPECTED=$(run --jobs=4 $PIPELINE "$f" | sed -e "s|FILE $f|FILE -|" -e "s|\"$f\"|\"-\"|")
+	same "StdinPipeline $f" "$EXPECTED" "$(run --jobs=4 $PIPELINE - < "$f")"
+done
+if mkfifo "$TMP/input.h" 2>/dev/null; then
+	EXPECTED=$(run $GENERATORS tests/test1.xh | sed -e "s|tests/test1.xh|$TMP/input.h|")
+	cat tests/test1.xh > "$TMP/input.h" &
+	same Fifo "$EXPECTED" "$(run $GENERATORS "$TMP/input.h")"
+	wait
+fi
+rm -rf "$TMP"
+
+# the daemon parses only the files that changed since the last request, its output has to equal a fresh run
+TMP=$(mktemp -d)
+cp $INPUTS "$TMP"
+FILES=$(ls "$TMP"/*)
+"$BIN/CppReflector" --serve="$TMP/sock" 2>/dev/null &
+i=0
+while [ ! -S "$TMP/sock" ] && [ $i -lt 50 ]; do sleep 0.1; i=$((i + 1)); done
+same Daemon "$(run $GENERATORS $FILES)" "$(run --connect="$TMP/sock" $GENERATORS $FILES)"
+same DaemonCached "$(run $GENERATORS $FILES)" "$(run --connect="$TMP/sock" $GENERATORS $FILES)"
+printf '\nclass DaemonEdit\n{\n\tint added;\n};\n' >> "$TMP/test1.xh"
+same DaemonEdit "$(run $GENERATORS $FILES)" "$(run --connect="$TMP/sock" $GENERATORS $FILES)"
+"$BIN/CppReflector" --connect="$TMP/sock" --daemon-shutdown >/dev/null 2>&1
+wait
+rm -rf "$TMP"
+
+exit $FAILED